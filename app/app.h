@@ -11,11 +11,28 @@ typedef struct Settings {
 
     char* enc_name_v;
     char* enc_opts_v;
+    char* pix_fmt_v;
+
+    // container formats, NULL = guess, the output format is needed when writing to stdout
+    const char* in_format;
+    const char* out_format;
 
     char* filter_dir;
     char** filter_names;
     PXMap* filter_opts;
     int n_filters;
 
+    int queue_depth;
+    int filter_threads;
+    int strip_rows; // see PXContext::strip_rows
+    int dec_threads;
+    int enc_threads;
+    int n_jobs;
+    int n_segments;
+
+    int progress_interval; // ms between progress reports, 0 = none
+
+    const char* stats_file; // timings as JSON, "-" = stdout, NULL = none
+
     PXLogLevel log_level;
 } Settings;
@@ -0,0 +1,515 @@
+#include "batch.h"
+#include "stats.h"
+
+#include <pixie/pixie.h>
+
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// threads each file uses per stage, 0 = automatic
+typedef struct ThreadBudget {
+    int dec;
+    int filter;
+    int enc;
+} ThreadBudget;
+
+// a file, or a segment of one, to transcode
+typedef struct JobDesc {
+    const char* input_file;
+    char* output_file;
+    const PXSegment* segment; // NULL = the whole file
+} JobDesc;
+
+/**
+ * wakes up the thread running the batch when a job finishes, or when a job has made progress and a
+ * progress report is due, so that it doesn't have to poll the jobs
+ */
+typedef struct BatchEvents {
+    PXMutex lock;
+    PXCond cond;
+    bool pending; // guarded by `lock`
+
+    atomic_int_fast64_t next_report_ns; // px_time_ns() of the next progress report
+} BatchEvents;
+
+static void batch_events_notify(BatchEvents* ev) {
+    px_mutex_lock(&ev->lock);
+    ev->pending = true;
+    px_cond_signal(&ev->cond);
+    px_mutex_unlock(&ev->lock);
+}
+
+static void batch_events_wait(BatchEvents* ev) {
+    px_mutex_lock(&ev->lock);
+    while (!ev->pending)
+        px_cond_wait(&ev->cond, &ev->lock);
+    ev->pending = false;
+    px_mutex_unlock(&ev->lock);
+}
+
+// PXContext::progress_cb of every job, only wakes the batch thread once a report is due
+static void job_progress(void* opaque, [[maybe_unused]] const PXProgress* progress) {
+    BatchEvents* ev = opaque;
+    if (px_time_ns() >= ev->next_report_ns)
+        batch_events_notify(ev);
+}
+
+typedef struct Job {
+    const Settings* settings;
+    const JobDesc* desc;
+    ThreadBudget threads;
+    BatchEvents* events;
+
+    PXContext* pxc;
+    atomic_bool transcoding; // `pxc` is fully set up, its progress can be read
+    PXThread thread;
+} Job;
+
+// open the job's files and filters and transcode them, on the job's own thread
+static int job_run(void* arg) {
+    Job* job = arg;
+    const Settings* s = job->settings;
+
+    int ret = 0;
+    job->pxc = px_ctx_alloc();
+    if (!job->pxc) {
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+    PXContext* pxc = job->pxc;
+
+    // filter instances keep per-file state in `user_data`, so every job gets its own
+    const char* const* filter_names_view = (const char* const*)s->filter_names;
+    ret = px_filter_ctx_new(&pxc->fltr_ctx, s->filter_dir, filter_names_view, s->filter_opts, s->n_filters);
+    if (ret < 0)
+        goto end;
+
+    pxc->queue_depth = s->queue_depth;
+    pxc->filter_threads = job->threads.filter;
+    pxc->strip_rows = s->strip_rows;
+    if (s->progress_interval > 0) {
+        pxc->progress_cb = job_progress;
+        pxc->progress_opaque = job->events;
+        pxc->progress_interval_ms = s->progress_interval;
+    }
+
+    PXMediaSettings media_settings = {
+        .enc_name_v = s->enc_name_v,
+        .enc_opts_v = s->enc_opts_v,
+        .pix_fmt_v = s->pix_fmt_v,
+        .fltr_ctx = pxc->fltr_ctx,
+        .dec_threads = job->threads.dec,
+        .enc_threads = job->threads.enc,
+        .segment = job->desc->segment,
+        .in_format = s->in_format,
+        .out_format = s->out_format,
+    };
+    // TODO: check if input is same as output
+    ret = px_media_ctx_new(&pxc->media_ctx, job->desc->input_file, job->desc->output_file, &media_settings);
+    if (ret < 0)
+        goto end;
+
+    job->transcoding = true;
+    ret = px_transcode(pxc);
+
+end:
+    job->thread.done = true;
+    batch_events_notify(job->events);
+    return ret;
+}
+
+static void job_free(Job* job) {
+    px_ctx_free(&job->pxc);
+    job->transcoding = false;
+}
+
+static char* get_output_file(const Settings* s, const char* input_file) {
+    if (s->n_input_files == 1)
+        return strdup(s->output_file);
+
+    // output is a directory, keep the input's name
+    const char* basename = px_get_basename(input_file);
+    size_t len = strlen(s->output_file) + strlen(PX_PATH_SEP) + strlen(basename) + 1;
+    char* output_file = malloc(len);
+    if (!output_file) {
+        px_oom_msg(len);
+        return NULL;
+    }
+
+    snprintf(output_file, len, "%s" PX_PATH_SEP "%s", s->output_file, basename);
+    return output_file;
+}
+
+// segments are encoded into NUT files, which keep the encoder's timestamps exactly
+static char* get_segment_file(const char* output_file, int seg_idx) {
+    int len = snprintf(NULL, 0, "%s.part%d.nut", output_file, seg_idx) + 1;
+    char* seg_file = malloc((size_t)len);
+    if (!seg_file) {
+        px_oom_msg((size_t)len);
+        return NULL;
+    }
+
+    snprintf(seg_file, (size_t)len, "%s.part%d.nut", output_file, seg_idx);
+    return seg_file;
+}
+
+static int job_start(Job* job, const Settings* s, const JobDesc* desc, ThreadBudget threads,
+                     BatchEvents* events) {
+    *job = (Job) {
+        .settings = s,
+        .desc = desc,
+        .threads = threads,
+        .events = events,
+    };
+
+    job->thread = (PXThread) {.func = job_run, .args = job};
+    int ret = px_thrd_launch(&job->thread);
+    if (ret != 0) {
+        job->thread.func = NULL;
+        return ret < 0 ? ret : PXERROR(ret);
+    }
+
+    return 0;
+}
+
+// join a finished job and report its result
+static int job_finish(Job* job) {
+    int transc_ret = 0;
+    int ret = px_thrd_join(&job->thread, &transc_ret);
+    if (ret == 0 && transc_ret < 0) {
+        ret = transc_ret;
+        px_log(PX_LOG_ERROR, "Error occurred while processing file \"%s\" (stream index %d)\n",
+               job->desc->input_file, job->pxc && job->pxc->media_ctx ? job->pxc->media_ctx->stream_idx : -1);
+    } else if (ret > 0) {
+        ret = PXERROR(ret);
+    }
+
+    job_free(job);
+    return ret;
+}
+
+// -et, or the encoder's `threads` option, 0 if neither was set
+static int get_enc_threads(const Settings* s) {
+    if (s->enc_threads > 0 || !s->enc_opts_v)
+        return s->enc_threads;
+
+    PXMap enc_opts = {0};
+    if (px_map_parse(&enc_opts, s->enc_opts_v) < 0)
+        return 0;
+
+    int enc_threads = 0;
+    if (px_map_get_int(&enc_opts, &enc_threads, "threads") < 0 || enc_threads < 0)
+        enc_threads = 0;
+
+    px_map_free(&enc_opts);
+    return enc_threads;
+}
+
+static inline int max_int(int a, int b) {
+    return a > b ? a : b;
+}
+
+/**
+ * the number of files (or segments) to transcode at once, `settings->n_jobs` if set
+ * otherwise, as many as fit in the available CPU threads if each file's stages use the number of threads
+ * they were given, or 1 each if they weren't
+ */
+static int get_n_jobs(const Settings* s, int n_descs) {
+    int n_jobs = s->n_jobs;
+    if (n_jobs <= 0) {
+        int threads_per_job = max_int(s->dec_threads, 1) + max_int(get_enc_threads(s), 1);
+        if (s->n_filters > 0)
+            threads_per_job += max_int(s->filter_threads, 1);
+
+        n_jobs = px_get_available_threads() / threads_per_job;
+    }
+
+    if (n_jobs > n_descs)
+        n_jobs = n_descs;
+    return n_jobs < 1 ? 1 : n_jobs;
+}
+
+/**
+ * split each file's share of the CPU threads between the stages that weren't given a number of threads,
+ * so that the decoder, filters and encoder don't all size themselves for the whole machine
+ * encoding usually costs the most, so the encoder gets as many threads as decoding and filtering combined
+ */
+static ThreadBudget get_thread_budget(const Settings* s, int n_jobs) {
+    ThreadBudget budget = {
+        .dec = s->dec_threads,
+        .filter = s->filter_threads,
+        .enc = get_enc_threads(s),
+    };
+
+    bool filtering = s->n_filters > 0;
+    int dec_weight = budget.dec ? 0 : 1;
+    int filter_weight = budget.filter || !filtering ? 0 : 1;
+    int enc_weight = budget.enc ? 0 : dec_weight + filter_weight;
+    int total_weight = dec_weight + filter_weight + enc_weight;
+    if (!total_weight)
+        return budget;
+
+    int left = px_get_available_threads() / n_jobs - budget.dec - budget.enc;
+    if (filtering)
+        left -= budget.filter;
+    if (dec_weight)
+        budget.dec = max_int(left * dec_weight / total_weight, 1);
+    if (filter_weight)
+        budget.filter = max_int(left * filter_weight / total_weight, 1);
+    if (enc_weight)
+        budget.enc = max_int(left * enc_weight / total_weight, 1);
+
+    return budget;
+}
+
+typedef struct BatchProgress {
+    int jobs_done;
+    uint64_t frames_decoded;
+    uint64_t frames_dropped;
+    uint64_t frames_output;
+
+    // summed over the jobs, `duration_us` is -1 if any of them is unknown
+    int64_t duration_us;
+    int64_t out_time_us;
+} BatchProgress;
+
+static void add_progress(BatchProgress* total, const PXProgress* progress) {
+    total->frames_decoded += progress->frames_decoded;
+    total->frames_dropped += progress->frames_dropped;
+    total->frames_output += progress->frames_output;
+    total->out_time_us += progress->out_time_us;
+    if (total->duration_us >= 0)
+        total->duration_us = progress->duration_us < 0 ? -1 : total->duration_us + progress->duration_us;
+}
+
+static void print_progress(const BatchProgress* done, const Job* jobs, int n_jobs, int n_descs,
+                           const char* unit, int64_t start_ns) {
+    BatchProgress total = *done;
+    int n_transcoding = 0;
+    for (int i = 0; i < n_jobs; i++) {
+        if (!jobs[i].transcoding)
+            continue;
+
+        PXProgress progress;
+        px_get_progress(jobs[i].pxc, &progress);
+        add_progress(&total, &progress);
+        n_transcoding++;
+    }
+
+    char line[256];
+    int len = 0;
+    if (n_descs > 1)
+        len += snprintf(line, sizeof line, "Finished %d/%d %s, ", total.jobs_done, n_descs, unit);
+
+    double elapsed = (double)(px_time_ns() - start_ns) / 1e9;
+    double fps = elapsed > 0 ? (double)total.frames_output / elapsed : 0.0;
+    double speed = elapsed > 0 ? (double)total.out_time_us / 1e6 / elapsed : 0.0;
+    len += snprintf(line + len, sizeof line - (size_t)len,
+                    "Decoded %" PRIu64 " frames, dropped %" PRIu64 " frames, encoded %" PRIu64
+                    " frames, %.1f fps, %.2fx",
+                    total.frames_decoded, total.frames_dropped, total.frames_output, fps, speed);
+
+    // the time left is only known once every job has been opened
+    bool all_opened = total.jobs_done + n_transcoding == n_descs;
+    if (all_opened && total.duration_us > 0 && speed > 0 && total.jobs_done < n_descs) {
+        int64_t left_us = total.duration_us - total.out_time_us;
+        int eta = left_us > 0 ? (int)((double)left_us / 1e6 / speed) : 0;
+        snprintf(line + len, sizeof line - (size_t)len, ", ETA %d:%02d:%02d", eta / 3600, eta / 60 % 60,
+                 eta % 60);
+    }
+
+    px_log(PX_LOG_PROGRESS, "%s\r", line);
+}
+
+// transcode every one of `descs`, running up to `settings->n_jobs` of them at once
+// the timings of every job that got to transcode are added to `stats`
+static int run_jobs(const Settings* s, const JobDesc* descs, int n_descs, const char* unit,
+                    BatchStats* stats) {
+    int n_jobs = get_n_jobs(s, n_descs);
+    ThreadBudget threads = get_thread_budget(s, n_jobs);
+
+    px_log(PX_LOG_INFO,
+           "Transcoding up to %d %s at once, each with %d decoder, %d filter and %d encoder threads\n",
+           n_jobs, unit, threads.dec, threads.filter, threads.enc);
+
+    Job* jobs = calloc((size_t)n_jobs, sizeof *jobs);
+    if (!jobs) {
+        px_oom_msg((size_t)n_jobs * sizeof *jobs);
+        return PXERROR(ENOMEM);
+    }
+
+    int64_t start_ns = px_time_ns();
+    int64_t interval_ns = s->progress_interval * INT64_C(1000000);
+    BatchEvents events = {.next_report_ns = start_ns + interval_ns};
+    if (px_mutex_init(&events.lock) != 0) {
+        free(jobs);
+        return PXERROR(EAGAIN);
+    }
+    if (px_cond_init(&events.cond) != 0) {
+        px_mutex_destroy(&events.lock);
+        free(jobs);
+        return PXERROR(EAGAIN);
+    }
+
+    // keep going after a job fails so that one broken input doesn't stop the whole batch
+    int ret = 0;
+    int next_desc = 0;
+    int n_running = 0;
+    BatchProgress done = {0};
+
+    while (next_desc < n_descs || n_running > 0) {
+        for (int i = 0; i < n_jobs && next_desc < n_descs; i++) {
+            if (jobs[i].thread.func)
+                continue;
+
+            int job_ret = job_start(&jobs[i], s, &descs[next_desc++], threads, &events);
+            if (job_ret < 0) {
+                ret = ret < 0 ? ret : job_ret;
+                done.jobs_done++;
+                continue;
+            }
+            n_running++;
+        }
+
+        // woken up by a job finishing or a report being due, instead of polling
+        if (n_running > 0)
+            batch_events_wait(&events);
+
+        int64_t now = px_time_ns();
+        if (interval_ns > 0 && now >= events.next_report_ns) {
+            print_progress(&done, jobs, n_jobs, n_descs, unit, start_ns);
+            events.next_report_ns = now + interval_ns;
+        }
+
+        for (int i = 0; i < n_jobs; i++) {
+            if (!jobs[i].thread.func || !jobs[i].thread.done)
+                continue;
+
+            if (jobs[i].transcoding) {
+                PXProgress progress;
+                px_get_progress(jobs[i].pxc, &progress);
+                add_progress(&done, &progress);
+                batch_stats_add(stats, jobs[i].pxc->media_ctx->stats);
+            }
+
+            int job_ret = job_finish(&jobs[i]);
+            if (job_ret < 0 && ret >= 0)
+                ret = job_ret;
+
+            jobs[i].thread.func = NULL;
+            done.jobs_done++;
+            n_running--;
+        }
+    }
+
+    print_progress(&done, jobs, n_jobs, n_descs, unit, start_ns);
+    // the progress line goes to stderr, stdout may be the output file
+    if (px_global_log_level >= PX_LOG_PROGRESS)
+        fputc('\n', stderr);
+
+    px_cond_destroy(&events.cond);
+    px_mutex_destroy(&events.lock);
+    free(jobs);
+    return ret;
+}
+
+// split `file` into `settings->n_segments` segments at keyframes, transcode them at once and join them
+static int transcode_segmented(const Settings* s, const JobDesc* file, BatchStats* stats) {
+    PXSegment* segments = NULL;
+    int n_segs = 0;
+    int ret = px_find_segments(&segments, &n_segs, file->input_file, s->n_segments);
+    if (ret < 0)
+        return ret;
+
+    const char* seg_files[n_segs];
+    JobDesc* descs = calloc((size_t)n_segs, sizeof *descs);
+    if (!descs) {
+        px_oom_msg((size_t)n_segs * sizeof *descs);
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int i = 0; i < n_segs; i++) {
+        descs[i] = (JobDesc) {
+            .input_file = file->input_file,
+            .output_file = get_segment_file(file->output_file, i),
+            .segment = &segments[i],
+        };
+        if (!descs[i].output_file) {
+            ret = PXERROR(ENOMEM);
+            goto end;
+        }
+        seg_files[i] = descs[i].output_file;
+    }
+
+    ret = run_jobs(s, descs, n_segs, "segments", stats);
+    if (ret < 0)
+        goto end;
+
+    ret = px_concat_segments(file->output_file, file->input_file, seg_files, n_segs);
+
+end:
+    for (int i = 0; descs && i < n_segs; i++) {
+        if (descs[i].output_file)
+            remove(descs[i].output_file);
+        px_free(&descs[i].output_file);
+    }
+    free(descs);
+    free(segments);
+    return ret;
+}
+
+int run_batch(const Settings* s) {
+    BatchStats stats;
+    int ret = batch_stats_init(&stats, s->n_filters);
+    if (ret < 0)
+        return ret;
+
+    JobDesc* descs = calloc((size_t)s->n_input_files, sizeof *descs);
+    if (!descs) {
+        px_oom_msg((size_t)s->n_input_files * sizeof *descs);
+        batch_stats_free(&stats);
+        return PXERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < s->n_input_files; i++) {
+        descs[i].input_file = s->input_files[i];
+        descs[i].output_file = get_output_file(s, s->input_files[i]);
+        if (!descs[i].output_file) {
+            ret = PXERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    if (s->n_segments <= 1) {
+        ret = run_jobs(s, descs, s->n_input_files, "files", &stats);
+        goto report;
+    }
+
+    // files are split one at a time, their segments are what's transcoded at once
+    for (int i = 0; i < s->n_input_files; i++) {
+        int file_ret = transcode_segmented(s, &descs[i], &stats);
+        if (file_ret < 0) {
+            px_log(PX_LOG_ERROR, "Error occurred while processing file \"%s\"\n", descs[i].input_file);
+            ret = ret < 0 ? ret : file_ret;
+        }
+    }
+
+report:
+    batch_stats_print(&stats, s);
+    if (s->stats_file) {
+        int stats_ret = batch_stats_write_json(&stats, s);
+        ret = ret < 0 ? ret : stats_ret;
+    }
+
+end:
+    for (int i = 0; i < s->n_input_files; i++) {
+        px_free(&descs[i].output_file);
+    }
+    free(descs);
+    batch_stats_free(&stats);
+    return ret;
+}
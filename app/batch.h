@@ -0,0 +1,6 @@
+#pragma once
+
+#include "app.h"
+
+// transcode every input file, running up to `settings->n_jobs` of them at once
+int run_batch(const Settings* settings);
@@ -11,11 +11,23 @@
 
 static const char* const full_help_msg =
     "Options:\n"
-    "  -i <file> [...]                  Input file(s), separated by space\n"
-    "  -o <file>                        Output file, treated as a folder if more than one input\n"
+    "  -i <file> [...]                  Input file(s), separated by space, - = stdin\n"
+    "  -o <file>                        Output file, treated as a folder if more than one input, - = stdout\n"
     "  -e <encoder>[:opt=val:...]       Video encoder name and optionally settings\n"
+    "  -p <format>                      Video encoder pixel format (default: picked to avoid conversions)\n"
+    "  -if <format>                     Input container format (default: guessed)\n"
+    "  -of <format>                     Output container format (default: guessed from the file name)\n"
     "  -f <filter>[:opt=val:...] [...]  Video filter names and optionally settings, filters separated by space\n"
     "  -d <dir>                         Directory to load filters from\n"
+    "  -q <n>                           Decode, filter and encode in parallel, buffering up to n frames\n"
+    "  -t <n>                           Number of threads to run filters on (default: 0 = auto)\n"
+    "  -sr <n>                          Rows per filter strip, auto = fit in L2 (default: 0 = off)\n"
+    "  -dt <n>                          Number of threads per video decoder (default: 0 = auto)\n"
+    "  -et <n>                          Number of threads per video encoder (default: 0 = auto)\n"
+    "  -j <n>                           Number of input files to process at once (default: 0 = auto)\n"
+    "  -s <n>                           Split each input into n segments, transcoded at once (default: 1)\n"
+    "  -pi <ms>                         Milliseconds between progress reports, 0 to disable (default: 500)\n"
+    "  -sj <file>                       Write time spent per stage and filter as JSON (- = stdout)\n"
     "  -l <level>                       Log level: quiet|error|progress|warn|info|verbose (default: progress)\n"
     "  -h                               Print this help message";
 
@@ -119,6 +131,30 @@ int parse_args(int argc, char** argv, Settings* s) {
             continue;
         }
 
+        if (opt_matches(opt, "--pix-fmt", "-p")) {
+            s->pix_fmt_v = *++arg_it;
+            if (!is_value(s->pix_fmt_v))
+                return missing_value(opt);
+
+            continue;
+        }
+
+        if (opt_matches(opt, "--input-format", "-if")) {
+            s->in_format = *++arg_it;
+            if (!is_value(s->in_format))
+                return missing_value(opt);
+
+            continue;
+        }
+
+        if (opt_matches(opt, "--output-format", "-of")) {
+            s->out_format = *++arg_it;
+            if (!is_value(s->out_format))
+                return missing_value(opt);
+
+            continue;
+        }
+
         if (opt_matches(opt, "--video-filters", "-f")) {
             s->filter_names = ++arg_it;
             if (!is_value(s->filter_names[0]))
@@ -167,6 +203,123 @@ int parse_args(int argc, char** argv, Settings* s) {
             continue;
         }
 
+        if (opt_matches(opt, "--queue-depth", "-q")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            int ret = px_strtoi(&s->queue_depth, value);
+            if (ret < 0 || s->queue_depth < 0) {
+                px_log(PX_LOG_ERROR, "Invalid queue depth: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--filter-threads", "-t")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            int ret = px_strtoi(&s->filter_threads, value);
+            if (ret < 0 || s->filter_threads < 0) {
+                px_log(PX_LOG_ERROR, "Invalid number of filter threads: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--strip-rows", "-sr")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            if (strcmp(value, "auto") == 0) {
+                s->strip_rows = -1;
+                continue;
+            }
+
+            int ret = px_strtoi(&s->strip_rows, value);
+            if (ret < 0 || s->strip_rows < 0) {
+                px_log(PX_LOG_ERROR, "Invalid number of strip rows: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--decoder-threads", "-dt")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            int ret = px_strtoi(&s->dec_threads, value);
+            if (ret < 0 || s->dec_threads < 0) {
+                px_log(PX_LOG_ERROR, "Invalid number of decoder threads: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--encoder-threads", "-et")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            int ret = px_strtoi(&s->enc_threads, value);
+            if (ret < 0 || s->enc_threads < 0) {
+                px_log(PX_LOG_ERROR, "Invalid number of encoder threads: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--jobs", "-j")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            int ret = px_strtoi(&s->n_jobs, value);
+            if (ret < 0 || s->n_jobs < 0) {
+                px_log(PX_LOG_ERROR, "Invalid number of jobs: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--segments", "-s")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            int ret = px_strtoi(&s->n_segments, value);
+            if (ret < 0 || s->n_segments < 0) {
+                px_log(PX_LOG_ERROR, "Invalid number of segments: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--progress-interval", "-pi")) {
+            const char* value = *++arg_it;
+            if (!is_value(value))
+                return missing_value(opt);
+
+            int ret = px_strtoi(&s->progress_interval, value);
+            if (ret < 0 || s->progress_interval < 0) {
+                px_log(PX_LOG_ERROR, "Invalid progress interval: \"%s\"\n", value);
+                return PXERROR(EINVAL);
+            }
+            continue;
+        }
+
+        if (opt_matches(opt, "--stats-json", "-sj")) {
+            s->stats_file = *++arg_it;
+            if (!is_value(s->stats_file))
+                return missing_value(opt);
+
+            continue;
+        }
+
         if (opt_matches(opt, "--log-level", "-l")) {
             const char* value = *++arg_it;
             if (!is_value(value))
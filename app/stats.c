@@ -0,0 +1,183 @@
+#include "stats.h"
+
+#include <pixie/log.h>
+#include <pixie/util/utils.h>
+
+#include <inttypes.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int batch_stats_init(BatchStats* bs, int n_filters) {
+    *bs = (BatchStats) {.start_ns = px_time_ns()};
+    if (n_filters <= 0)
+        return 0;
+
+    bs->filters = calloc((size_t)n_filters, sizeof *bs->filters);
+    if (!bs->filters) {
+        px_oom_msg((size_t)n_filters * sizeof *bs->filters);
+        return PXERROR(ENOMEM);
+    }
+    bs->n_filters = n_filters;
+
+    return 0;
+}
+
+void batch_stats_free(BatchStats* bs) {
+    px_free(&bs->filters);
+    bs->n_filters = 0;
+}
+
+static void add_stage_time(PXStageTime* total, const PXStageTime* time) {
+    total->calls += time->calls;
+    total->wall_ns += time->wall_ns;
+    // CPU time is either measured everywhere or nowhere
+    total->cpu_ns = time->cpu_ns < 0 ? -1 : total->cpu_ns + time->cpu_ns;
+}
+
+void batch_stats_add(BatchStats* bs, const PXStats* stats) {
+    for (int i = 0; i < PX_STAGE_COUNT; i++) {
+        PXStageTime time;
+        if (px_stats_get_stage(stats, i, &time) == 0)
+            add_stage_time(&bs->stages[i], &time);
+    }
+
+    for (int i = 0; i < bs->n_filters && i < px_stats_num_filters(stats); i++) {
+        PXStageTime time;
+        if (px_stats_get_filter(stats, i, &time) == 0)
+            add_stage_time(&bs->filters[i], &time);
+    }
+
+    for (int i = 0; i < PX_QUEUE_COUNT; i++) {
+        PXQueueUsage usage;
+        if (px_stats_get_queue(stats, i, &usage) < 0)
+            continue;
+
+        PXQueueUsage* total = &bs->queues[i];
+        if (usage.capacity > total->capacity)
+            total->capacity = usage.capacity;
+        if (usage.max_len > total->max_len)
+            total->max_len = usage.max_len;
+        total->pushes += usage.pushes;
+        total->total_len += usage.total_len;
+    }
+}
+
+static int64_t total_wall_ns(const BatchStats* bs) {
+    int64_t total = 0;
+    for (int i = 0; i < PX_STAGE_COUNT; i++) {
+        total += bs->stages[i].wall_ns;
+    }
+    for (int i = 0; i < bs->n_filters; i++) {
+        total += bs->filters[i].wall_ns;
+    }
+    return total;
+}
+
+static void print_stage_time(const char* name, const PXStageTime* time, int64_t total_ns) {
+    double share = total_ns > 0 ? 100.0 * (double)time->wall_ns / (double)total_ns : 0.0;
+    if (time->cpu_ns < 0) {
+        px_log(PX_LOG_PROGRESS, "  %-24s %10" PRIu64 " %12.1f %12s %6.1f%%\n", name, time->calls,
+               (double)time->wall_ns / 1e6, "-", share);
+        return;
+    }
+
+    px_log(PX_LOG_PROGRESS, "  %-24s %10" PRIu64 " %12.1f %12.1f %6.1f%%\n", name, time->calls,
+           (double)time->wall_ns / 1e6, (double)time->cpu_ns / 1e6, share);
+}
+
+void batch_stats_print(const BatchStats* bs, const Settings* s) {
+    int64_t total_ns = total_wall_ns(bs);
+
+    px_log(PX_LOG_PROGRESS, "Finished in %.2f s, time spent per stage (summed over threads):\n",
+           (double)(px_time_ns() - bs->start_ns) / 1e9);
+    px_log(PX_LOG_PROGRESS, "  %-24s %10s %12s %12s %7s\n", "stage", "calls", "wall (ms)", "cpu (ms)",
+           "share");
+
+    for (int i = 0; i < PX_STAGE_COUNT; i++) {
+        print_stage_time(px_stage_name(i), &bs->stages[i], total_ns);
+
+        // filters run between importing and exporting
+        if (i != PX_STAGE_IMPORT)
+            continue;
+
+        for (int j = 0; j < bs->n_filters; j++) {
+            char name[25];
+            snprintf(name, sizeof name, "filter %s", s->filter_names[j]);
+            print_stage_time(name, &bs->filters[j], total_ns);
+        }
+    }
+
+    if (!s->queue_depth)
+        return;
+
+    px_log(PX_LOG_PROGRESS, "  %-24s %10s %12s %12s\n", "queue", "capacity", "avg length", "max length");
+    for (int i = 0; i < PX_QUEUE_COUNT; i++) {
+        const PXQueueUsage* usage = &bs->queues[i];
+        double avg_len = usage->pushes ? (double)usage->total_len / (double)usage->pushes : 0.0;
+        px_log(PX_LOG_PROGRESS, "  %-24s %10d %12.1f %12d\n", px_queue_name(i), usage->capacity, avg_len,
+               usage->max_len);
+    }
+}
+
+// filter names come from the command line, so they may need escaping
+static void write_json_string(FILE* file, const char* str) {
+    fputc('"', file);
+    for (const char* it = str; *it; it++) {
+        if (*it == '"' || *it == '\\')
+            fprintf(file, "\\%c", *it);
+        else if ((unsigned char)*it < 0x20)
+            fprintf(file, "\\u%04x", (unsigned)*it);
+        else
+            fputc(*it, file);
+    }
+    fputc('"', file);
+}
+
+static void write_json_stage_time(FILE* file, const PXStageTime* time) {
+    fprintf(file, ", \"calls\": %" PRIu64 ", \"wall_ns\": %" PRId64 ", ", time->calls, time->wall_ns);
+    if (time->cpu_ns < 0)
+        fprintf(file, "\"cpu_ns\": null}");
+    else
+        fprintf(file, "\"cpu_ns\": %" PRId64 "}", time->cpu_ns);
+}
+
+int batch_stats_write_json(const BatchStats* bs, const Settings* s) {
+    bool to_stdout = strcmp(s->stats_file, "-") == 0;
+    FILE* file = to_stdout ? stdout : fopen(s->stats_file, "w");
+    if (!file) {
+        px_log(PX_LOG_ERROR, "Failed to open \"%s\": %s\n", s->stats_file,
+               px_last_os_errstr((char[256]) {0}, 0));
+        return PXERROR(EIO);
+    }
+
+    fprintf(file, "{\n  \"elapsed_ns\": %" PRId64 ",\n  \"stages\": [\n", px_time_ns() - bs->start_ns);
+    for (int i = 0; i < PX_STAGE_COUNT; i++) {
+        fprintf(file, "    {\"name\": \"%s\"", px_stage_name(i));
+        write_json_stage_time(file, &bs->stages[i]);
+        fprintf(file, "%s\n", i < PX_STAGE_COUNT - 1 ? "," : "");
+    }
+
+    fprintf(file, "  ],\n  \"filters\": [\n");
+    for (int i = 0; i < bs->n_filters; i++) {
+        fprintf(file, "    {\"name\": ");
+        write_json_string(file, s->filter_names[i]);
+        write_json_stage_time(file, &bs->filters[i]);
+        fprintf(file, "%s\n", i < bs->n_filters - 1 ? "," : "");
+    }
+
+    fprintf(file, "  ],\n  \"queues\": [\n");
+    for (int i = 0; i < PX_QUEUE_COUNT; i++) {
+        const PXQueueUsage* usage = &bs->queues[i];
+        double avg_len = usage->pushes ? (double)usage->total_len / (double)usage->pushes : 0.0;
+        fprintf(file, "    {\"name\": \"%s\", \"capacity\": %d, \"avg_len\": %.3f, \"max_len\": %d}%s\n",
+                px_queue_name(i), usage->capacity, avg_len, usage->max_len,
+                i < PX_QUEUE_COUNT - 1 ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+
+    if (!to_stdout)
+        fclose(file);
+    return 0;
+}
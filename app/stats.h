@@ -0,0 +1,28 @@
+#pragma once
+
+#include "app.h"
+
+#include <pixie/stats.h>
+
+// timings of every job in a batch added together
+typedef struct BatchStats {
+    PXStageTime stages[PX_STAGE_COUNT];
+    PXQueueUsage queues[PX_QUEUE_COUNT];
+
+    PXStageTime* filters;
+    int n_filters;
+
+    int64_t start_ns; // px_time_ns() when the batch started
+} BatchStats;
+
+int batch_stats_init(BatchStats* bs, int n_filters);
+void batch_stats_free(BatchStats* bs);
+
+// add a finished job's timings
+void batch_stats_add(BatchStats* bs, const PXStats* stats);
+
+// log a table of the time spent in each stage and filter, and how full the queues were
+void batch_stats_print(const BatchStats* bs, const Settings* s);
+
+// write the same as JSON to `settings->stats_file`, "-" being stdout
+int batch_stats_write_json(const BatchStats* bs, const Settings* s);
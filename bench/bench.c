@@ -0,0 +1,827 @@
+#include "../src/internals.h"
+
+#include <pixie/pixie.h>
+#include <pixie/util/strconv.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// counting allocations relies on glibc exporting its allocator under other names as well,
+// and sanitizers replace malloc() themselves
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define BENCH_SANITIZED
+#endif
+#endif
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(BENCH_SANITIZED)
+#define BENCH_COUNT_ALLOCS
+#endif
+
+#ifdef BENCH_COUNT_ALLOCS
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t align, size_t size);
+
+static atomic_size_t bytes_allocated;
+
+// these replace libc's for the whole process, including libpixie and FFmpeg
+void* malloc(size_t size) {
+    bytes_allocated += size;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    bytes_allocated += n * size;
+    return __libc_calloc(n, size);
+}
+
+// counts the new size, so growing a buffer counts more than what is actually added
+void* realloc(void* ptr, size_t size) {
+    bytes_allocated += size;
+    return __libc_realloc(ptr, size);
+}
+
+void* aligned_alloc(size_t align, size_t size) {
+    bytes_allocated += size;
+    return __libc_memalign(align, size);
+}
+
+void* memalign(size_t align, size_t size) {
+    bytes_allocated += size;
+    return __libc_memalign(align, size);
+}
+
+int posix_memalign(void** ptr, size_t align, size_t size) {
+    bytes_allocated += size;
+    *ptr = __libc_memalign(align, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+#endif
+
+// synthetic frames are cycled through instead of generating a new one for every iteration
+#define N_SOURCE_FRAMES 4
+
+#define BENCH_FPS 25
+
+#define HELP_PRINTED 1
+
+typedef struct BenchSettings {
+    int width;
+    int height;
+    int n_frames;
+
+    const char* encoder;
+    int queue_depth;
+    int filter_threads;
+
+    const char* tmp_dir;
+    const char* output_file; // NULL = stdout
+} BenchSettings;
+
+typedef struct BenchResult {
+    const char* stage;
+    char pix_fmt[PX_PIX_FMT_MAX_NAME_LEN];
+
+    uint64_t frames;
+    int64_t ns;
+    size_t bytes_allocated;
+} BenchResult;
+
+typedef struct BenchResults {
+    BenchResult* arr;
+    int n;
+    int capacity;
+} BenchResults;
+
+static size_t get_bytes_allocated(void) {
+#ifdef BENCH_COUNT_ALLOCS
+    return bytes_allocated;
+#else
+    return 0;
+#endif
+}
+
+typedef struct Stopwatch {
+    int64_t start_ns;
+    size_t start_bytes;
+} Stopwatch;
+
+static Stopwatch stopwatch_start(void) {
+    return (Stopwatch) {.start_bytes = get_bytes_allocated(), .start_ns = px_time_ns()};
+}
+
+static int add_result(BenchResults* results, const BenchSettings* s, const char* stage, PXPixelFormat pix_fmt,
+                      uint64_t frames, Stopwatch sw) {
+    int64_t ns = px_time_ns() - sw.start_ns;
+    size_t bytes = get_bytes_allocated() - sw.start_bytes;
+
+    if (results->n == results->capacity) {
+        int new_capacity = results->capacity ? results->capacity * 2 : 64;
+        BenchResult* arr = realloc(results->arr, (size_t)new_capacity * sizeof *arr);
+        if (!arr) {
+            px_oom_msg((size_t)new_capacity * sizeof *arr);
+            return PXERROR(ENOMEM);
+        }
+        results->arr = arr;
+        results->capacity = new_capacity;
+    }
+
+    BenchResult* res = &results->arr[results->n++];
+    *res = (BenchResult) {.stage = stage, .frames = frames, .ns = ns, .bytes_allocated = bytes};
+    px_pix_fmt_get_name(res->pix_fmt, pix_fmt);
+
+    double pixels = (double)frames * s->width * s->height;
+    px_log(PX_LOG_PROGRESS, "%-10s %-12s %10.1f fps %8.3f ns/px\n", stage, res->pix_fmt,
+           ns > 0 ? (double)frames * 1e9 / (double)ns : 0.0, pixels > 0 ? (double)ns / pixels : 0.0);
+    return 0;
+}
+
+// inverts every component, which is cheap enough that the benchmark mostly measures pixie itself
+static int invert_apply_slice(PXFilter* filter, int plane, int y_start, int y_end) {
+    const PXFrame* in = filter->in_frame;
+    PXFrame* out = filter->out_frame;
+    PXPixFmtDescriptor desc = px_pix_fmt_get_desc(in->pix_fmt);
+
+    const PXVideoPlane* src = &in->planes[plane];
+    PXVideoPlane* dst = &out->planes[plane];
+    int max = (1 << desc.bits_per_comp) - 1;
+
+    for (int y = y_start; y < y_end; y++) {
+        const uint8_t* src_row = src->data + (ptrdiff_t)y * src->stride;
+        uint8_t* dst_row = dst->data + (ptrdiff_t)y * dst->stride;
+
+        if (desc.comp_type == PX_COMP_TYPE_FLOAT) {
+            for (int x = 0; x < src->width; x++) {
+                ((float*)dst_row)[x] = 1.0f - ((const float*)src_row)[x];
+            }
+        } else if (desc.bytes_per_comp == 1) {
+            for (int x = 0; x < src->width; x++) {
+                dst_row[x] = (uint8_t)(max - src_row[x]);
+            }
+        } else {
+            for (int x = 0; x < src->width; x++) {
+                ((uint16_t*)dst_row)[x] = (uint16_t)(max - ((const uint16_t*)src_row)[x]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+static PXFilter* invert_filter_alloc(void) {
+    PXFilter* filter = px_filter_alloc();
+    if (!filter)
+        return NULL;
+
+    filter->name = "invert";
+    filter->apply_slice = invert_apply_slice;
+    filter->flags = PX_FILTER_FRAME_THREADS | PX_FILTER_INPLACE;
+    return filter;
+}
+
+static int invert_apply(PXFilter* filter) {
+    for (int i = 0; i < filter->out_frame->n_planes; i++) {
+        int ret = filter->apply_slice(filter, i, 0, filter->out_frame->planes[i].height);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+// gradient with some noise, so that encoders have something to do
+static int make_source_frame(AVFrame** frame, enum AVPixelFormat pix_fmt, int width, int height, int idx) {
+    *frame = av_frame_alloc();
+    if (!*frame) {
+        px_oom_msg(sizeof(AVFrame));
+        return PXERROR(ENOMEM);
+    }
+
+    AVFrame* pframe = *frame;
+    pframe->width = width;
+    pframe->height = height;
+    pframe->format = pix_fmt;
+
+    int ret = av_frame_get_buffer(pframe, 0);
+    if (ret < 0) {
+        LAV_THROW_MSG("av_frame_get_buffer", ret);
+        return ret;
+    }
+
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+    int n_planes = av_pix_fmt_count_planes(pix_fmt);
+    int depth = desc->comp[0].depth;
+    bool is_float = desc->flags & AV_PIX_FMT_FLAG_FLOAT;
+    unsigned seed = (unsigned)idx * 2654435761u;
+
+    for (int i = 0; i < n_planes; i++) {
+        bool chroma = i == 1 || i == 2;
+        bool is_rgb = desc->flags & AV_PIX_FMT_FLAG_RGB;
+        int plane_w = chroma && !is_rgb ? -(-width >> desc->log2_chroma_w) : width;
+        int plane_h = chroma && !is_rgb ? -(-height >> desc->log2_chroma_h) : height;
+
+        for (int y = 0; y < plane_h; y++) {
+            uint8_t* row = pframe->data[i] + (ptrdiff_t)y * pframe->linesize[i];
+            for (int x = 0; x < plane_w; x++) {
+                seed = seed * 1103515245u + 12345u;
+                int value = ((x + y + idx * 8) & 0xff) ^ (int)((seed >> 16) & 0xf);
+
+                if (is_float)
+                    ((float*)row)[x] = (float)value / 255.0f;
+                else if (depth > 8)
+                    ((uint16_t*)row)[x] = (uint16_t)(value << (depth - 8));
+                else
+                    row[x] = (uint8_t)value;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void free_source_frames(AVFrame** frames) {
+    for (int i = 0; i < N_SOURCE_FRAMES; i++) {
+        av_frame_free(&frames[i]);
+    }
+}
+
+static int make_source_frames(AVFrame** frames, enum AVPixelFormat pix_fmt, const BenchSettings* s) {
+    for (int i = 0; i < N_SOURCE_FRAMES; i++) {
+        int ret = make_source_frame(&frames[i], pix_fmt, s->width, s->height, i);
+        if (ret < 0) {
+            free_source_frames(frames);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+// decoder output (yuv420p) -> `pix_fmt`, which is only a reference if the formats are the same
+static int bench_import(BenchResults* results, enum AVPixelFormat pix_fmt, const BenchSettings* s) {
+    AVFrame* src[N_SOURCE_FRAMES] = {0};
+    PXFramePool* pool = NULL;
+    struct SwsContext* sws = NULL;
+
+    int ret = make_source_frames(src, AV_PIX_FMT_YUV420P, s);
+    if (ret < 0)
+        goto end;
+
+    ret = px_frame_pool_new(&pool);
+    if (ret < 0)
+        goto end;
+
+    Stopwatch sw = stopwatch_start();
+    for (int i = 0; i < s->n_frames; i++) {
+        PXFrame frame = {0};
+        ret = px_frame_from_av(&frame, src[i % N_SOURCE_FRAMES], pix_fmt, pool, &sws);
+        if (ret < 0)
+            goto end;
+        px_frame_unref(&frame);
+    }
+    ret = add_result(results, s, "import", px_pix_fmt_from_planar_av(pix_fmt), (uint64_t)s->n_frames, sw);
+
+end:
+    sws_freeContext(sws);
+    px_frame_pool_free(&pool);
+    free_source_frames(src);
+    return ret;
+}
+
+// one thread, without the rest of the chain, see bench_transcode() for that
+static int bench_filter(BenchResults* results, enum AVPixelFormat pix_fmt, const BenchSettings* s) {
+    AVFrame* src[N_SOURCE_FRAMES] = {0};
+    PXFrame frames[N_SOURCE_FRAMES] = {0};
+    struct SwsContext* sws = NULL;
+
+    PXFilter* filter = invert_filter_alloc();
+    if (!filter)
+        return PXERROR(ENOMEM);
+
+    int ret = make_source_frames(src, pix_fmt, s);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < N_SOURCE_FRAMES; i++) {
+        ret = px_frame_from_av(&frames[i], src[i], pix_fmt, NULL, &sws);
+        if (ret < 0)
+            goto end;
+        ret = px_frame_make_writable(&frames[i], NULL);
+        if (ret < 0)
+            goto end;
+    }
+
+    Stopwatch sw = stopwatch_start();
+    for (int i = 0; i < s->n_frames; i++) {
+        filter->in_frame = filter->out_frame = &frames[i % N_SOURCE_FRAMES];
+        filter->frame_num = (uint64_t)i;
+        ret = invert_apply(filter);
+        if (ret < 0)
+            goto end;
+    }
+    ret = add_result(results, s, "filter", px_pix_fmt_from_planar_av(pix_fmt), (uint64_t)s->n_frames, sw);
+
+end:
+    for (int i = 0; i < N_SOURCE_FRAMES; i++) {
+        px_frame_unref(&frames[i]);
+    }
+    sws_freeContext(sws);
+    free_source_frames(src);
+    px_filter_free(&filter);
+    return ret;
+}
+
+// `pix_fmt` -> encoder input (yuv420p), like after the last filter
+static int bench_export(BenchResults* results, enum AVPixelFormat pix_fmt, const BenchSettings* s) {
+    AVFrame* src[N_SOURCE_FRAMES] = {0};
+    PXFrame frames[N_SOURCE_FRAMES] = {0};
+    struct SwsContext* sws = NULL;
+    AVFrame* px_av_frame = av_frame_alloc();
+    AVFrame* conv_frame = av_frame_alloc();
+
+    int ret = 0;
+    if (!px_av_frame || !conv_frame) {
+        px_oom_msg(sizeof(AVFrame));
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = make_source_frames(src, pix_fmt, s);
+    if (ret < 0)
+        goto end;
+
+    for (int i = 0; i < N_SOURCE_FRAMES; i++) {
+        ret = px_frame_from_av(&frames[i], src[i], pix_fmt, NULL, &sws);
+        if (ret < 0)
+            goto end;
+    }
+
+    Stopwatch sw = stopwatch_start();
+    for (int i = 0; i < s->n_frames; i++) {
+        ret = px_frame_to_av(px_av_frame, &frames[i % N_SOURCE_FRAMES]);
+        if (ret < 0)
+            goto end;
+
+        // pixie passes frames already in the encoder's format on by reference
+        if (pix_fmt == AV_PIX_FMT_YUV420P) {
+            av_frame_unref(px_av_frame);
+            continue;
+        }
+
+        // the same as what pixie does with the encoder's buffer pool, minus the pool
+        av_frame_unref(conv_frame);
+        conv_frame->width = s->width;
+        conv_frame->height = s->height;
+        conv_frame->format = AV_PIX_FMT_YUV420P;
+        ret = av_frame_get_buffer(conv_frame, PX_ENC_BUF_ALIGN);
+        if (ret < 0) {
+            LAV_THROW_MSG("av_frame_get_buffer", ret);
+            goto end;
+        }
+
+        sws = sws_getCachedContext(sws, s->width, s->height, pix_fmt, s->width, s->height,
+                                   AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+        if (!sws) {
+            px_log(PX_LOG_ERROR, "Failed to create conversion context\n");
+            ret = PXERROR(ENOMEM);
+            goto end;
+        }
+
+        ret = sws_scale_frame(sws, conv_frame, px_av_frame);
+        if (ret < 0) {
+            LAV_THROW_MSG("sws_scale_frame", ret);
+            goto end;
+        }
+    }
+    ret = add_result(results, s, "export", px_pix_fmt_from_planar_av(pix_fmt), (uint64_t)s->n_frames, sw);
+
+end:
+    for (int i = 0; i < N_SOURCE_FRAMES; i++) {
+        px_frame_unref(&frames[i]);
+    }
+    av_frame_free(&conv_frame);
+    // drops the last reference to one of `frames`' buffers
+    av_frame_free(&px_av_frame);
+    sws_freeContext(sws);
+    free_source_frames(src);
+    return ret;
+}
+
+static int write_packets(AVCodecContext* enc_ctx, AVFormatContext* ofmt_ctx, AVPacket* pkt) {
+    int ret = 0;
+    while ((ret = avcodec_receive_packet(enc_ctx, pkt)) >= 0) {
+        av_packet_rescale_ts(pkt, enc_ctx->time_base, ofmt_ctx->streams[0]->time_base);
+        pkt->stream_index = 0;
+
+        ret = av_interleaved_write_frame(ofmt_ctx, pkt);
+        if (ret < 0) {
+            LAV_THROW_MSG("av_interleaved_write_frame", ret);
+            return ret;
+        }
+    }
+
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+        return 0;
+
+    LAV_THROW_MSG("avcodec_receive_packet", ret);
+    return ret;
+}
+
+// yuv420p frames -> `out_file`, which is then used as the input for bench_transcode()
+static int bench_encode(BenchResults* results, const char* out_file, const BenchSettings* s) {
+    AVFrame* src[N_SOURCE_FRAMES] = {0};
+    AVCodecContext* enc_ctx = NULL;
+    AVFormatContext* ofmt_ctx = NULL;
+    AVPacket* pkt = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+
+    int ret = 0;
+    if (!pkt || !frame) {
+        px_oom_msg(sizeof(AVFrame));
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = make_source_frames(src, AV_PIX_FMT_YUV420P, s);
+    if (ret < 0)
+        goto end;
+
+    const AVCodec* encoder = avcodec_find_encoder_by_name(s->encoder);
+    if (!encoder) {
+        px_log(PX_LOG_ERROR, "Encoder \"%s\" not found\n", s->encoder);
+        ret = AVERROR_ENCODER_NOT_FOUND;
+        goto end;
+    }
+
+    enc_ctx = avcodec_alloc_context3(encoder);
+    if (!enc_ctx) {
+        px_oom_msg(sizeof(AVCodecContext));
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+
+    enc_ctx->width = s->width;
+    enc_ctx->height = s->height;
+    enc_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc_ctx->time_base = (AVRational) {1, BENCH_FPS};
+    enc_ctx->framerate = (AVRational) {BENCH_FPS, 1};
+
+    ret = avformat_alloc_output_context2(&ofmt_ctx, NULL, NULL, out_file);
+    if (ret < 0) {
+        LAV_THROW_MSG("avformat_alloc_output_context2", ret);
+        goto end;
+    }
+
+    if (ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+        enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    ret = avcodec_open2(enc_ctx, encoder, NULL);
+    if (ret < 0) {
+        LAV_THROW_MSG("avcodec_open2", ret);
+        goto end;
+    }
+
+    AVStream* stream = avformat_new_stream(ofmt_ctx, NULL);
+    if (!stream) {
+        px_oom_msg(sizeof(AVStream));
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+    stream->time_base = enc_ctx->time_base;
+
+    ret = avcodec_parameters_from_context(stream->codecpar, enc_ctx);
+    if (ret < 0) {
+        LAV_THROW_MSG("avcodec_parameters_from_context", ret);
+        goto end;
+    }
+
+    ret = avio_open(&ofmt_ctx->pb, out_file, AVIO_FLAG_WRITE);
+    if (ret < 0) {
+        LAV_THROW_MSG("avio_open", ret);
+        goto end;
+    }
+
+    ret = avformat_write_header(ofmt_ctx, NULL);
+    if (ret < 0) {
+        LAV_THROW_MSG("avformat_write_header", ret);
+        goto end;
+    }
+
+    Stopwatch sw = stopwatch_start();
+    for (int i = 0; i < s->n_frames; i++) {
+        // the encoder may keep a reference to a frame, so it can't be written to directly
+        ret = av_frame_ref(frame, src[i % N_SOURCE_FRAMES]);
+        if (ret < 0) {
+            LAV_THROW_MSG("av_frame_ref", ret);
+            goto end;
+        }
+        frame->pts = i;
+
+        ret = avcodec_send_frame(enc_ctx, frame);
+        av_frame_unref(frame);
+        if (ret < 0) {
+            LAV_THROW_MSG("avcodec_send_frame", ret);
+            goto end;
+        }
+
+        ret = write_packets(enc_ctx, ofmt_ctx, pkt);
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = avcodec_send_frame(enc_ctx, NULL);
+    if (ret < 0) {
+        LAV_THROW_MSG("avcodec_send_frame", ret);
+        goto end;
+    }
+    ret = write_packets(enc_ctx, ofmt_ctx, pkt);
+    if (ret < 0)
+        goto end;
+
+    ret = av_write_trailer(ofmt_ctx);
+    if (ret < 0) {
+        LAV_THROW_MSG("av_write_trailer", ret);
+        goto end;
+    }
+
+    ret = add_result(results, s, "encode", PX_PIX_FMT_YUV420P8, (uint64_t)s->n_frames, sw);
+
+end:
+    if (ofmt_ctx)
+        avio_closep(&ofmt_ctx->pb);
+    avformat_free_context(ofmt_ctx);
+    avcodec_free_context(&enc_ctx);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    free_source_frames(src);
+    return ret;
+}
+
+// `in_file` -> invert -> `out_file` with the same encoder that wrote `in_file`
+static int bench_transcode(BenchResults* results, const char* in_file, const char* out_file,
+                           const BenchSettings* s) {
+    PXContext* pxc = px_ctx_alloc();
+    if (!pxc)
+        return PXERROR(ENOMEM);
+
+    int ret = 0;
+    pxc->queue_depth = s->queue_depth;
+    pxc->filter_threads = s->filter_threads;
+
+    pxc->fltr_ctx = px_filter_ctx_alloc();
+    if (!pxc->fltr_ctx) {
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+
+    PXFilterContext* fltr_ctx = pxc->fltr_ctx;
+    ret = px_frame_pool_new(&fltr_ctx->frame_pool);
+    if (ret < 0)
+        goto end;
+
+    fltr_ctx->filters = calloc(1, sizeof(PXFilter*));
+    if (!fltr_ctx->filters) {
+        px_oom_msg(sizeof(PXFilter*));
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+
+    fltr_ctx->filters[0] = invert_filter_alloc();
+    if (!fltr_ctx->filters[0]) {
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+    fltr_ctx->filters[0]->frame_pool = fltr_ctx->frame_pool;
+    fltr_ctx->n_filters = 1;
+
+    PXMediaSettings media_settings = {
+        .enc_name_v = s->encoder,
+        .pix_fmt_v = "yuv420p",
+        .fltr_ctx = fltr_ctx,
+    };
+
+    ret = px_media_ctx_new(&pxc->media_ctx, in_file, out_file, &media_settings);
+    if (ret < 0)
+        goto end;
+
+    Stopwatch sw = stopwatch_start();
+    ret = px_transcode(pxc);
+    if (ret < 0)
+        goto end;
+
+    ret = add_result(results, s, "transcode", PX_PIX_FMT_YUV420P8, pxc->media_ctx->frames_output, sw);
+
+end:
+    px_ctx_free(&pxc);
+    return ret;
+}
+
+// every planar format pixie can filter in, in the order FFmpeg lists them, without duplicates
+static int get_pix_fmts(enum AVPixelFormat* dest, int max) {
+    PXPixelFormat px_fmts[AV_PIX_FMT_NB];
+    int n = 0;
+
+    const AVPixFmtDescriptor* desc = NULL;
+    while ((desc = av_pix_fmt_desc_next(desc)) && n < max) {
+        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(desc);
+        if (px_planar_equivalent(pix_fmt) != pix_fmt)
+            continue;
+        if (av_pix_fmt_count_planes(pix_fmt) != desc->nb_components)
+            continue;
+
+        PXPixelFormat px_fmt = px_pix_fmt_from_planar_av(pix_fmt);
+        bool duplicate = false;
+        for (int i = 0; i < n && !duplicate; i++) {
+            duplicate = px_fmts[i] == px_fmt;
+        }
+        if (duplicate)
+            continue;
+
+        px_fmts[n] = px_fmt;
+        dest[n++] = pix_fmt;
+    }
+
+    return n;
+}
+
+static void write_json(FILE* file, const BenchResults* results, const BenchSettings* s) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"pixie_version\": \"%s\",\n", PX_VERSION);
+    fprintf(file, "  \"ffmpeg_version\": \"%s\",\n", px_ffmpeg_version());
+    fprintf(file, "  \"width\": %d,\n", s->width);
+    fprintf(file, "  \"height\": %d,\n", s->height);
+    fprintf(file, "  \"encoder\": \"%s\",\n", s->encoder);
+    fprintf(file, "  \"queue_depth\": %d,\n", s->queue_depth);
+    fprintf(file, "  \"filter_threads\": %d,\n", s->filter_threads);
+    fprintf(file, "  \"results\": [\n");
+
+    for (int i = 0; i < results->n; i++) {
+        const BenchResult* res = &results->arr[i];
+        double pixels = (double)res->frames * s->width * s->height;
+
+        fprintf(file, "    {\"stage\": \"%s\", \"pix_fmt\": \"%s\", \"frames\": %" PRIu64 ", ", res->stage,
+                res->pix_fmt, res->frames);
+        fprintf(file, "\"frames_per_sec\": %.3f, ",
+                res->ns > 0 ? (double)res->frames * 1e9 / (double)res->ns : 0.0);
+        fprintf(file, "\"ns_per_pixel\": %.4f, ", pixels > 0 ? (double)res->ns / pixels : 0.0);
+#ifdef BENCH_COUNT_ALLOCS
+        fprintf(file, "\"bytes_allocated\": %zu}", res->bytes_allocated);
+#else
+        fprintf(file, "\"bytes_allocated\": null}");
+#endif
+        fprintf(file, "%s\n", i < results->n - 1 ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+}
+
+static void print_help(void) {
+    printf("pixie-bench: time each stage of pixie's pipeline on synthetic frames\n\n"
+           "usage: pixie-bench [options]\n\n"
+           "options:\n"
+           "  -s <w>x<h>  frame size (default: 1920x1080)\n"
+           "  -n <count>  frames to process per stage (default: 100)\n"
+           "  -e <name>   encoder for the encode and transcode stages (default: mpeg4)\n"
+           "  -q <depth>  queue depth for the transcode stage, see --queue-depth (default: 0)\n"
+           "  -t <count>  filter threads for the transcode stage, 0 = all (default: 0)\n"
+           "  -d <dir>    directory for the temporary video files (default: .)\n"
+           "  -o <file>   write the results as JSON to <file> instead of stdout\n"
+           "  -h          print this help message and exit\n");
+}
+
+static int parse_args(int argc, char** argv, BenchSettings* s) {
+    for (int i = 1; i < argc; i++) {
+        const char* opt = argv[i];
+        if (!strcmp(opt, "-h")) {
+            print_help();
+            return HELP_PRINTED;
+        }
+
+        if (opt[0] != '-' || !opt[1] || opt[2] || i + 1 >= argc) {
+            px_log(PX_LOG_ERROR, "Invalid argument \"%s\", see -h\n", opt);
+            return PXERROR(EINVAL);
+        }
+        const char* val = argv[++i];
+
+        int ret = 0;
+        switch (opt[1]) {
+        case 's':
+            ret = sscanf(val, "%dx%d", &s->width, &s->height) == 2 && s->width > 0 && s->height > 0
+                      ? 0
+                      : PXERROR(EINVAL);
+            break;
+        case 'n':
+            ret = px_strtoi(&s->n_frames, val);
+            if (ret >= 0 && s->n_frames <= 0)
+                ret = PXERROR(EINVAL);
+            break;
+        case 'q':
+            ret = px_strtoi(&s->queue_depth, val);
+            break;
+        case 't':
+            ret = px_strtoi(&s->filter_threads, val);
+            break;
+        case 'e':
+            s->encoder = val;
+            break;
+        case 'd':
+            s->tmp_dir = val;
+            break;
+        case 'o':
+            s->output_file = val;
+            break;
+        default:
+            ret = PXERROR(EINVAL);
+        }
+
+        if (ret < 0) {
+            px_log(PX_LOG_ERROR, "Invalid value \"%s\" for option %s\n", val, opt);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    BenchSettings s = {
+        .width = 1920,
+        .height = 1080,
+        .n_frames = 100,
+        .encoder = "mpeg4",
+        .tmp_dir = ".",
+    };
+
+    int ret = parse_args(argc, argv, &s);
+    if (ret != 0)
+        return ret < 0;
+
+    px_log_set_level(PX_LOG_PROGRESS);
+
+    BenchResults results = {0};
+    char* in_file = NULL;
+    char* out_file = NULL;
+
+    enum AVPixelFormat pix_fmts[AV_PIX_FMT_NB];
+    int n_pix_fmts = get_pix_fmts(pix_fmts, AV_PIX_FMT_NB);
+
+    for (int i = 0; i < n_pix_fmts; i++) {
+        ret = bench_import(&results, pix_fmts[i], &s);
+        if (ret < 0)
+            goto end;
+        ret = bench_filter(&results, pix_fmts[i], &s);
+        if (ret < 0)
+            goto end;
+        ret = bench_export(&results, pix_fmts[i], &s);
+        if (ret < 0)
+            goto end;
+    }
+
+    size_t path_len = strlen(s.tmp_dir) + strlen(PX_PATH_SEP "pixie-bench-out.nut") + 1;
+    in_file = malloc(path_len);
+    out_file = malloc(path_len);
+    if (!in_file || !out_file) {
+        px_oom_msg(path_len);
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+    snprintf(in_file, path_len, "%s" PX_PATH_SEP "pixie-bench-in.nut", s.tmp_dir);
+    snprintf(out_file, path_len, "%s" PX_PATH_SEP "pixie-bench-out.nut", s.tmp_dir);
+
+    ret = bench_encode(&results, in_file, &s);
+    if (ret < 0)
+        goto end;
+
+    ret = bench_transcode(&results, in_file, out_file, &s);
+    if (ret < 0)
+        goto end;
+
+    FILE* json_file = s.output_file ? fopen(s.output_file, "w") : stdout;
+    if (!json_file) {
+        ret = PXERROR(PX_LAST_OS_ERR());
+        OS_THROW_MSG("fopen", -ret);
+        goto end;
+    }
+
+    write_json(json_file, &results, &s);
+    if (json_file != stdout)
+        fclose(json_file);
+
+end:
+    if (in_file)
+        remove(in_file);
+    if (out_file)
+        remove(out_file);
+    px_free(&in_file);
+    px_free(&out_file);
+    px_free(&results.arr);
+    return ret < 0;
+}
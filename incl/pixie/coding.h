@@ -1,33 +1,158 @@
 #pragma once
 
+#include <pixie/stats.h>
+#include <pixie/util/thread.h>
+
 #include <stdint.h>
 #include <stdatomic.h>
 
 typedef struct AVCodecContext AVCodecContext;
 typedef struct AVFormatContext AVFormatContext;
+typedef struct AVIOContext AVIOContext;
+typedef struct AVFrame AVFrame;
+typedef struct AVPacket AVPacket;
+typedef struct AVBufferPool AVBufferPool;
+typedef struct PXFilterContext PXFilterContext;
+struct SwsContext;
 
 typedef struct PXCodingContext {
     AVCodecContext* dec_ctx;
     AVCodecContext* enc_ctx;
+
+    // enum AVPixelFormat video frames are filtered in, AV_PIX_FMT_NONE if there are no filters
+    int filter_pix_fmt;
+    // enum AVPixelFormat frames come out of the last filter in, see PXFilter::config_output()
+    int filter_out_pix_fmt;
+
+    // cached pixel format conversion contexts, one per filter thread since they can't be shared
+    struct SwsContext** sws_import; // decoder -> filters
+    struct SwsContext** sws_export; // filters -> encoder
+    AVFrame** conv_frames;          // filters -> encoder, reused as the destination of each conversion
+
+    // reused for the whole transcode instead of being allocated for every packet or frame
+    AVFrame* dec_frame; // only used while decoding
+    AVPacket* enc_pkt;  // only used while encoding
+
+    // buffers for frames in the encoder's format and size, which pixie's own buffers are copied to
+    AVBufferPool* enc_buf_pool;
 } PXCodingContext;
 
+// part of a file's video stream, starting at a keyframe, see px_find_segments()
+typedef struct PXSegment {
+    // presentation timestamps in the video stream's time base
+    int64_t start; // of the segment's first keyframe, INT64_MIN for the first segment
+    int64_t end;   // of the next segment's first keyframe, INT64_MAX for the last segment
+} PXSegment;
+
+/**
+ * custom IO for reading the input or writing the output, see PXMediaSettings::in_io
+ * the callbacks work like those of avio_alloc_context(): they return the number of bytes read or written,
+ * or a negative AVERROR code (AVERROR_EOF at the end of the input)
+ */
+typedef struct PXIOCallbacks {
+    void* opaque;
+
+    int (*read)(void* opaque, uint8_t* buf, int size);        // only used for input
+    int (*write)(void* opaque, const uint8_t* buf, int size); // only used for output
+
+    // NULL if the stream can't seek, `whence` may be AVSEEK_SIZE to ask for the size of the stream
+    int64_t (*seek)(void* opaque, int64_t offset, int whence);
+} PXIOCallbacks;
+
 // context for processing a media file
 typedef struct PXMediaContext {
     AVFormatContext* ifmt_ctx;
     AVFormatContext* ofmt_ctx;
 
+    // set if the input or output uses PXMediaSettings::in_io or out_io
+    AVIOContext* in_io;
+    AVIOContext* out_io;
+    PXIOCallbacks in_cb;
+    PXIOCallbacks out_cb;
+
+    // serializes writes to `ofmt_ctx`, which may happen from several threads
+    PXMutex mux_lock;
+
     // index of the stream currently being processed, -1 if none
     atomic_int stream_idx;
 
     // context for transcoding each stream
     PXCodingContext* coding_ctx_arr;
+    int n_sws_threads; // length of the `sws_*` arrays of each coding context
+
+    // if `segmented`, only the video frames within `segment` are transcoded, and other streams are left out
+    bool segmented;
+    PXSegment segment;
+    bool seg_end_reached; // the next segment's first keyframe has been read
 
     atomic_uint_fast64_t frames_decoded;
     atomic_uint_fast64_t decoded_frames_dropped;
     atomic_uint_fast64_t frames_output;
+
+    // the part of the input being transcoded, in microseconds, `duration_us` is -1 if unknown
+    int64_t start_us;
+    int64_t duration_us;
+    // end of the latest video frame encoded, in microseconds from `start_us`
+    atomic_int_fast64_t out_time_us;
+
+    // time spent in each stage and filter, and how full the queues between stages were
+    PXStats* stats;
 } PXMediaContext;
 
+typedef struct PXMediaSettings {
+    const char* enc_name_v; // NULL = libx264
+    const char* enc_opts_v; // opt=val:opt2=val2:..., may be NULL
+
+    // name of the video encoder's input pixel format
+    // if NULL, the format needing the least conversions between decoder, filters and encoder is picked
+    const char* pix_fmt_v;
+
+    // filters the video frames will be run through, may be NULL
+    // configured for the video streams' frames with px_filter_ctx_config()
+    PXFilterContext* fltr_ctx;
+
+    // threads for frame/slice threading in each video decoder and encoder, 0 = let libavcodec decide
+    int dec_threads;
+    int enc_threads;
+
+    // only transcode this part of the input's video stream, may be NULL
+    // see px_find_segments() and px_concat_segments()
+    const PXSegment* segment;
+
+    // container format names, e.g. "matroska", NULL = guess from the file name or contents
+    // the output format has to be given when writing to stdout or `out_io`
+    const char* in_format;
+    const char* out_format;
+
+    // read the input or write the output through these instead of opening a file, may be NULL
+    // the file name passed to px_media_ctx_new() is then only used in log messages, and may be NULL
+    const PXIOCallbacks* in_io;
+    const PXIOCallbacks* out_io;
+} PXMediaSettings;
+
 PXMediaContext* px_media_ctx_alloc(void);
-int px_media_ctx_new(PXMediaContext** ctx, const char* in_file, const char* out_file, const char* enc_name_v,
-                     const char* enc_opts_v);
+
+/**
+ * open `in_file` and `out_file` and set up transcoding between them
+ * a file name of "-" reads from stdin or writes to stdout
+ */
+int px_media_ctx_new(PXMediaContext** ctx, const char* in_file, const char* out_file,
+                     const PXMediaSettings* settings);
 void px_media_ctx_free(PXMediaContext** ctx);
+
+// make sure each stream has a conversion context and frame slot for `n_threads` threads
+int px_media_ctx_alloc_sws(PXMediaContext* ctx, int n_threads);
+
+/**
+ * split the video stream of `in_file` at keyframes into up to `n_segments` segments of roughly equal
+ * duration, which can be transcoded separately (and at once) with PXMediaSettings::segment
+ * `*segments` is allocated and must be freed with free(), `*n_found` may be less than `n_segments`
+ * only files with a single video stream can be split
+ */
+int px_find_segments(PXSegment** segments, int* n_found, const char* in_file, int n_segments);
+
+/**
+ * join the video streams of `seg_files`, the outputs of transcoding each of `in_file`'s segments in order,
+ * and the other streams of `in_file` into `out_file`, without re-encoding
+ */
+int px_concat_segments(const char* out_file, const char* in_file, const char* const* seg_files, int n_segs);
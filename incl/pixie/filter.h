@@ -1,9 +1,38 @@
+#pragma once
+
 #include <pixie/frame.h>
 #include <pixie/util/map.h>
 #include <pixie/util/dll.h>
+#include <pixie/util/thread.h>
 
 #define PX_FILTER_EXPORT_FUNC "pixie_export_filter"
 
+// largest PXFilter::max_out_frames a filter may set
+#define PX_FILTER_MAX_OUT_FRAMES 64
+
+typedef enum PXFilterFlags {
+    // `apply()` only depends on `user_data` and the frames it's given, so pixie may run it on several
+    // frames at once, each call getting its own copy of the PXFilter struct
+    PX_FILTER_FRAME_THREADS = 1 << 0,
+    // each output pixel only depends on the input pixel at the same position, so `in_frame` and
+    // `out_frame` may point to the same frame, which pixie makes sure isn't shared with anything else
+    PX_FILTER_INPLACE = 1 << 1,
+    // `apply_slice()` only reads rows of `in_frame` within `halo_rows` of its slice, so pixie may run it
+    // strip by strip along with the filters next to it, see PXContext::strip_rows
+    PX_FILTER_STRIPS = 1 << 2,
+} PXFilterFlags;
+
+// properties shared by all frames going into or coming out of a filter, see PXFilter::config_output()
+typedef struct PXFrameProps {
+    int width;
+    int height;
+    PXPixelFormat pix_fmt;
+
+    // frames per second as a fraction, 0/1 if unknown
+    int fps_num;
+    int fps_den;
+} PXFrameProps;
+
 typedef struct PXFilter {
     const PXFrame* in_frame;
     PXFrame* out_frame;
@@ -11,26 +40,130 @@ typedef struct PXFilter {
 
     void* user_data;
 
+    // set by pixie before init(), can be used to allocate scratch frames
+    PXFramePool* frame_pool;
+    // set by pixie before the first frame is filtered, shared with pixie itself, see px_parallel_for()
+    PXThreadPool* thread_pool;
+
     int (*init)(struct PXFilter* filter, const PXMap* args);
     int (*apply)(struct PXFilter* filter);
+    // optional, process rows [y_start, y_end) of plane `plane` of `out_frame` only
+    // may be called concurrently for different slices of the same frame
+    int (*apply_slice)(struct PXFilter* filter, int plane, int y_start, int y_end);
     void (*free)(struct PXFilter* filter);
 
+    /**
+     * optional, called once after init() and before any frame is filtered, with `in_props` set to the
+     * properties of the frames the filter will get and `out_props` to a copy of them. a filter that resizes,
+     * converts or changes the frame rate of its input sets `out_props` (and `max_out_frames`) accordingly,
+     * and pixie allocates every `out_frame` with them, passing them on to the next filter and the encoder
+     */
+    int (*config_output)(struct PXFilter* filter);
+
+    /**
+     * optional, for filters that map each component value to a new one regardless of where it is, e.g.
+     * levels or gamma: fill `lut` with the output value of each of the `n_entries` possible input values of
+     * plane `plane`, given `in_props` (`n_entries` is 1 << bits per component). called after config_output()
+     * for integer formats of 8 to 16 bits, in which case pixie applies the table itself, merged with those
+     * of the filters next to it, and apply() and apply_slice() aren't used. they may be NULL if the filter
+     * only supports such formats
+     */
+    int (*get_lut)(struct PXFilter* filter, int plane, uint16_t* lut, int n_entries);
+
     const char* name;
+    int flags; // PXFilterFlags
+
+    // formats `apply()` can handle, terminated by PX_PIX_FMT_NONE, NULL if any format is supported
+    const PXPixelFormat* pix_fmts;
+
+    // with PX_FILTER_STRIPS, rows above and below [y_start, y_end) of the same plane of `in_frame` that
+    // `apply_slice()` reads, 0 if each output row only depends on the same input row. may be set in init()
+    // when running strip by strip, rows of `in_frame` further away may not have been filtered yet
+    int halo_rows;
+
+    // set by pixie before config_output()
+    PXFrameProps in_props;
+    PXFrameProps out_props;
+
+    // most frames `apply()` can output for one input, may be set in init() or config_output(), 0 means 1
+    // `out_frames` holds that many frames (`out_frame` is the first), and `apply()` sets `n_out_frames` to
+    // how many of them it filled in, which is 1 by default. 0 drops the input frame
+    // at most PX_FILTER_MAX_OUT_FRAMES
+    int max_out_frames;
+    PXFrame* out_frames;
+    int n_out_frames;
+
+    // number of frames before and after `in_frame` that `apply()` needs to see, may be set in init()
+    // pixie keeps them in `window` and delays the output by `future_frames`, see px_filter_get_frame()
+    int past_frames;
+    int future_frames;
+
+    // set by pixie while applying a filter with `past_frames` or `future_frames`,
+    // `in_frame` is at index `window_pos`
+    const PXFrameBuffer* window;
+    int window_pos;
 
     void* dll_handle;
 } PXFilter;
 
+// lookup tables of consecutive filters with PXFilter::get_lut(), merged into one
+typedef struct PXLut PXLut;
+
 typedef struct PXFilterContext {
     PXFilter** filters;
+    PXFramePool* frame_pool; // shared by all filters and pixie's own frames
     const PXMap* filter_opts;
     int n_filters;
+
+    // set by px_filter_ctx_config()
+    PXLut* luts;
+    int n_luts;
+
+    bool configured; // px_filter_ctx_config() has succeeded
 } PXFilterContext;
 
 PXFilter* px_filter_alloc(void);
 int px_filter_from_dll(PXFilter** filter, const char* dll_path);
 void px_filter_free(PXFilter** filter);
 
+bool px_filter_supports_pix_fmt(const PXFilter* filter, PXPixelFormat pix_fmt);
+
+// check if the filter sees frames other than `in_frame`
+bool px_filter_is_temporal(const PXFilter* filter);
+
+/**
+ * the frame `offset` frames after `in_frame` (before if negative), within [-past_frames, future_frames]
+ * at the start and end of the video, missing frames are replaced by the first or last frame
+ */
+const PXFrame* px_filter_get_frame(const PXFilter* filter, int offset);
+
+/**
+ * run `func(ctx, i, thread_idx)` for every `i` in [0, `n_jobs`) on pixie's threads and wait for them to
+ * finish, so filters don't start threads of their own that compete with pixie's and the codecs'
+ * may be called from apply(), apply_slice() or another job, and the calling thread runs jobs as well
+ * `thread_idx` is in [0, px_parallel_threads()), and unique among the jobs of one call running at a time
+ * without `thread_pool`, e.g. outside of transcoding, the jobs run one by one on the calling thread
+ *
+ * @return the first negative value returned by `func`, or 0
+ */
+int px_parallel_for(const PXFilter* filter, int n_jobs, PXPoolJobFunc func, void* ctx);
+
+// number of threads px_parallel_for() may run jobs on, e.g. to allocate scratch space for each
+int px_parallel_threads(const PXFilter* filter);
+
 PXFilterContext* px_filter_ctx_alloc(void);
 int px_filter_ctx_new(PXFilterContext** ctx, const char* filter_dir, const char* const* filter_names,
                       const PXMap* filter_opts, int n_filters);
 void px_filter_ctx_free(PXFilterContext** ctx);
+
+// check if the chain can take frames in `pix_fmt`: every filter up to the first one with config_output()
+// has to support it, later filters get whatever format the one before them outputs
+bool px_filter_ctx_supports_pix_fmt(const PXFilterContext* ctx, PXPixelFormat pix_fmt);
+
+/**
+ * call each filter's config_output() in order, starting from the properties of the decoded frames in `in`,
+ * and merge the lookup tables of consecutive filters with get_lut()
+ * `*out` is set to the properties of the frames coming out of the last filter
+ * fails if a filter gets a format it doesn't support, or different properties than when last configured
+ */
+int px_filter_ctx_config(PXFilterContext* ctx, const PXFrameProps* in, PXFrameProps* out);
@@ -7,6 +7,12 @@
 
 #define PX_FRAME_MAX_PLANES 4
 
+// refcounted buffer holding the plane data of one or more frames
+typedef struct PXFrameBuf PXFrameBuf;
+
+// recycles frame buffers, see px_frame_pool_get()
+typedef struct PXFramePool PXFramePool;
+
 // TODO: abi stability :(
 typedef struct PXVideoPlane {
     int width;
@@ -29,10 +35,15 @@ typedef struct PXFrame {
 
     // AVPixelFormat enum value, only used internally for conversions
     int av_pix_fmt;
+
+    // owner of the plane data, NULL if the frame has no data
+    PXFrameBuf* buf;
 } PXFrame;
 
+// ring of references to the last `max_frames` frames added, oldest first, see px_fb_add()
 typedef struct PXFrameBuffer {
-    PXFrame** frames;
+    PXFrame* frames; // ring storage, `max_frames` long
+    int first;       // index of the oldest frame in `frames`
     int num_frames;
     int max_frames;
 } PXFrameBuffer;
@@ -45,13 +56,39 @@ int px_frame_alloc_bufs(PXFrame* frame);
 int px_frame_new(PXFrame** frame, int width, int height, PXPixelFormat pix_fmt, const int* strides);
 void px_frame_free(PXFrame** frame);
 
+// make `dest` a copy of `src` sharing its plane data, `dest` must not hold a reference already
+void px_frame_ref(PXFrame* dest, const PXFrame* src);
+
+// drop the frame's reference to its plane data, which is freed or returned to its pool if it was the last one
+void px_frame_unref(PXFrame* frame);
+
+// check if the frame is the only one referencing its plane data, and that data is owned by pixie
+bool px_frame_is_writable(const PXFrame* frame);
+
+// if the frame is not writable, replace its data with a writable copy allocated from `pool` (may be NULL)
+int px_frame_make_writable(PXFrame* frame, PXFramePool* pool);
+
 void px_frame_copy(PXFrame* dest, const PXFrame* src);
 
 size_t px_plane_size(const PXFrame* frame, int idx);
 size_t px_frame_size(const PXFrame* frame);
 
-int px_fb_init(PXFrameBuffer* fb, int width, int height, PXPixelFormat pix_fmt);
+int px_frame_pool_new(PXFramePool** pool);
+
+// buffers still in use stay valid until they're unreferenced
+void px_frame_pool_free(PXFramePool** pool);
+
+// like px_frame_init() + px_frame_alloc_bufs(), but reuses a released buffer of the same layout if available
+// the buffer is returned to the pool when the last reference to it is dropped with px_frame_unref()
+int px_frame_pool_get(PXFramePool* pool, PXFrame* frame, int width, int height, PXPixelFormat pix_fmt,
+                      const int* strides);
+
+int px_fb_init(PXFrameBuffer* fb, int max_frames);
 void px_fb_free(PXFrameBuffer* fb);
 
+// add a reference to `frame` without copying its data, dropping the oldest frame if the buffer is full
 int px_fb_add(PXFrameBuffer* fb, const PXFrame* frame);
 void px_fb_clear(PXFrameBuffer* fb);
+
+// `idx` counts from the oldest frame, NULL if out of range
+const PXFrame* px_fb_get(const PXFrameBuffer* fb, int idx);
@@ -29,6 +29,10 @@ PXLogLevel px_log_level_from_str(const char* str);
 
 void px_log_set_level(PXLogLevel level);
 
+// PX_LOG_INFO messages go to stdout by default, and every other level to stderr
+// NULL resets to stdout, e.g. set this to stderr when writing the output to stdout
+void px_log_set_info_stream(FILE* stream);
+
 // abi-safe way to get PX_LOG_COUNT
 int px_log_num_levels(void);
 
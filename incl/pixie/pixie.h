@@ -6,17 +6,69 @@
 
 #define PX_VERSION "0.3.1"
 
+// how far along a transcode is, see px_get_progress()
+typedef struct PXProgress {
+    uint64_t frames_decoded;
+    uint64_t frames_dropped;
+    uint64_t frames_output;
+
+    // of the input, or the segment being transcoded, in microseconds, -1 if unknown
+    int64_t duration_us;
+    // how much of it has been encoded, in microseconds
+    int64_t out_time_us;
+
+    int64_t elapsed_ns; // since px_transcode() was called
+    bool done;          // px_transcode() is returning
+} PXProgress;
+
+// see PXContext::progress_cb
+typedef void (*PXProgressFunc)(void* opaque, const PXProgress* progress);
+
 typedef struct PXContext {
     PXMediaContext* media_ctx;
     PXFilterContext* fltr_ctx;
 
     PXThread transc_thread;
 
+    // max number of packets/frames buffered between the demux, decode, filter and encode stages,
+    // which run on separate threads if this is > 0
+    int queue_depth;
+
+    // number of threads to run filters on, 0 = number of available CPU threads
+    // when pipelining, this many frames are filtered at once by filters with PX_FILTER_FRAME_THREADS
+    int filter_threads;
+    PXThreadPool* thrd_pool;
+
+    /**
+     * rows per strip when running consecutive filters with PX_FILTER_STRIPS strip by strip, so that each
+     * strip is passed through all of them while it's still in cache, instead of filter by filter over
+     * whole frames. 0 = off, < 0 = sized so that a strip of every frame they touch fits in L2
+     */
+    int strip_rows;
+
     int input_idx;
+
+    /**
+     * called every `progress_interval_ms` milliseconds and every `progress_frames` encoded frames
+     * (whichever are > 0) while frames are being encoded, and once more when px_transcode() returns
+     * it runs on the thread encoding the frames, so it should return quickly. may be NULL
+     */
+    PXProgressFunc progress_cb;
+    void* progress_opaque;
+    int progress_interval_ms;
+    int progress_frames;
+
+    // set by px_transcode()
+    atomic_int_fast64_t start_ns;
+    int64_t next_progress_ns;
+    uint64_t next_progress_frame;
 } PXContext;
 
 int px_transcode(PXContext* pxc);
 
+// may be called from any thread once `pxc->media_ctx` is set
+void px_get_progress(const PXContext* pxc, PXProgress* progress);
+
 PXContext* px_ctx_alloc(void);
 void px_ctx_free(PXContext** pxc);
 
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <pixie/frame.h>
+
+#include <stdint.h>
+
+/**
+ * vectorized building blocks for filters, picked at runtime for the CPU they run on
+ *
+ * rows hold `n` components of `depth` bits (PXPixFmtDescriptor::bits_per_comp): uint8_t for 8 bits,
+ * uint16_t for 9 to 16 bits and float for 32-bit float formats. results are computed in float, then
+ * rounded to the nearest integer and clamped to [0, (1 << depth) - 1] for integer formats, float results
+ * aren't clamped. `dst` may be the same row as any of the sources, but must not overlap them otherwise
+ */
+
+typedef enum PXCpuFlags {
+    PX_CPU_SSE4 = 1 << 0,
+    PX_CPU_AVX2 = 1 << 1,
+    PX_CPU_AVX512 = 1 << 2, // F, BW, CD, DQ and VL
+    PX_CPU_NEON = 1 << 3,
+} PXCpuFlags;
+
+// PXCpuFlags supported by the CPU pixie is running on
+int px_cpu_flags(void);
+
+// name of the set of kernels the functions below dispatch to, e.g. "avx2" or "c"
+const char* px_simd_impl_name(void);
+
+// dst = a + b
+void px_row_add(void* dst, const void* a, const void* b, int n, int depth);
+
+// dst = src * mul + add, e.g. mul = -1 and add = (1 << depth) - 1 inverts the row
+void px_row_mul_add(void* dst, const void* src, float mul, float add, int n, int depth);
+
+// dst = src clamped to [lo, hi]
+void px_row_clamp(void* dst, const void* src, float lo, float hi, int n, int depth);
+
+// dst = a * (1 - weight) + b * weight
+void px_row_blend(void* dst, const void* a, const void* b, float weight, int n, int depth);
+
+/**
+ * convert a row between depths. integer depths are shifted, rounding to the nearest value when shifting
+ * right, and float components are in [0, 1], scaled by (1 << depth) - 1 to and from integer depths
+ */
+void px_row_convert(void* dst, int dst_depth, const void* src, int src_depth, int n);
+
+/**
+ * count each value of the row into `hist`, which has 1 << depth bins for integer depths, and 1 << 16 for
+ * float rows, whose values are clamped to [0, 1] and scaled to the nearest bin. `hist` isn't cleared first
+ * integer values above (1 << depth) - 1 only have their low `depth` bits counted
+ */
+void px_row_histogram(uint32_t* hist, const void* src, int n, int depth);
+
+/**
+ * filter rows [y_start, y_end) of `src` into `dst` with a separable kernel, first vertically with
+ * `kernel_v` then horizontally with `kernel_h`, which both have 2 * `radius` + 1 taps
+ * pixels past the edges of the plane repeat the edge pixels. reads rows of `src` up to `radius` rows
+ * outside [y_start, y_end), so `radius` is the filter's PXFilter::halo_rows. `dst` must not be `src`
+ * fails with PXERROR(ENOMEM) if the scratch rows can't be allocated
+ */
+int px_plane_convolve(PXVideoPlane* dst, const PXVideoPlane* src, int depth, const float* kernel_h,
+                      const float* kernel_v, int radius, int y_start, int y_end);
+
+// px_plane_convolve() with every tap 1 / (2 * `radius` + 1), computed in constant time per pixel
+int px_plane_box_blur(PXVideoPlane* dst, const PXVideoPlane* src, int depth, int radius, int y_start,
+                      int y_end);
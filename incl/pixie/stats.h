@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum PXStage : int {
+    PX_STAGE_DEMUX,  // reading packets from the input
+    PX_STAGE_DECODE,
+    PX_STAGE_IMPORT, // converting decoded frames to the filters' format
+    PX_STAGE_EXPORT, // converting filtered (or decoded, without filters) frames to the encoder's format
+    PX_STAGE_ENCODE,
+    PX_STAGE_MUX,    // writing packets to the output
+    PX_STAGE_COUNT,  // number of stages (not a valid stage)
+} PXStage;
+
+// queues between the threads of a pipelined transcode, see PXContext::queue_depth
+typedef enum PXQueueKind : int {
+    PX_QUEUE_PACKETS,  // demux -> decode
+    PX_QUEUE_DECODED,  // decode -> filter
+    PX_QUEUE_FILTERED, // filter -> encode
+    PX_QUEUE_COUNT,    // number of queues (not a valid queue)
+} PXQueueKind;
+
+// time spent in a stage or filter, summed over every thread it ran on
+typedef struct PXStageTime {
+    uint64_t calls;
+
+    // may exceed the duration of the transcode if the stage runs on several threads at once
+    int64_t wall_ns;
+
+    // CPU time of the threads calling into the stage, -1 if it can't be measured
+    // threads started by the decoders and encoders themselves aren't included
+    int64_t cpu_ns;
+} PXStageTime;
+
+typedef struct PXQueueUsage {
+    int capacity;
+    int max_len;
+
+    // queue length right after each push, total_len / pushes is the average
+    uint64_t pushes;
+    uint64_t total_len;
+} PXQueueUsage;
+
+// timings collected during a transcode, see PXMediaContext::stats
+// may be read from any thread while the transcode is running
+typedef struct PXStats PXStats;
+
+PXStats* px_stats_alloc(int n_filters);
+void px_stats_free(PXStats** stats);
+
+// abi-safe way to get PX_STAGE_COUNT and PX_QUEUE_COUNT
+int px_stats_num_stages(void);
+int px_stats_num_queues(void);
+
+// number of filters timed, in the order of PXFilterContext::filters
+int px_stats_num_filters(const PXStats* stats);
+
+// NULL if out of range
+const char* px_stage_name(PXStage stage);
+const char* px_queue_name(PXQueueKind queue);
+
+// each returns PXERROR(EINVAL) if the stage, filter or queue is out of range
+int px_stats_get_stage(const PXStats* stats, PXStage stage, PXStageTime* dest);
+int px_stats_get_filter(const PXStats* stats, int filter_idx, PXStageTime* dest);
+int px_stats_get_queue(const PXStats* stats, PXQueueKind queue, PXQueueUsage* dest);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <pixie/util/thread.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bounded thread-safe FIFO of fixed-size elements
+typedef struct PXQueue {
+    uint8_t* elems;
+    size_t elem_size;
+    int capacity;
+
+    int head; // index of the oldest element
+    int len;
+
+    bool aborted;
+
+    PXMutex lock;
+    PXCond not_empty;
+    PXCond not_full;
+} PXQueue;
+
+int px_queue_init(PXQueue* queue, size_t elem_size, int capacity);
+void px_queue_free(PXQueue* queue);
+
+// copy `*elem` to the end of the queue, blocking while the queue is full
+// returns PXERROR(EPIPE) if the queue has been aborted
+int px_queue_push(PXQueue* queue, const void* elem);
+
+// like px_queue_push() but never blocks, returns PXERROR(EAGAIN) if the queue is full
+int px_queue_try_push(PXQueue* queue, const void* elem);
+
+// move the oldest element to `*dest`, blocking while the queue is empty
+// returns PXERROR(EPIPE) if the queue has been aborted
+int px_queue_pop(PXQueue* queue, void* dest);
+
+// like px_queue_pop() but never blocks, returns PXERROR(EAGAIN) if the queue is empty
+// elements can still be popped after the queue has been aborted
+int px_queue_try_pop(PXQueue* queue, void* dest);
+
+// wake up all waiting threads and make every following push/pop fail
+void px_queue_abort(PXQueue* queue);
+
+int px_queue_len(PXQueue* queue);
@@ -43,6 +43,17 @@ typedef struct PXThread {
 
 } PXThread;
 
+#ifdef PX_THREADS_C11
+typedef mtx_t PXMutex;
+typedef cnd_t PXCond;
+#elif defined(PX_THREADS_WIN32)
+typedef CRITICAL_SECTION PXMutex;
+typedef CONDITION_VARIABLE PXCond;
+#elif defined(PX_THREADS_POSIX)
+typedef pthread_mutex_t PXMutex;
+typedef pthread_cond_t PXCond;
+#endif
+
 // launch thread with function `thread->func` and arguments `thread->args`
 int px_thrd_launch(PXThread* thread);
 
@@ -51,3 +62,39 @@ int px_thrd_join(PXThread* thread, int* return_code);
 
 // terminate calling thread with code `ret`
 void px_thrd_exit(int ret);
+
+int px_mutex_init(PXMutex* mutex);
+void px_mutex_destroy(PXMutex* mutex);
+void px_mutex_lock(PXMutex* mutex);
+void px_mutex_unlock(PXMutex* mutex);
+
+int px_cond_init(PXCond* cond);
+void px_cond_destroy(PXCond* cond);
+
+// atomically unlock `mutex` and wait for `cond` to be signaled, `mutex` is locked again on return
+void px_cond_wait(PXCond* cond, PXMutex* mutex);
+void px_cond_signal(PXCond* cond);
+void px_cond_broadcast(PXCond* cond);
+
+// runs jobs on a fixed set of threads, see px_thrd_pool_run()
+typedef struct PXThreadPool PXThreadPool;
+
+// called for each job of a px_thrd_pool_run() call, `thread_idx` is in [0, n_threads)
+typedef int (*PXPoolJobFunc)(void* ctx, int job_idx, int thread_idx);
+
+// create a pool of `n_threads` threads, including the thread calling px_thrd_pool_run()
+int px_thrd_pool_new(PXThreadPool** pool, int n_threads);
+void px_thrd_pool_free(PXThreadPool** pool);
+
+int px_thrd_pool_num_threads(const PXThreadPool* pool);
+
+/**
+ * run `func(ctx, i, thread_idx)` for every `i` in [0, `n_jobs`) and wait for all of them to finish
+ * the calling thread takes part in running the jobs, and threads that run out of jobs steal them from the
+ * others. jobs may call this again on the same pool, their jobs then run alongside any others and the
+ * calling thread keeps its `thread_idx`. calls from threads outside of the pool are serialized
+ * no two jobs of the same call run with the same `thread_idx` at the same time
+ *
+ * @return the first negative value returned by `func`, or 0
+ */
+int px_thrd_pool_run(PXThreadPool* pool, PXPoolJobFunc func, void* ctx, int n_jobs);
@@ -4,6 +4,7 @@
 
 #include <assert.h>
 
+#include <stdint.h>
 #include <stdio.h>
 
 // same as ffmpeg's AVERROR(x) for consistency
@@ -78,3 +79,9 @@ void px_aligned_free(void* ptr);
 
 // check if `path` exists
 bool px_file_exists(const char* path);
+
+// monotonic clock in nanoseconds, only meaningful as a difference between two calls
+int64_t px_time_ns(void);
+
+// CPU time used by the calling thread in nanoseconds, -1 if it can't be measured
+int64_t px_thread_cpu_time_ns(void);
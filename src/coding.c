@@ -1,24 +1,38 @@
 #include "internals.h"
 
 #include <pixie/coding.h>
+#include <pixie/filter.h>
 #include <pixie/util/utils.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
 
-static int init_input(PXMediaContext* ctx, const char* in_file);
-static int init_output(PXMediaContext* ctx, const char* out_file, const char* enc_name_v,
-                       const char* enc_opts_v);
+static int init_input(PXMediaContext* ctx, const char* in_file, const PXMediaSettings* settings);
+static int init_output(PXMediaContext* ctx, const char* out_file, const PXMediaSettings* settings);
+static int init_segment(PXMediaContext* ctx, const PXSegment* segment);
+static void init_time_range(PXMediaContext* ctx);
+
+// size of the buffer AVIOContexts wrapping PXIOCallbacks read into and write from
+#define PX_IO_BUF_SIZE (64 * 1024)
 
 PXMediaContext* px_media_ctx_alloc(void) {
     PXMediaContext* ctx = calloc(1, sizeof *ctx);
-    if (!ctx)
+    if (!ctx) {
         px_oom_msg(sizeof *ctx);
+        return NULL;
+    }
+
+    if (px_mutex_init(&ctx->mux_lock) != 0)
+        px_free(&ctx);
+
     return ctx;
 }
 
-int px_media_ctx_new(PXMediaContext** ctx, const char* in_file, const char* out_file, const char* enc_name_v,
-                     const char* enc_opts_v) {
+int px_media_ctx_new(PXMediaContext** ctx, const char* in_file, const char* out_file,
+                     const PXMediaSettings* settings) {
     *ctx = px_media_ctx_alloc();
     if (!*ctx)
         return PXERROR(ENOMEM);
@@ -27,13 +41,33 @@ int px_media_ctx_new(PXMediaContext** ctx, const char* in_file, const char* out_
 
     pctx->stream_idx = -1;
 
-    int ret = init_input(pctx, in_file);
+    // only used for log messages when using custom IO
+    if (settings->in_io)
+        in_file = in_file ? in_file : "<custom input>";
+    if (settings->out_io)
+        out_file = out_file ? out_file : "<custom output>";
+
+    pctx->stats = px_stats_alloc(settings->fltr_ctx ? settings->fltr_ctx->n_filters : 0);
+    if (!pctx->stats)
+        return PXERROR(ENOMEM);
+
+    int ret = init_input(pctx, in_file, settings);
     if (ret < 0) {
         px_log(PX_LOG_ERROR, "Error occurred while processing input file \"%s\"\n", in_file);
         return ret;
     }
 
-    ret = init_output(pctx, out_file, enc_name_v, enc_opts_v);
+    if (settings->segment) {
+        ret = init_segment(pctx, settings->segment);
+        if (ret < 0) {
+            px_log(PX_LOG_ERROR, "Error occurred while seeking in input file \"%s\"\n", in_file);
+            return ret;
+        }
+    }
+
+    init_time_range(pctx);
+
+    ret = init_output(pctx, out_file, settings);
     if (ret < 0) {
         px_log(PX_LOG_ERROR, "Error occurred while processing output file \"%s\"\n", out_file);
         return ret;
@@ -42,41 +76,174 @@ int px_media_ctx_new(PXMediaContext** ctx, const char* in_file, const char* out_
     return 0;
 }
 
+static void free_sws(PXMediaContext* ctx) {
+    if (!ctx->coding_ctx_arr)
+        return;
+
+    for (unsigned i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        PXCodingContext* coding_ctx = &ctx->coding_ctx_arr[i];
+        for (int j = 0; j < ctx->n_sws_threads; j++) {
+            if (coding_ctx->sws_import)
+                sws_freeContext(coding_ctx->sws_import[j]);
+            if (coding_ctx->sws_export)
+                sws_freeContext(coding_ctx->sws_export[j]);
+            if (coding_ctx->conv_frames)
+                av_frame_free(&coding_ctx->conv_frames[j]);
+        }
+
+        px_free(&coding_ctx->sws_import);
+        px_free(&coding_ctx->sws_export);
+        px_free(&coding_ctx->conv_frames);
+    }
+
+    ctx->n_sws_threads = 0;
+}
+
+int px_media_ctx_alloc_sws(PXMediaContext* ctx, int n_threads) {
+    if (ctx->n_sws_threads >= n_threads)
+        return 0;
+
+    free_sws(ctx);
+
+    for (unsigned i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        PXCodingContext* coding_ctx = &ctx->coding_ctx_arr[i];
+
+        coding_ctx->sws_import = calloc((size_t)n_threads, sizeof *coding_ctx->sws_import);
+        coding_ctx->sws_export = calloc((size_t)n_threads, sizeof *coding_ctx->sws_export);
+        coding_ctx->conv_frames = calloc((size_t)n_threads, sizeof *coding_ctx->conv_frames);
+        if (!coding_ctx->sws_import || !coding_ctx->sws_export || !coding_ctx->conv_frames) {
+            px_oom_msg((size_t)n_threads * sizeof *coding_ctx->sws_import);
+            px_free(&coding_ctx->sws_import);
+            px_free(&coding_ctx->sws_export);
+            px_free(&coding_ctx->conv_frames);
+            free_sws(ctx);
+            return PXERROR(ENOMEM);
+        }
+    }
+
+    ctx->n_sws_threads = n_threads;
+    return 0;
+}
+
+static int io_read(void* opaque, uint8_t* buf, int size) {
+    const PXIOCallbacks* io = opaque;
+    return io->read(io->opaque, buf, size);
+}
+
+// the buffer is only const since libavformat 61
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int io_write(void* opaque, const uint8_t* buf, int size) {
+#else
+static int io_write(void* opaque, uint8_t* buf, int size) {
+#endif
+    const PXIOCallbacks* io = opaque;
+    return io->write(io->opaque, buf, size);
+}
+
+static int64_t io_seek(void* opaque, int64_t offset, int whence) {
+    const PXIOCallbacks* io = opaque;
+    return io->seek(io->opaque, offset, whence);
+}
+
+// wrap `io` (which has to outlive the returned context) in an AVIOContext, for writing if `write`
+static AVIOContext* alloc_custom_io(const PXIOCallbacks* io, bool write) {
+    uint8_t* buf = av_malloc(PX_IO_BUF_SIZE);
+    if (!buf) {
+        px_oom_msg(PX_IO_BUF_SIZE);
+        return NULL;
+    }
+
+    AVIOContext* avio = avio_alloc_context(buf, PX_IO_BUF_SIZE, write, (void*)io, write ? NULL : io_read,
+                                           write ? io_write : NULL, io->seek ? io_seek : NULL);
+    if (!avio) {
+        av_free(buf);
+        px_oom_msg(sizeof(AVIOContext));
+    }
+    return avio;
+}
+
+static void free_custom_io(AVIOContext** avio) {
+    if (!*avio)
+        return;
+
+    // libavformat may have replaced the buffer
+    av_freep(&(*avio)->buffer);
+    avio_context_free(avio);
+}
+
 void px_media_ctx_free(PXMediaContext** ctx) {
     if (!ctx || !*ctx)
         return;
     PXMediaContext* pctx = *ctx;
 
     if (pctx->ifmt_ctx) {
+        free_sws(pctx);
+
         for (unsigned i = 0; i < pctx->ifmt_ctx->nb_streams; i++) {
-            if (pctx->coding_ctx_arr[i].dec_ctx) {
-                avcodec_free_context(&pctx->coding_ctx_arr[i].dec_ctx);
+            PXCodingContext* coding_ctx = &pctx->coding_ctx_arr[i];
+            if (coding_ctx->dec_ctx) {
+                avcodec_free_context(&coding_ctx->dec_ctx);
             }
-            if (pctx->coding_ctx_arr[i].enc_ctx) {
-                avcodec_free_context(&pctx->coding_ctx_arr[i].enc_ctx);
+            if (coding_ctx->enc_ctx) {
+                avcodec_free_context(&coding_ctx->enc_ctx);
             }
+
+            av_frame_free(&coding_ctx->dec_frame);
+            av_packet_free(&coding_ctx->enc_pkt);
+            av_buffer_pool_uninit(&coding_ctx->enc_buf_pool);
         }
 
         avformat_close_input(&pctx->ifmt_ctx);
         pctx->ifmt_ctx = NULL;
     }
+    free_custom_io(&pctx->in_io);
 
     px_free(&pctx->coding_ctx_arr);
 
     if (pctx->ofmt_ctx) {
-        if (!(pctx->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+        if (!(pctx->ofmt_ctx->oformat->flags & AVFMT_NOFILE) && !pctx->out_io)
             avio_closep(&pctx->ofmt_ctx->pb);
 
         avformat_free_context(pctx->ofmt_ctx);
         pctx->ofmt_ctx = NULL;
     }
+    free_custom_io(&pctx->out_io);
 
     pctx->stream_idx = -1;
+    px_stats_free(&pctx->stats);
+    px_mutex_destroy(&pctx->mux_lock);
     px_free(ctx);
 }
 
-static int init_input(PXMediaContext* ctx, const char* in_file) {
-    int ret = avformat_open_input(&ctx->ifmt_ctx, in_file, NULL, NULL);
+static int init_input(PXMediaContext* ctx, const char* in_file, const PXMediaSettings* settings) {
+    const AVInputFormat* in_fmt = NULL;
+    if (settings->in_format) {
+        in_fmt = av_find_input_format(settings->in_format);
+        if (!in_fmt) {
+            px_log(PX_LOG_ERROR, "Unknown input format \"%s\"\n", settings->in_format);
+            return AVERROR_DEMUXER_NOT_FOUND;
+        }
+    }
+
+    const char* url = strcmp(in_file, "-") == 0 ? "pipe:" : in_file;
+    if (settings->in_io) {
+        ctx->ifmt_ctx = avformat_alloc_context();
+        if (!ctx->ifmt_ctx) {
+            px_oom_msg(sizeof(AVFormatContext));
+            return AVERROR(ENOMEM);
+        }
+
+        ctx->in_cb = *settings->in_io;
+        ctx->in_io = alloc_custom_io(&ctx->in_cb, false);
+        if (!ctx->in_io)
+            return AVERROR(ENOMEM);
+
+        ctx->ifmt_ctx->pb = ctx->in_io;
+        ctx->ifmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        url = NULL;
+    }
+
+    int ret = avformat_open_input(&ctx->ifmt_ctx, url, in_fmt, NULL);
     if (ret < 0) {
         LAV_THROW_MSG("avformat_open_input", ret);
         return ret;
@@ -120,6 +287,10 @@ static int init_input(PXMediaContext* ctx, const char* in_file) {
             return ret;
         }
 
+        // frame threading if the decoder supports it, slice threading otherwise
+        dec_ctx->thread_count = settings->dec_threads;
+        dec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
         ret = avcodec_open2(dec_ctx, decoder, NULL);
         if (ret < 0) {
             LAV_THROW_MSG("avcodec_open2", ret);
@@ -130,6 +301,12 @@ static int init_input(PXMediaContext* ctx, const char* in_file) {
 
         ctx->coding_ctx_arr[i].dec_ctx = dec_ctx;
 
+        ctx->coding_ctx_arr[i].dec_frame = av_frame_alloc();
+        if (!ctx->coding_ctx_arr[i].dec_frame) {
+            px_oom_msg(sizeof(AVFrame));
+            return AVERROR(ENOMEM);
+        }
+
         if (av_log_get_level() >= AV_LOG_INFO)
             av_dump_format(ctx->ifmt_ctx, (int)i, in_file, false);
     }
@@ -142,9 +319,212 @@ static int init_input(PXMediaContext* ctx, const char* in_file) {
     return 0;
 }
 
-static int init_output(PXMediaContext* ctx, const char* out_file, const char* enc_name_v,
-                       const char* enc_opts_v) {
-    int ret = avformat_alloc_output_context2(&ctx->ofmt_ctx, NULL, NULL, out_file);
+// AV_PIX_FMT_NONE-terminated, NULL if the encoder accepts any format
+static const enum AVPixelFormat* get_supported_pix_fmts(const AVCodec* encoder) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61, 13, 100)
+    const void* pix_fmts = NULL;
+    int ret = avcodec_get_supported_config(NULL, encoder, AV_CODEC_CONFIG_PIX_FORMAT, 0, &pix_fmts, NULL);
+    return ret < 0 ? NULL : pix_fmts;
+#else
+    return encoder->pix_fmts;
+#endif
+}
+
+static bool pix_fmt_supported(const enum AVPixelFormat* pix_fmts, enum AVPixelFormat pix_fmt) {
+    if (pix_fmt == AV_PIX_FMT_NONE)
+        return false;
+
+    if (!pix_fmts)
+        return true;
+
+    for (const enum AVPixelFormat* it = pix_fmts; *it != AV_PIX_FMT_NONE; it++) {
+        if (*it == pix_fmt)
+            return true;
+    }
+
+    return false;
+}
+
+static bool has_alpha(enum AVPixelFormat pix_fmt) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+    return desc && desc->flags & AV_PIX_FMT_FLAG_ALPHA;
+}
+
+/**
+ * pick the format video frames are filtered in: the planar equivalent of the decoder's format if every
+ * filter supports it, otherwise the closest planar format they all support
+ */
+static int get_filter_pix_fmt(enum AVPixelFormat* filter_pix_fmt, enum AVPixelFormat dec_pix_fmt,
+                              const PXFilterContext* fltr_ctx) {
+    enum AVPixelFormat planar_equiv = px_planar_equivalent(dec_pix_fmt);
+    if (planar_equiv == AV_PIX_FMT_NONE) {
+        const char* fmt_name = av_get_pix_fmt_name(dec_pix_fmt);
+        px_log(PX_LOG_ERROR, "Unsupported pixel format \"%s\"\n", fmt_name ? fmt_name : "(unknown)");
+        return AVERROR(EINVAL);
+    }
+
+    *filter_pix_fmt = planar_equiv;
+    if (px_filter_ctx_supports_pix_fmt(fltr_ctx, px_pix_fmt_from_planar_av(planar_equiv)))
+        return 0;
+
+    enum AVPixelFormat candidates[AV_PIX_FMT_NB + 1];
+    PXPixelFormat candidate_px_fmts[AV_PIX_FMT_NB];
+    int n_candidates = 0;
+
+    const AVPixFmtDescriptor* desc = NULL;
+    while ((desc = av_pix_fmt_desc_next(desc))) {
+        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(desc);
+        if (px_planar_equivalent(pix_fmt) != pix_fmt)
+            continue;
+        if (av_pix_fmt_count_planes(pix_fmt) != desc->nb_components)
+            continue;
+
+        PXPixelFormat px_pix_fmt = px_pix_fmt_from_planar_av(pix_fmt);
+        if (!px_filter_ctx_supports_pix_fmt(fltr_ctx, px_pix_fmt))
+            continue;
+
+        // e.g. yuvj420p has the same layout as yuv420p, which comes first
+        bool duplicate = false;
+        for (int i = 0; i < n_candidates && !duplicate; i++) {
+            duplicate = candidate_px_fmts[i] == px_pix_fmt;
+        }
+        if (duplicate)
+            continue;
+
+        candidate_px_fmts[n_candidates] = px_pix_fmt;
+        candidates[n_candidates++] = pix_fmt;
+    }
+    candidates[n_candidates] = AV_PIX_FMT_NONE;
+
+    if (!n_candidates) {
+        px_log(PX_LOG_ERROR, "No pixel format is supported by every filter\n");
+        return AVERROR(EINVAL);
+    }
+
+    *filter_pix_fmt =
+        avcodec_find_best_pix_fmt_of_list(candidates, dec_pix_fmt, has_alpha(dec_pix_fmt), NULL);
+    px_log(PX_LOG_INFO, "Filtering in %s, %s is not supported by every filter\n",
+           av_get_pix_fmt_name(*filter_pix_fmt), av_get_pix_fmt_name(planar_equiv));
+
+    return 0;
+}
+
+// negotiate the format frames are filtered in and configure the filters' output for one video stream
+static int config_filters(PXCodingContext* coding_ctx, PXFilterContext* fltr_ctx, PXFrameProps* out) {
+    const AVCodecContext* dec_ctx = coding_ctx->dec_ctx;
+
+    enum AVPixelFormat filter_pix_fmt = AV_PIX_FMT_NONE;
+    int ret = get_filter_pix_fmt(&filter_pix_fmt, dec_ctx->pix_fmt, fltr_ctx);
+    if (ret < 0)
+        return ret;
+
+    AVRational fps = dec_ctx->framerate.den > 0 ? dec_ctx->framerate : (AVRational) {0, 1};
+    PXFrameProps in = {
+        .width = dec_ctx->width,
+        .height = dec_ctx->height,
+        .pix_fmt = px_pix_fmt_from_planar_av(filter_pix_fmt),
+        .fps_num = fps.num,
+        .fps_den = fps.den,
+    };
+    ret = px_filter_ctx_config(fltr_ctx, &in, out);
+    if (ret < 0)
+        return ret;
+
+    coding_ctx->filter_pix_fmt = filter_pix_fmt;
+
+    // formats with the same layout are interchangeable for filters, so keep e.g. yuvj420p if it's unchanged
+    coding_ctx->filter_out_pix_fmt =
+        out->pix_fmt == in.pix_fmt ? filter_pix_fmt : px_planar_av_from_pix_fmt(out->pix_fmt);
+    if (coding_ctx->filter_out_pix_fmt == AV_PIX_FMT_NONE) {
+        char fmt_name[PX_PIX_FMT_MAX_NAME_LEN];
+        px_pix_fmt_get_name(fmt_name, out->pix_fmt);
+        px_log(PX_LOG_ERROR, "Filters output frames in %s, which FFmpeg has no equivalent for\n", fmt_name);
+        return AVERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+/**
+ * pick the encoder's input format so that frames need as few conversions as possible
+ * frames reach the encoder in the format the last filter outputs, or as decoded if there are no filters,
+ * so that format is preferred. otherwise, one conversion is unavoidable
+ */
+static enum AVPixelFormat negotiate_pix_fmt(const AVCodec* encoder, enum AVPixelFormat src_pix_fmt) {
+    const enum AVPixelFormat* supported = get_supported_pix_fmts(encoder);
+    if (pix_fmt_supported(supported, src_pix_fmt))
+        return src_pix_fmt;
+
+    // let ffmpeg pick the least lossy conversion
+    return avcodec_find_best_pix_fmt_of_list(supported, src_pix_fmt, has_alpha(src_pix_fmt), NULL);
+}
+
+static int get_enc_pix_fmt(enum AVPixelFormat* enc_pix_fmt, const AVCodec* encoder,
+                           enum AVPixelFormat src_pix_fmt, const PXMediaSettings* settings) {
+    if (!settings->pix_fmt_v) {
+        *enc_pix_fmt = negotiate_pix_fmt(encoder, src_pix_fmt);
+        if (*enc_pix_fmt == AV_PIX_FMT_NONE) {
+            px_log(PX_LOG_ERROR, "No pixel format supported by encoder \"%s\" found\n", encoder->name);
+            return AVERROR(EINVAL);
+        }
+
+        px_log(PX_LOG_INFO, "Using pixel format %s for encoder \"%s\"\n", av_get_pix_fmt_name(*enc_pix_fmt),
+               encoder->name);
+        return 0;
+    }
+
+    *enc_pix_fmt = av_get_pix_fmt(settings->pix_fmt_v);
+    if (*enc_pix_fmt == AV_PIX_FMT_NONE) {
+        px_log(PX_LOG_ERROR, "Unknown pixel format \"%s\"\n", settings->pix_fmt_v);
+        return AVERROR(EINVAL);
+    }
+
+    if (!pix_fmt_supported(get_supported_pix_fmts(encoder), *enc_pix_fmt)) {
+        px_log(PX_LOG_ERROR, "Pixel format \"%s\" is not supported by encoder \"%s\"\n", settings->pix_fmt_v,
+               encoder->name);
+        return AVERROR(EINVAL);
+    }
+
+    return 0;
+}
+
+// allocate what encoding reuses for every frame, once the encoder is open
+static int init_enc_buffers(PXCodingContext* coding_ctx) {
+    const AVCodecContext* enc_ctx = coding_ctx->enc_ctx;
+
+    coding_ctx->enc_pkt = av_packet_alloc();
+    if (!coding_ctx->enc_pkt) {
+        px_oom_msg(sizeof(AVPacket));
+        return AVERROR(ENOMEM);
+    }
+
+    int buf_size =
+        av_image_get_buffer_size(enc_ctx->pix_fmt, enc_ctx->width, enc_ctx->height, PX_ENC_BUF_ALIGN);
+    if (buf_size < 0) {
+        LAV_THROW_MSG("av_image_get_buffer_size", buf_size);
+        return buf_size;
+    }
+
+    // padded like av_frame_get_buffer() does, since SIMD code may read a bit past the last row
+    coding_ctx->enc_buf_pool = av_buffer_pool_init((size_t)buf_size + PX_ENC_BUF_ALIGN, NULL);
+    if (!coding_ctx->enc_buf_pool) {
+        px_oom_msg((size_t)buf_size);
+        return AVERROR(ENOMEM);
+    }
+
+    return 0;
+}
+
+static int init_output(PXMediaContext* ctx, const char* out_file, const PXMediaSettings* settings) {
+    bool to_stdout = !settings->out_io && strcmp(out_file, "-") == 0;
+    if ((to_stdout || settings->out_io) && !settings->out_format) {
+        px_log(PX_LOG_ERROR, "The output format has to be given when writing to %s\n",
+               to_stdout ? "stdout" : "custom output");
+        return AVERROR(EINVAL);
+    }
+
+    const char* url = to_stdout ? "pipe:" : settings->out_io ? NULL : out_file;
+    int ret = avformat_alloc_output_context2(&ctx->ofmt_ctx, NULL, settings->out_format, url);
     if (ret < 0) {
         LAV_THROW_MSG("avformat_alloc_output_context2", ret);
         return ret;
@@ -168,9 +548,9 @@ static int init_output(PXMediaContext* ctx, const char* out_file, const char* en
             continue;
         }
 
-        const AVCodec* encoder = avcodec_find_encoder_by_name(enc_name_v);
-        if (!encoder && enc_name_v) {
-            px_log(PX_LOG_ERROR, "Failed to find encoder \"%s\"\n", enc_name_v);
+        const AVCodec* encoder = avcodec_find_encoder_by_name(settings->enc_name_v);
+        if (!encoder && settings->enc_name_v) {
+            px_log(PX_LOG_ERROR, "Failed to find encoder \"%s\"\n", settings->enc_name_v);
             return AVERROR_ENCODER_NOT_FOUND;
         } else if (!encoder) {
             const char* default_enc = "libx264";
@@ -178,29 +558,68 @@ static int init_output(PXMediaContext* ctx, const char* out_file, const char* en
             encoder = avcodec_find_encoder_by_name(default_enc);
         }
 
+        PXCodingContext* coding_ctx = &ctx->coding_ctx_arr[i];
+        const AVCodecContext* dec_ctx = coding_ctx->dec_ctx;
+
+        // frames are passed to the encoder as they come out of the last filter, or as decoded
+        enum AVPixelFormat src_pix_fmt = dec_ctx->pix_fmt;
+        int width = dec_ctx->width;
+        int height = dec_ctx->height;
+        AVRational framerate = dec_ctx->framerate;
+
+        coding_ctx->filter_pix_fmt = AV_PIX_FMT_NONE;
+        coding_ctx->filter_out_pix_fmt = AV_PIX_FMT_NONE;
+        if (settings->fltr_ctx && settings->fltr_ctx->n_filters > 0) {
+            PXFrameProps out_props = {0};
+            ret = config_filters(coding_ctx, settings->fltr_ctx, &out_props);
+            if (ret < 0)
+                return ret;
+
+            src_pix_fmt = coding_ctx->filter_out_pix_fmt;
+            width = out_props.width;
+            height = out_props.height;
+            if (out_props.fps_num > 0)
+                framerate = (AVRational) {out_props.fps_num, out_props.fps_den};
+        }
+
+        enum AVPixelFormat enc_pix_fmt = AV_PIX_FMT_NONE;
+        ret = get_enc_pix_fmt(&enc_pix_fmt, encoder, src_pix_fmt, settings);
+        if (ret < 0)
+            return ret;
+
         AVCodecContext* enc_ctx = avcodec_alloc_context3(encoder);
         if (!enc_ctx) {
             px_oom_msg(sizeof *enc_ctx);
             return AVERROR(ENOMEM);
         }
 
-        const AVCodecContext* dec_ctx = ctx->coding_ctx_arr[i].dec_ctx;
-
-        enc_ctx->time_base = av_inv_q(dec_ctx->framerate);
+        enc_ctx->framerate = framerate;
+        enc_ctx->time_base = av_inv_q(framerate);
         ostream->time_base = enc_ctx->time_base;
 
-        enc_ctx->width = dec_ctx->width;
-        enc_ctx->height = dec_ctx->height;
+        enc_ctx->width = width;
+        enc_ctx->height = height;
         enc_ctx->sample_aspect_ratio = dec_ctx->sample_aspect_ratio;
-        enc_ctx->pix_fmt = dec_ctx->pix_fmt;
+        enc_ctx->pix_fmt = enc_pix_fmt;
+
+        enc_ctx->thread_count = settings->enc_threads;
+        enc_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
 
         AVDictionary* opts = NULL;
-        ret = av_dict_parse_string(&opts, enc_opts_v, "=", ":", 0);
+        ret = av_dict_parse_string(&opts, settings->enc_opts_v, "=", ":", 0);
         if (ret < 0) {
             LAV_THROW_MSG("av_dict_parse_string", ret);
             return ret;
         }
 
+        // an explicit thread count takes precedence over the `threads` encoder option
+        if (settings->enc_threads > 0)
+            av_dict_set(&opts, "threads", NULL, 0);
+
+        // has to be set before opening the encoder to have any effect
+        if (ctx->ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
+            enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
         ret = avcodec_open2(enc_ctx, encoder, &opts);
         if (ret < 0) {
             LAV_THROW_MSG("avcodec_open2", ret);
@@ -213,17 +632,26 @@ static int init_output(PXMediaContext* ctx, const char* out_file, const char* en
             return ret;
         }
 
-        ctx->coding_ctx_arr[i].enc_ctx = enc_ctx;
+        coding_ctx->enc_ctx = enc_ctx;
 
-        if (ctx->ofmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
-            enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        ret = init_enc_buffers(coding_ctx);
+        if (ret < 0)
+            return ret;
 
         if (av_log_get_level() >= AV_LOG_INFO)
             av_dump_format(ctx->ofmt_ctx, (int)i, out_file, true);
     }
 
-    if (!(ctx->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&ctx->ofmt_ctx->pb, out_file, AVIO_FLAG_WRITE);
+    if (settings->out_io) {
+        ctx->out_cb = *settings->out_io;
+        ctx->out_io = alloc_custom_io(&ctx->out_cb, true);
+        if (!ctx->out_io)
+            return AVERROR(ENOMEM);
+
+        ctx->ofmt_ctx->pb = ctx->out_io;
+        ctx->ofmt_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    } else if (!(ctx->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&ctx->ofmt_ctx->pb, url, AVIO_FLAG_WRITE);
         if (ret < 0) {
             LAV_THROW_MSG("avio_open", ret);
             return ret;
@@ -238,3 +666,58 @@ static int init_output(PXMediaContext* ctx, const char* out_file, const char* en
 
     return 0;
 }
+
+// skip to the start of `segment` and leave out every stream but the video stream
+static int init_segment(PXMediaContext* ctx, const PXSegment* segment) {
+    int video_idx = -1;
+    for (unsigned i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        AVStream* stream = ctx->ifmt_ctx->streams[i];
+        if (stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+            stream->discard = AVDISCARD_ALL;
+            continue;
+        }
+
+        if (video_idx >= 0) {
+            px_log(PX_LOG_ERROR, "Only files with a single video stream can be transcoded in segments\n");
+            return AVERROR(EINVAL);
+        }
+        video_idx = (int)i;
+    }
+
+    ctx->segmented = true;
+    ctx->segment = *segment;
+    if (segment->start == INT64_MIN)
+        return 0;
+
+    // `start` is a keyframe, so this lands right on it unless the index is inexact
+    int ret = av_seek_frame(ctx->ifmt_ctx, video_idx, segment->start, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        LAV_THROW_MSG("av_seek_frame", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+// find the part of the input that will be transcoded, for reporting progress
+static void init_time_range(PXMediaContext* ctx) {
+    const AVFormatContext* ifmt_ctx = ctx->ifmt_ctx;
+    int64_t start = ifmt_ctx->start_time != AV_NOPTS_VALUE ? ifmt_ctx->start_time : 0;
+    int64_t end = ifmt_ctx->duration != AV_NOPTS_VALUE ? start + ifmt_ctx->duration : AV_NOPTS_VALUE;
+
+    // segmented inputs only have one stream left, the video stream
+    for (unsigned i = 0; ctx->segmented && i < ifmt_ctx->nb_streams; i++) {
+        const AVStream* stream = ifmt_ctx->streams[i];
+        if (stream->discard == AVDISCARD_ALL)
+            continue;
+
+        if (ctx->segment.start != INT64_MIN)
+            start = av_rescale_q(ctx->segment.start, stream->time_base, AV_TIME_BASE_Q);
+        if (ctx->segment.end != INT64_MAX)
+            end = av_rescale_q(ctx->segment.end, stream->time_base, AV_TIME_BASE_Q);
+        break;
+    }
+
+    ctx->start_us = start;
+    ctx->duration_us = end != AV_NOPTS_VALUE && end > start ? end - start : -1;
+}
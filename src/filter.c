@@ -1,3 +1,5 @@
+#include "internals.h"
+
 #include <pixie/filter.h>
 #include <pixie/log.h>
 #include <pixie/util/utils.h>
@@ -47,6 +49,10 @@ int px_filter_from_dll(PXFilter** filter, const char* dll_path) {
         px_log(PX_LOG_ERROR, "Filter name not set in \"%s\"\n", dll_path);
         return PXERROR(EINVAL);
     }
+    if (!pf->apply && !pf->apply_slice && !pf->get_lut) {
+        px_log(PX_LOG_ERROR, "Filter \"%s\" sets none of apply(), apply_slice() or get_lut()\n", pf->name);
+        return PXERROR(EINVAL);
+    }
 
     pf->dll_handle = dll_handle;
     return 0;
@@ -65,6 +71,52 @@ void px_filter_free(PXFilter** filter) {
     px_free(filter);
 }
 
+bool px_filter_supports_pix_fmt(const PXFilter* filter, PXPixelFormat pix_fmt) {
+    if (!filter->pix_fmts)
+        return true;
+
+    for (const PXPixelFormat* it = filter->pix_fmts; *it != PX_PIX_FMT_NONE; it++) {
+        if (*it == pix_fmt)
+            return true;
+    }
+
+    return false;
+}
+
+bool px_filter_is_temporal(const PXFilter* filter) {
+    return filter->past_frames > 0 || filter->future_frames > 0;
+}
+
+const PXFrame* px_filter_get_frame(const PXFilter* filter, int offset) {
+    assert(offset >= -filter->past_frames && offset <= filter->future_frames);
+    if (!filter->window)
+        return filter->in_frame;
+
+    int idx = filter->window_pos + offset;
+    if (idx < 0)
+        idx = 0;
+    else if (idx >= filter->window->num_frames)
+        idx = filter->window->num_frames - 1;
+
+    return px_fb_get(filter->window, idx);
+}
+
+int px_parallel_for(const PXFilter* filter, int n_jobs, PXPoolJobFunc func, void* ctx) {
+    if (filter->thread_pool)
+        return px_thrd_pool_run(filter->thread_pool, func, ctx, n_jobs);
+
+    for (int i = 0; i < n_jobs; i++) {
+        int ret = func(ctx, i, 0);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+int px_parallel_threads(const PXFilter* filter) {
+    return filter->thread_pool ? px_thrd_pool_num_threads(filter->thread_pool) : 1;
+}
+
 PXFilterContext* px_filter_ctx_alloc(void) {
     PXFilterContext* ctx = calloc(1, sizeof *ctx);
     if (!ctx)
@@ -99,7 +151,9 @@ int px_filter_ctx_new(PXFilterContext** ctx, const char* filter_dir, const char*
     pctx->n_filters = n_filters;
     pctx->filter_opts = filter_opts;
 
-    int ret = 0;
+    int ret = px_frame_pool_new(&pctx->frame_pool);
+    if (ret < 0)
+        goto fail;
 
     pctx->filters = calloc((size_t)pctx->n_filters, sizeof(PXFilter*));
     if (!pctx->filters) {
@@ -120,6 +174,8 @@ int px_filter_ctx_new(PXFilterContext** ctx, const char* filter_dir, const char*
         if (ret < 0)
             goto fail;
 
+        pctx->filters[i]->frame_pool = pctx->frame_pool;
+
         if (pctx->filters[i]->init) {
             ret = pctx->filters[i]->init(pctx->filters[i], &pctx->filter_opts[i]);
             if (ret < 0) {
@@ -127,6 +183,18 @@ int px_filter_ctx_new(PXFilterContext** ctx, const char* filter_dir, const char*
                 goto fail;
             }
         }
+
+        const PXFilter* fltr = pctx->filters[i];
+        if (fltr->past_frames < 0 || fltr->future_frames < 0) {
+            px_log(PX_LOG_ERROR, "Filter \"%s\" asks for a negative number of frames\n", fltr->name);
+            ret = PXERROR(EINVAL);
+            goto fail;
+        }
+        if (fltr->halo_rows < 0) {
+            px_log(PX_LOG_ERROR, "Filter \"%s\" asks for a negative number of halo rows\n", fltr->name);
+            ret = PXERROR(EINVAL);
+            goto fail;
+        }
     }
 
     return 0;
@@ -141,10 +209,157 @@ void px_filter_ctx_free(PXFilterContext** ctx) {
         return;
     PXFilterContext* pctx = *ctx;
 
-    for (int i = 0; i < pctx->n_filters; i++) {
+    for (int i = 0; pctx->filters && i < pctx->n_filters; i++) {
         px_filter_free(&pctx->filters[i]);
     }
 
-    px_free(pctx->filters);
+    for (int i = 0; i < pctx->n_luts; i++) {
+        px_lut_free(&pctx->luts[i]);
+    }
+    px_free(&pctx->luts);
+
+    px_free(&pctx->filters);
+    px_frame_pool_free(&pctx->frame_pool);
     px_free(ctx);
 }
+
+bool px_filter_ctx_supports_pix_fmt(const PXFilterContext* ctx, PXPixelFormat pix_fmt) {
+    for (int i = 0; i < ctx->n_filters; i++) {
+        if (!px_filter_supports_pix_fmt(ctx->filters[i], pix_fmt))
+            return false;
+        if (ctx->filters[i]->config_output)
+            break;
+    }
+
+    return true;
+}
+
+static bool props_equal(const PXFrameProps* a, const PXFrameProps* b) {
+    return a->width == b->width && a->height == b->height && a->pix_fmt == b->pix_fmt &&
+           a->fps_num == b->fps_num && a->fps_den == b->fps_den;
+}
+
+// whether pixie applies the filter through its lookup table, see PXFilter::get_lut()
+static bool uses_lut(const PXFilter* fltr) {
+    const PXFrameProps* in = &fltr->in_props;
+    const PXFrameProps* out = &fltr->out_props;
+    bool same_props = out->width == in->width && out->height == in->height && out->pix_fmt == in->pix_fmt;
+
+    return fltr->get_lut && px_lut_supports_pix_fmt(in->pix_fmt) && same_props &&
+           !px_filter_is_temporal(fltr) && fltr->max_out_frames <= 1;
+}
+
+static int config_filter(PXFilter* fltr, const PXFrameProps* in) {
+    char fmt_name[PX_PIX_FMT_MAX_NAME_LEN];
+    if (!px_filter_supports_pix_fmt(fltr, in->pix_fmt)) {
+        px_pix_fmt_get_name(fmt_name, in->pix_fmt);
+        px_log(PX_LOG_ERROR, "Filter \"%s\" does not support its input format %s\n", fltr->name, fmt_name);
+        return PXERROR(EINVAL);
+    }
+
+    fltr->in_props = *in;
+    fltr->out_props = *in;
+    if (fltr->config_output) {
+        int ret = fltr->config_output(fltr);
+        if (ret < 0) {
+            px_log(PX_LOG_ERROR, "Failed to configure the output of filter \"%s\"\n", fltr->name);
+            return ret;
+        }
+    }
+
+    const PXFrameProps* out = &fltr->out_props;
+    if (out->width <= 0 || out->height <= 0 || out->pix_fmt == PX_PIX_FMT_NONE || out->fps_num < 0 ||
+        out->fps_den <= 0 || fltr->max_out_frames < 0 || fltr->max_out_frames > PX_FILTER_MAX_OUT_FRAMES) {
+        px_log(PX_LOG_ERROR, "Filter \"%s\" set invalid output properties\n", fltr->name);
+        return PXERROR(EINVAL);
+    }
+
+    if (fltr->max_out_frames == 0)
+        fltr->max_out_frames = 1;
+
+    if (!fltr->apply && !fltr->apply_slice && !uses_lut(fltr)) {
+        px_pix_fmt_get_name(fmt_name, in->pix_fmt);
+        px_log(PX_LOG_ERROR, "Filter \"%s\" can't be applied to %s frames without apply()\n", fltr->name,
+               fmt_name);
+        return PXERROR(EINVAL);
+    }
+
+    if (!props_equal(out, in)) {
+        px_pix_fmt_get_name(fmt_name, out->pix_fmt);
+        px_log(PX_LOG_INFO, "Filter \"%s\" outputs %dx%d %s at %d/%d fps\n", fltr->name, out->width,
+               out->height, fmt_name, out->fps_num, out->fps_den);
+    }
+
+    return 0;
+}
+
+// merge the tables of each run of consecutive filters that use one into a single table
+static int build_luts(PXFilterContext* ctx) {
+    for (int i = 0; i < ctx->n_filters;) {
+        if (!uses_lut(ctx->filters[i])) {
+            i++;
+            continue;
+        }
+
+        int n = 1;
+        while (i + n < ctx->n_filters && uses_lut(ctx->filters[i + n])) {
+            n++;
+        }
+
+        PXLut* luts = realloc(ctx->luts, (size_t)(ctx->n_luts + 1) * sizeof *luts);
+        if (!luts) {
+            px_oom_msg((size_t)(ctx->n_luts + 1) * sizeof *luts);
+            return PXERROR(ENOMEM);
+        }
+        ctx->luts = luts;
+
+        int ret = px_lut_build(&ctx->luts[ctx->n_luts], ctx->filters, i, n);
+        if (ret < 0)
+            return ret;
+        ctx->n_luts++;
+
+        if (n > 1)
+            px_log(PX_LOG_INFO, "Merged the lookup tables of %d filters from \"%s\" on\n", n,
+                   ctx->filters[i]->name);
+        i += n;
+    }
+
+    return 0;
+}
+
+const PXLut* px_filter_ctx_find_lut(const PXFilterContext* ctx, int filter_idx) {
+    for (int i = 0; i < ctx->n_luts; i++) {
+        const PXLut* lut = &ctx->luts[i];
+        if (filter_idx >= lut->first_filter && filter_idx < lut->first_filter + lut->n_filters)
+            return lut;
+    }
+
+    return NULL;
+}
+
+int px_filter_ctx_config(PXFilterContext* ctx, const PXFrameProps* in, PXFrameProps* out) {
+    if (ctx->configured) {
+        // the filters keep a single configuration, shared by every video stream
+        if (ctx->n_filters > 0 && !props_equal(in, &ctx->filters[0]->in_props)) {
+            px_log(PX_LOG_ERROR,
+                   "Video streams with different sizes, formats or frame rates can't be filtered together\n");
+            return PXERROR(EINVAL);
+        }
+    } else {
+        PXFrameProps props = *in;
+        for (int i = 0; i < ctx->n_filters; i++) {
+            int ret = config_filter(ctx->filters[i], &props);
+            if (ret < 0)
+                return ret;
+            props = ctx->filters[i]->out_props;
+        }
+
+        int ret = build_luts(ctx);
+        if (ret < 0)
+            return ret;
+        ctx->configured = true;
+    }
+
+    *out = ctx->n_filters > 0 ? ctx->filters[ctx->n_filters - 1]->out_props : *in;
+    return 0;
+}
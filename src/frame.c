@@ -4,11 +4,13 @@
 #include <libavutil/pixfmt.h>
 #include <pixie/frame.h>
 #include <pixie/coding.h>
+#include <pixie/util/thread.h>
 #include <pixie/util/utils.h>
 
 #include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 
+#include <stdatomic.h>
 #include <stdlib.h>
 
 PXFrame* px_frame_alloc(void) {
@@ -18,19 +20,82 @@ PXFrame* px_frame_alloc(void) {
     return frame;
 }
 
-int px_frame_alloc_bufs(PXFrame* frame) {
-    size_t frame_sz = px_frame_size(frame);
-    uint8_t* data = px_aligned_alloc(32, frame_sz); // todo: platform dependent alignment
-    if (!data) {
-        px_oom_msg(frame_sz);
-        return PXERROR(ENOMEM);
+struct PXFrameBuf {
+    uint8_t* data;
+    size_t size;
+    atomic_int refcount;
+
+    // if set, the data is borrowed and `free(opaque)` is called instead of freeing it
+    void (*free)(void* opaque);
+    void* opaque;
+    bool read_only;
+
+    // pool the buffer is returned to when released, NULL if not pooled
+    PXFramePool* pool;
+    int bucket_idx;
+    PXFrameBuf* next_free;
+};
+
+// released buffers of frames with identical layouts
+typedef struct PoolBucket {
+    int width;
+    int height;
+    PXPixelFormat pix_fmt;
+    int strides[PX_FRAME_MAX_PLANES];
+
+    PXFrameBuf* free_bufs;
+} PoolBucket;
+
+struct PXFramePool {
+    PXMutex lock;
+
+    PoolBucket* buckets;
+    int n_buckets;
+
+    // one reference for the owner + one for each buffer in use
+    int refcount;
+};
+
+static PXFrameBuf* frame_buf_alloc(size_t size) {
+    PXFrameBuf* buf = calloc(1, sizeof *buf);
+    if (!buf) {
+        px_oom_msg(sizeof *buf);
+        return NULL;
+    }
+
+    buf->data = px_aligned_alloc(PX_FRAME_ALIGN, size);
+    if (!buf->data) {
+        px_oom_msg(size);
+        px_free(&buf);
+        return NULL;
     }
 
-    frame->planes[0].data = data;
+    buf->size = size;
+    buf->refcount = 1;
+    return buf;
+}
+
+static void frame_buf_free(PXFrameBuf* buf) {
+    if (buf->free)
+        buf->free(buf->opaque);
+    else
+        px_aligned_free(buf->data);
+    free(buf);
+}
+
+static void set_plane_ptrs(PXFrame* frame) {
+    frame->planes[0].data = frame->buf->data;
     for (int i = 1; i < frame->n_planes; i++) {
         frame->planes[i].data = frame->planes[i - 1].data + px_plane_size(frame, i - 1);
     }
+}
 
+int px_frame_alloc_bufs(PXFrame* frame) {
+    frame->buf = frame_buf_alloc(px_frame_size(frame));
+    if (!frame->buf)
+        return PXERROR(ENOMEM);
+
+    set_plane_ptrs(frame);
     return 0;
 }
 
@@ -54,7 +119,7 @@ int px_frame_init(PXFrame* frame, int width, int height, PXPixelFormat pix_fmt,
         frame->planes[i].height = i == 0 ? frame->height : chroma_height;
 
         frame->planes[i].stride =
-            strides ? strides[i] : FFALIGN(frame->planes[i].width * frame->bytes_per_comp, 32);
+            strides ? strides[i] : FFALIGN(frame->planes[i].width * frame->bytes_per_comp, PX_FRAME_ALIGN);
         assert(frame->planes[i].stride >= frame->planes[i].width * frame->bytes_per_comp);
     }
 
@@ -84,13 +149,190 @@ void px_frame_free(PXFrame** frame) {
     if (!frame || !*frame)
         return;
 
-    px_frame_free_internal(*frame);
+    px_frame_unref(*frame);
     px_free(frame);
 }
 
-void px_frame_free_internal(PXFrame* frame) {
-    px_aligned_free(frame->planes[0].data);
-    frame->planes[0].data = NULL;
+void px_frame_ref(PXFrame* dest, const PXFrame* src) {
+    *dest = *src;
+    if (dest->buf)
+        dest->buf->refcount++;
+}
+
+// drop one of the pool's references, assumes `pool->lock` is held and releases it
+static void frame_pool_unref_locked(PXFramePool* pool) {
+    bool last_ref = --pool->refcount == 0;
+    px_mutex_unlock(&pool->lock);
+    if (!last_ref)
+        return;
+
+    for (int i = 0; i < pool->n_buckets; i++) {
+        PXFrameBuf* buf = pool->buckets[i].free_bufs;
+        while (buf) {
+            PXFrameBuf* next = buf->next_free;
+            frame_buf_free(buf);
+            buf = next;
+        }
+    }
+
+    px_mutex_destroy(&pool->lock);
+    px_free(&pool->buckets);
+    free(pool);
+}
+
+// drop a reference to `buf`, freeing it or returning it to its pool if it was the last one
+static void frame_buf_unref(PXFrameBuf* buf) {
+    if (!buf || --buf->refcount > 0)
+        return;
+
+    PXFramePool* pool = buf->pool;
+    if (!pool) {
+        frame_buf_free(buf);
+        return;
+    }
+
+    px_mutex_lock(&pool->lock);
+    PoolBucket* bucket = &pool->buckets[buf->bucket_idx];
+    buf->next_free = bucket->free_bufs;
+    bucket->free_bufs = buf;
+    frame_pool_unref_locked(pool);
+}
+
+void px_frame_unref(PXFrame* frame) {
+    PXFrameBuf* buf = frame->buf;
+    frame->buf = NULL;
+    for (int i = 0; i < frame->n_planes; i++) {
+        frame->planes[i].data = NULL;
+    }
+
+    frame_buf_unref(buf);
+}
+
+bool px_frame_is_writable(const PXFrame* frame) {
+    return frame->buf && frame->buf->refcount == 1 && !frame->buf->read_only;
+}
+
+int px_frame_make_writable(PXFrame* frame, PXFramePool* pool) {
+    if (px_frame_is_writable(frame))
+        return 0;
+
+    PXFrame copy = {0};
+    int ret = 0;
+    if (pool) {
+        ret = px_frame_pool_get(pool, &copy, frame->width, frame->height, frame->pix_fmt, NULL);
+    } else {
+        ret = px_frame_init(&copy, frame->width, frame->height, frame->pix_fmt, NULL);
+        if (ret >= 0)
+            ret = px_frame_alloc_bufs(&copy);
+    }
+    if (ret < 0)
+        return ret;
+    copy.av_pix_fmt = frame->av_pix_fmt;
+
+    px_frame_copy(&copy, frame);
+    px_frame_unref(frame);
+    *frame = copy;
+
+    return 0;
+}
+
+int px_frame_pool_new(PXFramePool** pool) {
+    *pool = calloc(1, sizeof **pool);
+    if (!*pool) {
+        px_oom_msg(sizeof **pool);
+        return PXERROR(ENOMEM);
+    }
+
+    if (px_mutex_init(&(*pool)->lock) != 0) {
+        px_free(pool);
+        return PXERROR(EAGAIN);
+    }
+
+    (*pool)->refcount = 1;
+    return 0;
+}
+
+void px_frame_pool_free(PXFramePool** pool) {
+    if (!pool || !*pool)
+        return;
+
+    px_mutex_lock(&(*pool)->lock);
+    frame_pool_unref_locked(*pool);
+    *pool = NULL;
+}
+
+static int find_bucket(PXFramePool* pool, const PXFrame* frame) {
+    for (int i = 0; i < pool->n_buckets; i++) {
+        const PoolBucket* bucket = &pool->buckets[i];
+        if (bucket->width != frame->width || bucket->height != frame->height ||
+            bucket->pix_fmt != frame->pix_fmt)
+            continue;
+
+        bool strides_match = true;
+        for (int p = 0; p < frame->n_planes; p++) {
+            strides_match &= bucket->strides[p] == frame->planes[p].stride;
+        }
+        if (strides_match)
+            return i;
+    }
+
+    size_t buckets_size = (size_t)(pool->n_buckets + 1) * sizeof *pool->buckets;
+    PoolBucket* buckets = realloc(pool->buckets, buckets_size);
+    if (!buckets) {
+        px_oom_msg(buckets_size);
+        return PXERROR(ENOMEM);
+    }
+    pool->buckets = buckets;
+
+    PoolBucket* bucket = &pool->buckets[pool->n_buckets];
+    *bucket = (PoolBucket) {
+        .width = frame->width,
+        .height = frame->height,
+        .pix_fmt = frame->pix_fmt,
+    };
+    for (int p = 0; p < frame->n_planes; p++) {
+        bucket->strides[p] = frame->planes[p].stride;
+    }
+
+    return pool->n_buckets++;
+}
+
+int px_frame_pool_get(PXFramePool* pool, PXFrame* frame, int width, int height, PXPixelFormat pix_fmt,
+                      const int* strides) {
+    int ret = px_frame_init(frame, width, height, pix_fmt, strides);
+    if (ret < 0)
+        return ret;
+
+    px_mutex_lock(&pool->lock);
+
+    int bucket_idx = find_bucket(pool, frame);
+    if (bucket_idx < 0) {
+        px_mutex_unlock(&pool->lock);
+        return bucket_idx;
+    }
+
+    PoolBucket* bucket = &pool->buckets[bucket_idx];
+    PXFrameBuf* buf = bucket->free_bufs;
+    if (buf) {
+        bucket->free_bufs = buf->next_free;
+        buf->next_free = NULL;
+        buf->refcount = 1;
+    } else {
+        buf = frame_buf_alloc(px_frame_size(frame));
+        if (!buf) {
+            px_mutex_unlock(&pool->lock);
+            return PXERROR(ENOMEM);
+        }
+        buf->pool = pool;
+        buf->bucket_idx = bucket_idx;
+    }
+    pool->refcount++;
+
+    px_mutex_unlock(&pool->lock);
+
+    frame->buf = buf;
+    set_plane_ptrs(frame);
+    return 0;
 }
 
 void px_frame_copy(PXFrame* dest, const PXFrame* src) {
@@ -99,10 +341,19 @@ void px_frame_copy(PXFrame* dest, const PXFrame* src) {
     assert(src->height == dest->height);
 
     for (int i = 0; i < src->n_planes; i++) {
-        assert(src->planes[i].stride == dest->planes[i].stride);
-    }
+        const PXVideoPlane* src_plane = &src->planes[i];
+        PXVideoPlane* dest_plane = &dest->planes[i];
 
-    memcpy(dest->planes[0].data, src->planes[0].data, px_frame_size(src));
+        if (src_plane->stride == dest_plane->stride) {
+            memcpy(dest_plane->data, src_plane->data, px_plane_size(src, i));
+            continue;
+        }
+
+        for (int y = 0; y < src_plane->height; y++) {
+            memcpy(dest_plane->data + y * dest_plane->stride, src_plane->data + y * src_plane->stride,
+                   (size_t)(src_plane->width * src->bytes_per_comp));
+        }
+    }
 }
 
 size_t px_plane_size(const PXFrame* frame, int idx) {
@@ -118,7 +369,60 @@ size_t px_frame_size(const PXFrame* frame) {
     return size;
 }
 
-static enum AVPixelFormat get_planar_equivalent(enum AVPixelFormat pix_fmt) {
+int px_fb_init(PXFrameBuffer* fb, int max_frames) {
+    assert(max_frames > 0);
+
+    *fb = (PXFrameBuffer) {0};
+    fb->frames = calloc((size_t)max_frames, sizeof *fb->frames);
+    if (!fb->frames) {
+        px_oom_msg((size_t)max_frames * sizeof *fb->frames);
+        return PXERROR(ENOMEM);
+    }
+
+    fb->max_frames = max_frames;
+    return 0;
+}
+
+void px_fb_free(PXFrameBuffer* fb) {
+    if (fb->frames)
+        px_fb_clear(fb);
+
+    px_free(&fb->frames);
+    fb->max_frames = 0;
+}
+
+int px_fb_add(PXFrameBuffer* fb, const PXFrame* frame) {
+    if (!fb->frames)
+        return PXERROR(EINVAL);
+
+    if (fb->num_frames == fb->max_frames) {
+        px_frame_unref(&fb->frames[fb->first]);
+        fb->first = (fb->first + 1) % fb->max_frames;
+        fb->num_frames--;
+    }
+
+    px_frame_ref(&fb->frames[(fb->first + fb->num_frames) % fb->max_frames], frame);
+    fb->num_frames++;
+    return 0;
+}
+
+void px_fb_clear(PXFrameBuffer* fb) {
+    for (int i = 0; i < fb->num_frames; i++) {
+        px_frame_unref(&fb->frames[(fb->first + i) % fb->max_frames]);
+    }
+
+    fb->first = 0;
+    fb->num_frames = 0;
+}
+
+const PXFrame* px_fb_get(const PXFrameBuffer* fb, int idx) {
+    if (idx < 0 || idx >= fb->num_frames)
+        return NULL;
+
+    return &fb->frames[(fb->first + idx) % fb->max_frames];
+}
+
+enum AVPixelFormat px_planar_equivalent(enum AVPixelFormat pix_fmt) {
     const AVPixFmtDescriptor* fmt_desc = av_pix_fmt_desc_get(pix_fmt);
     if (!fmt_desc)
         return AV_PIX_FMT_NONE;
@@ -228,8 +532,7 @@ static enum AVPixelFormat get_planar_equivalent(enum AVPixelFormat pix_fmt) {
     }
 }
 
-// only valid for formats returned by get_planar_equivalent()
-static PXPixelFormat px_pix_fmt_from_planar_av(enum AVPixelFormat av_fmt) {
+PXPixelFormat px_pix_fmt_from_planar_av(enum AVPixelFormat av_fmt) {
     const AVPixFmtDescriptor* av_fmt_desc = av_pix_fmt_desc_get(av_fmt);
     if (!av_fmt_desc)
         return PX_PIX_FMT_NONE;
@@ -246,35 +549,115 @@ static PXPixelFormat px_pix_fmt_from_planar_av(enum AVPixelFormat av_fmt) {
                                av_fmt_desc->log2_chroma_w, av_fmt_desc->log2_chroma_h);
 }
 
+enum AVPixelFormat px_planar_av_from_pix_fmt(PXPixelFormat pix_fmt) {
+    const AVPixFmtDescriptor* desc = NULL;
+    while ((desc = av_pix_fmt_desc_next(desc))) {
+        enum AVPixelFormat av_fmt = av_pix_fmt_desc_get_id(desc);
+        if (px_planar_equivalent(av_fmt) != av_fmt || av_pix_fmt_count_planes(av_fmt) != desc->nb_components)
+            continue;
+
+        // e.g. yuv420p comes before yuvj420p, which has the same layout
+        if (px_pix_fmt_from_planar_av(av_fmt) == pix_fmt)
+            return av_fmt;
+    }
+
+    return AV_PIX_FMT_NONE;
+}
+
 static void array_abs(int* dest, const int* arr, size_t len) {
     for (size_t i = 0; i < len; i++) {
         dest[i] = abs(arr[i]);
     }
 }
 
-int px_frame_from_av(PXFrame* dest, const AVFrame* src) {
-    enum AVPixelFormat planar_equiv = get_planar_equivalent(src->format);
-    if (planar_equiv == AV_PIX_FMT_NONE) {
+static void free_av_frame_ref(void* opaque) {
+    AVFrame* frame = opaque;
+    av_frame_free(&frame);
+}
+
+// point `dest`'s planes to the data of `src`, keeping `src`'s buffers alive with a new reference
+static int frame_ref_av(PXFrame* dest, const AVFrame* src) {
+    PXFrameBuf* buf = calloc(1, sizeof *buf);
+    if (!buf) {
+        px_oom_msg(sizeof *buf);
+        return PXERROR(ENOMEM);
+    }
+
+    AVFrame* src_ref = av_frame_clone(src);
+    if (!src_ref) {
+        px_oom_msg(sizeof *src_ref);
+        free(buf);
+        return PXERROR(ENOMEM);
+    }
+
+    // the decoder may still be using the frame as a reference
+    *buf = (PXFrameBuf) {
+        .refcount = 1,
+        .free = free_av_frame_ref,
+        .opaque = src_ref,
+        .read_only = true,
+    };
+
+    dest->buf = buf;
+    for (int i = 0; i < dest->n_planes; i++) {
+        dest->planes[i].data = src_ref->data[i];
+    }
+
+    return 0;
+}
+
+// true if `src` can be used without copying: refcounted and not vertically flipped
+static bool can_ref_av(const AVFrame* src) {
+    if (!src->buf[0])
+        return false;
+
+    for (int i = 0; i < av_pix_fmt_count_planes(src->format); i++) {
+        if (src->linesize[i] <= 0)
+            return false;
+    }
+
+    return true;
+}
+
+int px_frame_from_av(PXFrame* dest, const AVFrame* src, enum AVPixelFormat pix_fmt, PXFramePool* pool,
+                     struct SwsContext** sws) {
+    if (px_planar_equivalent(src->format) == AV_PIX_FMT_NONE) {
         const char* fmt_name = av_get_pix_fmt_name(src->format);
         px_log(PX_LOG_ERROR, "Unsupported pixel format \"%s\"\n", fmt_name ? fmt_name : "(unknown)");
         return PXERROR(EINVAL);
     }
 
+    assert(px_planar_equivalent(pix_fmt) == pix_fmt);
+    PXPixelFormat px_pix_fmt = px_pix_fmt_from_planar_av(pix_fmt);
+
     int src_n_planes = av_pix_fmt_count_planes(src->format);
     int abs_src_linesize[AV_NUM_DATA_POINTERS] = {0};
     array_abs(abs_src_linesize, src->linesize, (size_t)src_n_planes);
 
-    int ret = px_frame_init(dest, src->width, src->height, px_pix_fmt_from_planar_av(planar_equiv),
-                            planar_equiv == src->format ? abs_src_linesize : NULL);
-    if (ret < 0)
-        return ret;
-    dest->av_pix_fmt = planar_equiv;
+    const int* dest_strides = pix_fmt == src->format ? abs_src_linesize : NULL;
+
+    int ret = 0;
+    if (pix_fmt == src->format && can_ref_av(src)) {
+        ret = px_frame_init(dest, src->width, src->height, px_pix_fmt, dest_strides);
+        if (ret < 0)
+            return ret;
+        dest->av_pix_fmt = pix_fmt;
+
+        return frame_ref_av(dest, src);
+    }
 
-    ret = px_frame_alloc_bufs(dest);
+    if (pool) {
+        ret = px_frame_pool_get(pool, dest, src->width, src->height, px_pix_fmt, dest_strides);
+    } else {
+        ret = px_frame_init(dest, src->width, src->height, px_pix_fmt, dest_strides);
+        if (ret >= 0)
+            ret = px_frame_alloc_bufs(dest);
+    }
     if (ret < 0)
         return ret;
+    dest->av_pix_fmt = pix_fmt;
 
-    if (planar_equiv == src->format) {
+    if (pix_fmt == src->format) {
         assert(src_n_planes == dest->n_planes);
         for (int i = 0; i < dest->n_planes; i++) {
             for (int y = 0; y < dest->planes[i].height; y++) {
@@ -285,16 +668,6 @@ int px_frame_from_av(PXFrame* dest, const AVFrame* src) {
         return 0;
     }
 
-    px_log(PX_LOG_INFO, "Converting from %s to %s\n", av_get_pix_fmt_name(src->format),
-           av_get_pix_fmt_name(planar_equiv));
-
-    struct SwsContext* sws = sws_getContext(src->width, src->height, src->format, dest->width, dest->height,
-                                            planar_equiv, SWS_BILINEAR, NULL, NULL, NULL);
-    if (!sws) {
-        LAV_THROW_MSG("sws_getContext", AVERROR(EINVAL));
-        return AVERROR(EINVAL);
-    }
-
     const uint8_t* const* src_data_decayed = (const uint8_t* const*)src->data;
 
     uint8_t* dest_plane_ptrs[PX_FRAME_MAX_PLANES] = {0};
@@ -304,17 +677,67 @@ int px_frame_from_av(PXFrame* dest, const AVFrame* src) {
         strides[i] = dest->planes[i].stride;
     }
 
-    sws_scale(sws, src_data_decayed, src->linesize, 0, src->height, dest_plane_ptrs, strides);
-    sws_freeContext(sws);
+    if (px_can_repack(src->format, pix_fmt)) {
+        px_repack(src_data_decayed, src->linesize, src->format, dest_plane_ptrs, strides, pix_fmt, src->width,
+                  src->height);
+        return 0;
+    }
+
+    if (!*sws) {
+        px_log(PX_LOG_INFO, "Converting from %s to %s\n", av_get_pix_fmt_name(src->format),
+               av_get_pix_fmt_name(pix_fmt));
+    }
+
+    *sws = sws_getCachedContext(*sws, src->width, src->height, src->format, dest->width, dest->height,
+                                pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!*sws) {
+        LAV_THROW_MSG("sws_getCachedContext", AVERROR(EINVAL));
+        px_frame_unref(dest);
+        return AVERROR(EINVAL);
+    }
+
+    sws_scale(*sws, src_data_decayed, src->linesize, 0, src->height, dest_plane_ptrs, strides);
+
+    return 0;
+}
+
+// AVBufferRef free callback of frames from px_frame_to_av(), may run on any thread
+static void release_av_buf(void* opaque, [[maybe_unused]] uint8_t* data) {
+    frame_buf_unref(opaque);
+}
 
+// give `dest` references to the buffers of the decoded frame `src` was made from, see frame_ref_av()
+static int ref_borrowed_av_bufs(AVFrame* dest, const AVFrame* src) {
+    for (size_t i = 0; i < FF_ARRAY_ELEMS(src->buf) && src->buf[i]; i++) {
+        dest->buf[i] = av_buffer_ref(src->buf[i]);
+        if (!dest->buf[i]) {
+            px_oom_msg(sizeof(AVBufferRef));
+            return AVERROR(ENOMEM);
+        }
+    }
     return 0;
 }
 
-void px_frame_to_av(AVFrame* dest, const PXFrame* px_frame) {
+int px_frame_to_av(AVFrame* dest, const PXFrame* px_frame) {
     for (size_t i = 0; i < FF_ARRAY_ELEMS(dest->buf); i++) {
         av_buffer_unref(&dest->buf[i]);
     }
 
+    PXFrameBuf* buf = px_frame->buf;
+    if (buf->free == free_av_frame_ref) {
+        int ret = ref_borrowed_av_bufs(dest, buf->opaque);
+        if (ret < 0)
+            return ret;
+    } else {
+        // pixie only writes to frames it holds the only reference to, so the data can't change under `dest`
+        dest->buf[0] = av_buffer_create(buf->data, buf->size, release_av_buf, buf, AV_BUFFER_FLAG_READONLY);
+        if (!dest->buf[0]) {
+            px_oom_msg(sizeof(AVBufferRef));
+            return AVERROR(ENOMEM);
+        }
+        buf->refcount++;
+    }
+
     dest->width = px_frame->width;
     dest->height = px_frame->height;
     dest->format = px_frame->av_pix_fmt;
@@ -323,4 +746,6 @@ void px_frame_to_av(AVFrame* dest, const PXFrame* px_frame) {
         dest->linesize[i] = px_frame->planes[i].stride;
         dest->data[i] = px_frame->planes[i].data;
     }
+
+    return 0;
 }
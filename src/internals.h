@@ -1,9 +1,24 @@
 #include <pixie/frame.h>
+#include <pixie/filter.h>
 #include <pixie/util/utils.h>
 #include <pixie/log.h>
+#include <pixie/stats.h>
 
 #include <libavutil/frame.h>
 
+#include <stdatomic.h>
+#include <stddef.h>
+
+// architectures with vector kernels, picked at runtime with px_cpu_flags()
+#if defined(__x86_64__) || defined(__i386__)
+#define PX_ARCH_X86
+#elif defined(__aarch64__)
+#define PX_ARCH_AARCH64
+#endif
+
+// row `y` of a plane starting at `data` with `stride` bytes between rows
+#define PX_ROW(data, stride, y) ((data) + (ptrdiff_t)(y) * (stride))
+
 #define LAV_THROW_MSG(func, err)                                                                            \
     px_log(PX_LOG_ERROR, "%s() failed at %s:%d: %s (code %d)\n", func, __FILE__, __LINE__, av_err2str(err), \
            err)
@@ -12,7 +27,108 @@
     px_log(PX_LOG_ERROR, "%s() failed at %s:%d: %s (code %d)\n", func, __FILE__, __LINE__, \
            px_last_os_errstr((char[256]) {0}, err), err)
 
-int px_frame_from_av(PXFrame* dest, const AVFrame* av_frame);
-void px_frame_to_av(AVFrame* dest, const PXFrame* px_frame);
+// alignment of the planes of frames pixie allocates for the encoder, see PXCodingContext::enc_buf_pool
+#define PX_ENC_BUF_ALIGN 64
+
+// alignment of pixie's own frame buffers and their default strides, enough for AVX-512
+// matches PX_ENC_BUF_ALIGN so that filtered frames can be passed to the encoder as they are
+#define PX_FRAME_ALIGN 64
+
+struct SwsContext;
+
+// the planar format frames in `pix_fmt` are converted to for filtering, AV_PIX_FMT_NONE if unsupported
+enum AVPixelFormat px_planar_equivalent(enum AVPixelFormat pix_fmt);
+
+// only valid for formats returned by px_planar_equivalent()
+PXPixelFormat px_pix_fmt_from_planar_av(enum AVPixelFormat av_fmt);
+
+// the planar format px_pix_fmt_from_planar_av() maps to `pix_fmt`, AV_PIX_FMT_NONE if there is none
+enum AVPixelFormat px_planar_av_from_pix_fmt(PXPixelFormat pix_fmt);
+
+/**
+ * import `av_frame` as `pix_fmt`, which has to be a format returned by px_planar_equivalent()
+ * frames already in `pix_fmt` are referenced without copying, in which case `dest` is read-only
+ * otherwise the frame is converted into a buffer from `pool`, or a new one if `pool` is NULL
+ * `sws` is a conversion context cache, (re)initialized if needed and freed by the caller
+ */
+int px_frame_from_av(PXFrame* dest, const AVFrame* av_frame, enum AVPixelFormat pix_fmt, PXFramePool* pool,
+                     struct SwsContext** sws);
+/**
+ * point `dest` at `px_frame`'s plane data without copying it, replacing any buffers `dest` had
+ * `dest` holds a reference to the data, which is only freed or returned to its pool once every reference
+ * to `dest`'s buffers is dropped, so e.g. an encoder can hold on to the frame. the data is read-only
+ * through `dest`
+ */
+int px_frame_to_av(AVFrame* dest, const PXFrame* px_frame);
+
+// check if there's a repack kernel between a packed or semi-planar format and its planar equivalent,
+// which is used instead of swscale since it only shuffles components around
+bool px_can_repack(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt);
+
+// only valid if px_can_repack(`src_fmt`, `dst_fmt`), arguments are the same as sws_scale()'s
+void px_repack(const uint8_t* const src[4], const int src_stride[4], enum AVPixelFormat src_fmt,
+               uint8_t* const dst[4], const int dst_stride[4], enum AVPixelFormat dst_fmt, int width,
+               int height);
+
+// entries past the end of each table, which the vector kernels may read but don't use
+#define PX_LUT_PADDING 2
+
+// lookup table per plane, merged from those of consecutive filters with PXFilter::get_lut()
+typedef struct PXLut {
+    int first_filter; // index in PXFilterContext::filters
+    int n_filters;
+    int n_planes;
+    int bits_per_comp;
+
+    // `1 << bits_per_comp` entries each, plus PX_LUT_PADDING
+    uint16_t* tables[PX_FRAME_MAX_PLANES];
+    // copy of `tables` for 8-bit formats, padded for 4-byte reads at the last entry
+    uint8_t tables_u8[PX_FRAME_MAX_PLANES][256 + 4];
+} PXLut;
+
+// integer formats of 8 to 16 bits
+bool px_lut_supports_pix_fmt(PXPixelFormat pix_fmt);
+
+/**
+ * merge the tables of `n_filters` filters from `filters[first]` on, which are all configured with the same
+ * PXFilter::in_props, in a format px_lut_supports_pix_fmt(). `lut` is freed with px_lut_free()
+ */
+int px_lut_build(PXLut* lut, PXFilter* const* filters, int first, int n_filters);
+void px_lut_free(PXLut* lut);
+
+// map rows [y_start, y_end) of `src` through the table of `plane` into `dst`, which may be `src`
+void px_lut_apply(const PXLut* lut, int plane, const PXVideoPlane* src, PXVideoPlane* dst, int y_start,
+                  int y_end);
+
+// the merged table filter `filter_idx` is applied through, NULL if it isn't, see px_filter_ctx_config()
+const PXLut* px_filter_ctx_find_lut(const PXFilterContext* ctx, int filter_idx);
+
+// running totals behind a PXStageTime
+typedef struct PXStageStats {
+    atomic_uint_fast64_t calls;
+    atomic_int_fast64_t wall_ns;
+    atomic_int_fast64_t cpu_ns;
+} PXStageStats;
+
+// when a stage started running on the current thread, see px_stats_add()
+typedef struct PXStatsTimer {
+    int64_t wall_ns;
+    int64_t cpu_ns;
+} PXStatsTimer;
+
+PXStatsTimer px_stats_timer_start(void);
+
+// NULL if `stats` is NULL, which every px_stats_add*() function ignores
+PXStageStats* px_stats_stage(PXStats* stats, PXStage stage);
+PXStageStats* px_stats_filter(PXStats* stats, int filter_idx);
+
+// add the wall and CPU time since `start` to `entry`, counting `calls` calls
+void px_stats_add(PXStageStats* entry, PXStatsTimer start, int calls);
+
+// for stages that run on several threads at once, the thread waiting for them adds the wall time
+// and each thread adds its own CPU time, so that none of it is counted twice
+void px_stats_add_wall(PXStageStats* entry, PXStatsTimer start, int calls);
+void px_stats_add_cpu(PXStageStats* entry, PXStatsTimer start);
 
-void px_frame_free_internal(PXFrame* frame);
+// `len` is the queue's length right after the push
+void px_stats_queue_pushed(PXStats* stats, PXQueueKind queue, int len, int capacity);
@@ -3,6 +3,7 @@
 #include <libavutil/log.h>
 
 PXLogLevel px_global_log_level = PX_LOG_WARN; // default
+static FILE* info_stream = NULL; // NULL = stdout
 
 const char* const px_log_names[PX_LOG_COUNT] = {
     "quiet", "error", "progress", "warn", "info", "verbose",
@@ -49,6 +50,10 @@ void px_log_set_level(PXLogLevel level) {
     px_global_log_level = level;
 }
 
+void px_log_set_info_stream(FILE* stream) {
+    info_stream = stream;
+}
+
 int px_log_num_levels(void) {
     return PX_LOG_COUNT;
 }
@@ -60,7 +65,9 @@ void px_log(PXLogLevel level, const char* msg, ...) {
     va_list args;
     va_start(args, msg);
 
-    FILE* stream = level == PX_LOG_INFO ? stdout : stderr;
+    FILE* stream = stderr;
+    if (level == PX_LOG_INFO)
+        stream = info_stream ? info_stream : stdout;
 
     char prefix[64];
 
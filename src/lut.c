@@ -0,0 +1,237 @@
+#include "internals.h"
+
+#include <pixie/simd.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef PX_ARCH_X86
+#include <immintrin.h>
+#elif defined(PX_ARCH_AARCH64)
+#include <arm_neon.h>
+#endif
+
+// row kernels, 16-bit values are masked to the table's size first
+typedef struct LutKernels {
+    void (*lut_u8)(const uint8_t* src, uint8_t* dst, const uint8_t* table, int n);
+    void (*lut_u16)(const uint16_t* src, uint16_t* dst, const uint16_t* table, int n, int mask);
+} LutKernels;
+
+static void lut_u8_c(const uint8_t* src, uint8_t* dst, const uint8_t* table, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = table[src[i]];
+    }
+}
+
+static void lut_u16_c(const uint16_t* src, uint16_t* dst, const uint16_t* table, int n, int mask) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = table[src[i] & mask];
+    }
+}
+
+static const LutKernels kernels_c = {
+    .lut_u8 = lut_u8_c,
+    .lut_u16 = lut_u16_c,
+};
+
+#ifdef PX_ARCH_X86
+
+// each lookup gathers a whole dword and masks off everything above the entry, see PX_LUT_PADDING
+
+[[gnu::target("avx2")]] static void lut_u8_avx2(const uint8_t* src, uint8_t* dst, const uint8_t* table,
+                                                  int n) {
+    const __m256i lo_mask = _mm256_set1_epi32(0xff);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i idx = _mm_loadu_si128((const __m128i*)(src + i));
+        __m256i lo = _mm256_cvtepu8_epi32(idx);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(idx, 8));
+        lo = _mm256_and_si256(_mm256_i32gather_epi32((const int*)table, lo, 1), lo_mask);
+        hi = _mm256_and_si256(_mm256_i32gather_epi32((const int*)table, hi, 1), lo_mask);
+
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+        __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1));
+        _mm_storeu_si128((__m128i*)(dst + i), bytes);
+    }
+
+    lut_u8_c(src + i, dst + i, table, n - i);
+}
+
+[[gnu::target("avx2")]] static void lut_u16_avx2(const uint16_t* src, uint16_t* dst, const uint16_t* table,
+                                                   int n, int mask) {
+    const __m256i idx_mask = _mm256_set1_epi32(mask);
+    const __m256i lo_mask = _mm256_set1_epi32(0xffff);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i idx = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(idx)), idx_mask);
+        __m256i hi = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(idx, 1)), idx_mask);
+        lo = _mm256_and_si256(_mm256_i32gather_epi32((const int*)table, lo, 2), lo_mask);
+        hi = _mm256_and_si256(_mm256_i32gather_epi32((const int*)table, hi, 2), lo_mask);
+
+        __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+        _mm256_storeu_si256((__m256i*)(dst + i), words);
+    }
+
+    lut_u16_c(src + i, dst + i, table, n - i, mask);
+}
+
+static const LutKernels kernels_avx2 = {
+    .lut_u8 = lut_u8_avx2,
+    .lut_u16 = lut_u16_avx2,
+};
+
+#endif // PX_ARCH_X86
+
+#ifdef PX_ARCH_AARCH64
+
+// the table is looked up 64 entries at a time, out of range indices leave the previous result as is
+static void lut_u8_neon(const uint8_t* src, uint8_t* dst, const uint8_t* table, int n) {
+    const uint8x16x4_t t0 = vld1q_u8_x4(table);
+    const uint8x16x4_t t1 = vld1q_u8_x4(table + 64);
+    const uint8x16x4_t t2 = vld1q_u8_x4(table + 128);
+    const uint8x16x4_t t3 = vld1q_u8_x4(table + 192);
+    const uint8x16_t step = vdupq_n_u8(64);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t idx = vld1q_u8(src + i);
+        uint8x16_t res = vqtbl4q_u8(t0, idx);
+        idx = vsubq_u8(idx, step);
+        res = vqtbx4q_u8(res, t1, idx);
+        idx = vsubq_u8(idx, step);
+        res = vqtbx4q_u8(res, t2, idx);
+        idx = vsubq_u8(idx, step);
+        res = vqtbx4q_u8(res, t3, idx);
+        vst1q_u8(dst + i, res);
+    }
+
+    lut_u8_c(src + i, dst + i, table, n - i);
+}
+
+// NEON has no gather, so 16-bit tables are looked up one value at a time
+static const LutKernels kernels_neon = {
+    .lut_u8 = lut_u8_neon,
+    .lut_u16 = lut_u16_c,
+};
+
+#endif // PX_ARCH_AARCH64
+
+static const LutKernels* get_kernels(void) {
+    [[maybe_unused]] int cpu_flags = px_cpu_flags();
+
+#ifdef PX_ARCH_X86
+    if (cpu_flags & PX_CPU_AVX2)
+        return &kernels_avx2;
+#elif defined(PX_ARCH_AARCH64)
+    if (cpu_flags & PX_CPU_NEON)
+        return &kernels_neon;
+#endif
+
+    return &kernels_c;
+}
+
+bool px_lut_supports_pix_fmt(PXPixelFormat pix_fmt) {
+    PXPixFmtDescriptor desc = px_pix_fmt_get_desc(pix_fmt);
+    return pix_fmt != PX_PIX_FMT_NONE && desc.comp_type == PX_COMP_TYPE_INT && desc.bits_per_comp >= 8 &&
+           desc.bits_per_comp <= 16;
+}
+
+int px_lut_build(PXLut* lut, PXFilter* const* filters, int first, int n_filters) {
+    const PXFilter* first_fltr = filters[first];
+    PXPixFmtDescriptor desc = px_pix_fmt_get_desc(first_fltr->in_props.pix_fmt);
+    assert(px_lut_supports_pix_fmt(first_fltr->in_props.pix_fmt));
+
+    *lut = (PXLut) {
+        .first_filter = first,
+        .n_filters = n_filters,
+        .n_planes = desc.n_planes,
+        .bits_per_comp = desc.bits_per_comp,
+    };
+
+    int n_entries = 1 << desc.bits_per_comp;
+    size_t table_size = (size_t)(n_entries + PX_LUT_PADDING) * sizeof(uint16_t);
+
+    int ret = 0;
+    uint16_t* step = malloc((size_t)n_entries * sizeof *step);
+    if (!step) {
+        px_oom_msg((size_t)n_entries * sizeof *step);
+        return PXERROR(ENOMEM);
+    }
+
+    for (int p = 0; p < lut->n_planes; p++) {
+        lut->tables[p] = calloc(1, table_size);
+        if (!lut->tables[p]) {
+            px_oom_msg(table_size);
+            ret = PXERROR(ENOMEM);
+            goto fail;
+        }
+
+        for (int v = 0; v < n_entries; v++) {
+            lut->tables[p][v] = (uint16_t)v;
+        }
+
+        // compose each filter's table on top of the ones before it
+        for (int i = first; i < first + n_filters; i++) {
+            PXFilter* fltr = filters[i];
+            ret = fltr->get_lut(fltr, p, step, n_entries);
+            if (ret < 0) {
+                px_log(PX_LOG_ERROR, "Failed to get the lookup table of filter \"%s\"\n", fltr->name);
+                goto fail;
+            }
+
+            for (int v = 0; v < n_entries; v++) {
+                if (step[v] >= n_entries) {
+                    px_log(PX_LOG_ERROR, "Filter \"%s\" put %d in a lookup table for %d-bit values\n",
+                           fltr->name, step[v], lut->bits_per_comp);
+                    ret = PXERROR(EINVAL);
+                    goto fail;
+                }
+            }
+
+            for (int v = 0; v < n_entries; v++) {
+                lut->tables[p][v] = step[lut->tables[p][v]];
+            }
+        }
+
+        if (lut->bits_per_comp == 8) {
+            for (int v = 0; v < n_entries; v++) {
+                lut->tables_u8[p][v] = (uint8_t)lut->tables[p][v];
+            }
+        }
+    }
+
+    px_free(&step);
+    return 0;
+
+fail:
+    px_free(&step);
+    px_lut_free(lut);
+    return ret;
+}
+
+void px_lut_free(PXLut* lut) {
+    for (int p = 0; p < PX_FRAME_MAX_PLANES; p++) {
+        px_free(&lut->tables[p]);
+    }
+}
+
+void px_lut_apply(const PXLut* lut, int plane, const PXVideoPlane* src, PXVideoPlane* dst, int y_start,
+                  int y_end) {
+    const LutKernels* kernels = get_kernels();
+    int mask = (1 << lut->bits_per_comp) - 1;
+
+    for (int y = y_start; y < y_end; y++) {
+        const uint8_t* src_row = PX_ROW(src->data, src->stride, y);
+        uint8_t* dst_row = PX_ROW(dst->data, dst->stride, y);
+
+        if (lut->bits_per_comp == 8)
+            kernels->lut_u8(src_row, dst_row, lut->tables_u8[plane], src->width);
+        else
+            kernels->lut_u16((const uint16_t*)src_row, (uint16_t*)dst_row, lut->tables[plane], src->width,
+                             mask);
+    }
+}
@@ -1,9 +1,12 @@
 #include "internals.h"
 
 #include <pixie/pixie.h>
+#include <pixie/util/queue.h>
 #include <pixie/util/utils.h>
 
 #include <libswscale/swscale.h>
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
 #include <libavutil/pixdesc.h>
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
@@ -15,14 +18,37 @@ PXContext* px_ctx_alloc(void) {
     return pxc;
 }
 
-static int conv_pix_fmt(AVFrame* dest, const AVFrame* src, enum AVPixelFormat dest_pix_fmt) {
-    struct SwsContext* sws = sws_getContext(src->width, src->height, src->format, src->width, src->height,
-                                            dest_pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
-    if (!sws) {
-        LAV_THROW_MSG("sws_getContext", AVERROR(EINVAL));
-        return AVERROR(EINVAL);
+// like av_frame_get_buffer(), but takes the buffer from `pool` if it's not NULL
+// `pool`'s buffers have to fit the frame's format and size, with planes aligned to PX_ENC_BUF_ALIGN
+static int get_frame_buffer(AVFrame* frame, AVBufferPool* pool) {
+    if (!pool) {
+        int ret = av_frame_get_buffer(frame, 0);
+        if (ret < 0)
+            LAV_THROW_MSG("av_frame_get_buffer", ret);
+        return ret;
+    }
+
+    frame->buf[0] = av_buffer_pool_get(pool);
+    if (!frame->buf[0]) {
+        px_oom_msg(sizeof(AVBufferRef));
+        return AVERROR(ENOMEM);
+    }
+
+    int ret = av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, frame->format,
+                                   frame->width, frame->height, PX_ENC_BUF_ALIGN);
+    if (ret < 0) {
+        LAV_THROW_MSG("av_image_fill_arrays", ret);
+        av_buffer_unref(&frame->buf[0]);
+        return ret;
     }
 
+    return 0;
+}
+
+// `dest` gets a buffer from `buf_pool`, see get_frame_buffer()
+// `sws` is a conversion context cache, (re)initialized if needed
+static int conv_pix_fmt(AVFrame* dest, const AVFrame* src, enum AVPixelFormat dest_pix_fmt,
+                        AVBufferPool* buf_pool, struct SwsContext** sws) {
     int ret = av_frame_copy_props(dest, src);
     if (ret < 0) {
         LAV_THROW_MSG("av_frame_copy_props", ret);
@@ -32,18 +58,73 @@ static int conv_pix_fmt(AVFrame* dest, const AVFrame* src, enum AVPixelFormat de
     dest->width = src->width;
     dest->height = src->height;
 
-    ret = sws_scale_frame(sws, dest, src);
+    ret = get_frame_buffer(dest, buf_pool);
+    if (ret < 0)
+        return ret;
+
+    if (dest_pix_fmt == src->format) {
+        av_image_copy(dest->data, dest->linesize, (const uint8_t**)src->data, src->linesize, dest_pix_fmt,
+                      src->width, src->height);
+        return 0;
+    }
+
+    if (px_can_repack(src->format, dest_pix_fmt)) {
+        px_repack((const uint8_t* const*)src->data, src->linesize, src->format, dest->data, dest->linesize,
+                  dest_pix_fmt, src->width, src->height);
+        return 0;
+    }
+
+    *sws = sws_getCachedContext(*sws, src->width, src->height, src->format, src->width, src->height,
+                                dest_pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!*sws) {
+        LAV_THROW_MSG("sws_getCachedContext", AVERROR(EINVAL));
+        return AVERROR(EINVAL);
+    }
+
+    ret = sws_scale_frame(*sws, dest, src);
     if (ret < 0) {
         LAV_THROW_MSG("sws_scale_frame", ret);
         return ret;
     }
-    sws_freeContext(sws);
 
     return 0;
 }
 
+static int write_packet(PXMediaContext* ctx, AVPacket* pkt) {
+    px_mutex_lock(&ctx->mux_lock);
+    PXStatsTimer timer = px_stats_timer_start();
+    int ret = av_interleaved_write_frame(ctx->ofmt_ctx, pkt);
+    px_stats_add(px_stats_stage(ctx->stats, PX_STAGE_MUX), timer, 1);
+    px_mutex_unlock(&ctx->mux_lock);
+
+    if (ret < 0)
+        LAV_THROW_MSG("av_interleaved_write_frame", ret);
+    return ret;
+}
+
+/**
+ * whether all of the segment's packets have been read
+ * packets after the next segment's first keyframe that are shown before it (leading pictures of an open GOP)
+ * still belong to this segment, and need that keyframe to be decoded. so reading only stops at the first
+ * packet after it that is shown after it too
+ */
+static bool segment_done(PXMediaContext* ctx, const AVPacket* pkt) {
+    int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (pts == AV_NOPTS_VALUE || pts < ctx->segment.end)
+        return false;
+
+    if (!ctx->seg_end_reached && pkt->flags & AV_PKT_FLAG_KEY) {
+        ctx->seg_end_reached = true;
+        return false;
+    }
+
+    return ctx->seg_end_reached;
+}
+
 static int read_frame(PXMediaContext* ctx, AVPacket* pkt) {
+    PXStatsTimer timer = px_stats_timer_start();
     int ret = av_read_frame(ctx->ifmt_ctx, pkt);
+    px_stats_add(px_stats_stage(ctx->stats, PX_STAGE_DEMUX), timer, 1);
     if (ret == AVERROR_EOF) {
         goto early_ret;
     } else if (ret < 0) {
@@ -51,19 +132,23 @@ static int read_frame(PXMediaContext* ctx, AVPacket* pkt) {
         goto early_ret;
     }
 
+    if (ctx->segmented && segment_done(ctx, pkt)) {
+        ret = AVERROR_EOF;
+        goto early_ret;
+    }
+
     ctx->stream_idx = pkt->stream_index;
 
-    enum AVMediaType stream_type = ctx->ifmt_ctx->streams[ctx->stream_idx]->codecpar->codec_type;
+    enum AVMediaType stream_type = ctx->ifmt_ctx->streams[pkt->stream_index]->codecpar->codec_type;
     if (stream_type != AVMEDIA_TYPE_VIDEO) {
-        AVRational in_tb = ctx->ifmt_ctx->streams[ctx->stream_idx]->time_base;
-        AVRational out_tb = ctx->ofmt_ctx->streams[ctx->stream_idx]->time_base;
+        AVRational in_tb = ctx->ifmt_ctx->streams[pkt->stream_index]->time_base;
+        AVRational out_tb = ctx->ofmt_ctx->streams[pkt->stream_index]->time_base;
         av_packet_rescale_ts(pkt, in_tb, out_tb);
 
-        ret = av_interleaved_write_frame(ctx->ofmt_ctx, pkt);
-        if (ret < 0) {
-            LAV_THROW_MSG("av_interleaved_write_frame", ret);
+        ret = write_packet(ctx, pkt);
+        if (ret < 0)
             goto early_ret;
-        }
+
         ret = AVERROR(EAGAIN);
         goto early_ret;
     }
@@ -75,17 +160,23 @@ early_ret:
     return ret;
 }
 
-static int encode_frame(PXMediaContext* ctx, const AVFrame* frame) {
-    AVCodecContext* enc_ctx = ctx->coding_ctx_arr[ctx->stream_idx].enc_ctx;
+static int encode_frame(PXMediaContext* ctx, int stream_idx, const AVFrame* frame) {
+    AVCodecContext* enc_ctx = ctx->coding_ctx_arr[stream_idx].enc_ctx;
+    PXStageStats* timing = px_stats_stage(ctx->stats, PX_STAGE_ENCODE);
+
+    PXStatsTimer timer = px_stats_timer_start();
     int ret = avcodec_send_frame(enc_ctx, frame);
+    px_stats_add(timing, timer, 1);
     if (ret < 0) {
         LAV_THROW_MSG("avcodec_send_frame", ret);
         return ret;
     }
 
-    AVPacket* pkt = av_packet_alloc();
+    AVPacket* pkt = ctx->coding_ctx_arr[stream_idx].enc_pkt;
     while (ret >= 0) {
+        timer = px_stats_timer_start();
         ret = avcodec_receive_packet(enc_ctx, pkt);
+        px_stats_add(timing, timer, 0);
         if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
             ret = 0;
             goto end;
@@ -94,173 +185,1596 @@ static int encode_frame(PXMediaContext* ctx, const AVFrame* frame) {
             goto end;
         }
 
-        pkt->stream_index = ctx->stream_idx;
+        pkt->stream_index = stream_idx;
 
-        const AVStream* istream = ctx->ifmt_ctx->streams[ctx->stream_idx];
-        const AVStream* ostream = ctx->ofmt_ctx->streams[ctx->stream_idx];
-        pkt->duration = ostream->time_base.den / ostream->time_base.num / istream->avg_frame_rate.num *
-                        istream->avg_frame_rate.den;
+        const AVStream* istream = ctx->ifmt_ctx->streams[stream_idx];
+        const AVStream* ostream = ctx->ofmt_ctx->streams[stream_idx];
+        // filters may change the frame rate, which the encoder is opened with
+        pkt->duration = ostream->time_base.den / ostream->time_base.num / enc_ctx->framerate.num *
+                        enc_ctx->framerate.den;
 
         av_packet_rescale_ts(pkt, istream->time_base, ostream->time_base);
 
-        ret = av_interleaved_write_frame(ctx->ofmt_ctx, pkt);
-        if (ret < 0) {
-            LAV_THROW_MSG("av_interleaved_write_frame", ret);
-            goto end;
+        // packets come out in decoding order, which isn't the order they're shown in
+        int64_t out_time_us = ctx->out_time_us;
+        if (pkt->pts != AV_NOPTS_VALUE) {
+            int64_t end_us = av_rescale_q(pkt->pts + pkt->duration, ostream->time_base, AV_TIME_BASE_Q);
+            out_time_us = FFMAX(out_time_us, end_us - ctx->start_us);
         }
 
+        ret = write_packet(ctx, pkt);
+        if (ret < 0)
+            goto end;
+
+        ctx->out_time_us = out_time_us;
         ctx->frames_output++;
         av_packet_unref(pkt);
     }
 
 end:
-    av_packet_free(&pkt);
+    av_packet_unref(pkt);
+    return ret;
+}
+
+/**
+ * AVFrames and AVPackets passed between stages are put in a queue of spares once they're done with,
+ * so that each one is allocated once instead of for every frame or packet
+ * the queue never blocks, objects are allocated if it's empty and freed if it's full
+ */
+static AVFrame* get_spare_frame(PXQueue* spares) {
+    AVFrame* frame = NULL;
+    if (px_queue_try_pop(spares, &frame) == 0)
+        return frame;
+
+    frame = av_frame_alloc();
+    if (!frame)
+        px_oom_msg(sizeof(AVFrame));
+    return frame;
+}
+
+static void put_spare_frame(PXQueue* spares, AVFrame** frame) {
+    if (!*frame)
+        return;
+
+    av_frame_unref(*frame);
+    if (px_queue_try_push(spares, frame) == 0)
+        *frame = NULL;
+    else
+        av_frame_free(frame);
+}
+
+static AVPacket* get_spare_packet(PXQueue* spares) {
+    AVPacket* pkt = NULL;
+    if (px_queue_try_pop(spares, &pkt) == 0)
+        return pkt;
+
+    pkt = av_packet_alloc();
+    if (!pkt)
+        px_oom_msg(sizeof(AVPacket));
+    return pkt;
+}
+
+static void put_spare_packet(PXQueue* spares, AVPacket** pkt) {
+    if (!*pkt)
+        return;
+
+    av_packet_unref(*pkt);
+    if (px_queue_try_push(spares, pkt) == 0)
+        *pkt = NULL;
+    else
+        av_packet_free(pkt);
+}
+
+static void free_spare_frames(PXQueue* spares) {
+    AVFrame* frame;
+    while (spares->elems && px_queue_try_pop(spares, &frame) == 0) {
+        av_frame_free(&frame);
+    }
+    px_queue_free(spares);
+}
+
+static void free_spare_packets(PXQueue* spares) {
+    AVPacket* pkt;
+    while (spares->elems && px_queue_try_pop(spares, &pkt) == 0) {
+        av_packet_free(&pkt);
+    }
+    px_queue_free(spares);
+}
+
+// element of the frame queues between the decode, filter and encode stages
+typedef struct FrameMsg {
+    AVFrame* frame; // NULL marks the end of all streams
+    int stream_idx;
+    uint64_t frame_num;
+} FrameMsg;
+
+// state of a frame going through the filter chain
+typedef struct FilterTask {
+    FrameMsg msg;
+    PXFrame frame; // output of the last filter applied, starting with `msg.frame` imported as a PXFrame
+
+    // set by apply_filter() if the filter output no frames or several, until the outputs are collected
+    bool dropped;
+    PXFrame* extra_frames; // outputs after `frame`
+    int n_extra_frames;
+} FilterTask;
+
+typedef struct TaskList {
+    FilterTask* tasks;
+    int count;
+    int capacity;
+} TaskList;
+
+static int task_list_push(TaskList* list, const FilterTask* task) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 8;
+        FilterTask* tasks = realloc(list->tasks, (size_t)capacity * sizeof *tasks);
+        if (!tasks) {
+            px_oom_msg((size_t)capacity * sizeof *tasks);
+            return PXERROR(ENOMEM);
+        }
+
+        list->tasks = tasks;
+        list->capacity = capacity;
+    }
+
+    list->tasks[list->count++] = *task;
     return 0;
 }
 
-static int filter_encode_frame(PXContext* pxc, AVFrame* frame) {
-    PXFrame px_frame = {0};
-    int ret = px_frame_from_av(&px_frame, frame);
+static void filter_task_free(FilterTask* task) {
+    av_frame_free(&task->msg.frame);
+    px_frame_unref(&task->frame);
+
+    for (int i = 0; i < task->n_extra_frames; i++) {
+        px_frame_unref(&task->extra_frames[i]);
+    }
+    px_free(&task->extra_frames);
+    task->n_extra_frames = 0;
+}
+
+static void task_list_clear(TaskList* list) {
+    for (int i = 0; i < list->count; i++) {
+        filter_task_free(&list->tasks[i]);
+    }
+    list->count = 0;
+}
+
+// frames seen by a filter with PXFilter::past_frames or future_frames, one per filter and video stream
+typedef struct FilterWindow {
+    PXFrameBuffer frames;
+
+    // ring of the frames in `frames` that haven't been filtered yet, oldest first
+    FrameMsg* pending;
+    int max_pending; // PXFilter::future_frames + 1
+    int first_pending;
+    int n_pending;
+} FilterWindow;
+
+typedef struct FilterChain {
+    PXContext* pxc;
+
+    TaskList tasks;   // frames currently going through the chain
+    TaskList scratch; // output of a temporal filter, swapped with `tasks` afterwards
+
+    // [stream_idx * n_filters + filter_idx], NULL if no filter is temporal
+    FilterWindow* windows;
+    int n_windows;
+
+    // AVFrame*: spare frames for the chain's input, which encoded frames are returned to
+    PXQueue spare_frames;
+} FilterChain;
+
+static void filter_chain_free(FilterChain* chain) {
+    task_list_clear(&chain->tasks);
+    task_list_clear(&chain->scratch);
+    px_free(&chain->tasks.tasks);
+    px_free(&chain->scratch.tasks);
+
+    for (int i = 0; i < chain->n_windows; i++) {
+        FilterWindow* win = &chain->windows[i];
+        px_fb_free(&win->frames);
+
+        for (int j = 0; j < win->n_pending; j++) {
+            av_frame_free(&win->pending[(win->first_pending + j) % win->max_pending].frame);
+        }
+        px_free(&win->pending);
+    }
+    px_free(&chain->windows);
+    chain->n_windows = 0;
+
+    free_spare_frames(&chain->spare_frames);
+}
+
+static int filter_chain_init(FilterChain* chain, PXContext* pxc) {
+    *chain = (FilterChain) {.pxc = pxc};
+
+    // enough for the frames queued between each stage and the ones being filtered at once
+    int n_spares = 2 * pxc->queue_depth + 2 * px_thrd_pool_num_threads(pxc->thrd_pool) + 2;
+    int ret = px_queue_init(&chain->spare_frames, sizeof(AVFrame*), n_spares);
     if (ret < 0)
         return ret;
-    const PXFrame* last_out_frame = &px_frame;
 
-    for (int i = 0; i < pxc->fltr_ctx->n_filters; i++) {
-        PXFilter* fltr = pxc->fltr_ctx->filters[i];
+    const PXFilterContext* fltr_ctx = pxc->fltr_ctx;
+    bool has_temporal = false;
+    for (int i = 0; i < fltr_ctx->n_filters; i++) {
+        has_temporal |= px_filter_is_temporal(fltr_ctx->filters[i]);
+    }
+    if (!has_temporal)
+        return 0;
 
-        fltr->in_frame = last_out_frame;
-        px_frame_new(&fltr->out_frame, fltr->in_frame->width, fltr->in_frame->height, fltr->in_frame->pix_fmt,
-                     NULL);
-        fltr->out_frame->av_pix_fmt = fltr->in_frame->av_pix_fmt;
-        fltr->frame_num = pxc->media_ctx->frames_decoded;
+    const AVFormatContext* ifmt_ctx = pxc->media_ctx->ifmt_ctx;
+    int n_windows = (int)ifmt_ctx->nb_streams * fltr_ctx->n_filters;
+    chain->windows = calloc((size_t)n_windows, sizeof *chain->windows);
+    if (!chain->windows) {
+        px_oom_msg((size_t)n_windows * sizeof *chain->windows);
+        ret = PXERROR(ENOMEM);
+        goto fail;
+    }
+    chain->n_windows = n_windows;
 
-        ret = fltr->apply(fltr); // TODO: optional apply
-        if (ret < 0) {
-            px_log(PX_LOG_ERROR, "Failed to apply filter \"%s\"\n", fltr->name);
-            goto end;
+    for (int i = 0; i < n_windows; i++) {
+        const PXFilter* fltr = fltr_ctx->filters[i % fltr_ctx->n_filters];
+        const AVStream* stream = ifmt_ctx->streams[i / fltr_ctx->n_filters];
+        if (!px_filter_is_temporal(fltr) || stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+
+        FilterWindow* win = &chain->windows[i];
+        ret = px_fb_init(&win->frames, fltr->past_frames + 1 + fltr->future_frames);
+        if (ret < 0)
+            goto fail;
+
+        win->max_pending = fltr->future_frames + 1;
+        win->pending = calloc((size_t)win->max_pending, sizeof *win->pending);
+        if (!win->pending) {
+            px_oom_msg((size_t)win->max_pending * sizeof *win->pending);
+            ret = PXERROR(ENOMEM);
+            goto fail;
         }
-        last_out_frame = fltr->out_frame;
     }
-    px_frame_to_av(frame, last_out_frame);
 
-    enum AVPixelFormat enc_pix_fmt =
-        pxc->media_ctx->coding_ctx_arr[pxc->media_ctx->stream_idx].enc_ctx->pix_fmt;
-    bool conv_needed = frame->format != enc_pix_fmt;
+    return 0;
 
-    AVFrame* conv_frame = frame;
-    if (conv_needed) {
-        conv_frame = av_frame_alloc();
-        if (!conv_frame) {
-            px_oom_msg(sizeof *conv_frame);
-            ret = AVERROR(ENOMEM);
-            goto end;
-        }
+fail:
+    filter_chain_free(chain);
+    return ret;
+}
+
+typedef struct FilterBatch {
+    PXContext* pxc;
+    FilterTask* tasks;
+    PXFilter* fltr; // filter currently being applied
+    PXStageStats* fltr_timing;
+} FilterBatch;
+
+static int import_frame(void* ctx, int task_idx, int thread_idx) {
+    FilterBatch* batch = ctx;
+    FilterTask* task = &batch->tasks[task_idx];
+    PXMediaContext* media_ctx = batch->pxc->media_ctx;
+    PXCodingContext* coding_ctx = &media_ctx->coding_ctx_arr[task->msg.stream_idx];
+
+    PXStatsTimer timer = px_stats_timer_start();
+    int ret = px_frame_from_av(&task->frame, task->msg.frame, coding_ctx->filter_pix_fmt,
+                               batch->pxc->fltr_ctx->frame_pool, &coding_ctx->sws_import[thread_idx]);
+    px_stats_add(px_stats_stage(media_ctx->stats, PX_STAGE_IMPORT), timer, 1);
+
+    return ret;
+}
+
+typedef struct SliceJobs {
+    PXFilter* fltr;
+    PXStageStats* timing; // CPU time of each slice is added to this
+    int n_slices;         // per plane
+} SliceJobs;
+
+static int apply_slice_job(void* ctx, int job_idx, [[maybe_unused]] int thread_idx) {
+    SliceJobs* jobs = ctx;
+
+    int plane = job_idx / jobs->n_slices;
+    int slice = job_idx % jobs->n_slices;
+    int height = jobs->fltr->out_frame->planes[plane].height;
+
+    int y_start = (int)((int64_t)height * slice / jobs->n_slices);
+    int y_end = (int)((int64_t)height * (slice + 1) / jobs->n_slices);
+    if (y_start == y_end)
+        return 0;
+
+    PXStatsTimer timer = px_stats_timer_start();
+    int ret = jobs->fltr->apply_slice(jobs->fltr, plane, y_start, y_end);
+    px_stats_add_cpu(jobs->timing, timer);
+
+    return ret;
+}
+
+// get `n_frames` frames to apply the filter into, sized as configured or like `in_frame`
+static int alloc_out_frames(const PXFilter* fltr, const PXFrame* in_frame, PXFrame* out_frames,
+                            int n_frames) {
+    bool configured = fltr->config_output;
+    int width = configured ? fltr->out_props.width : in_frame->width;
+    int height = configured ? fltr->out_props.height : in_frame->height;
+    PXPixelFormat pix_fmt = configured ? fltr->out_props.pix_fmt : in_frame->pix_fmt;
 
-        px_log(PX_LOG_INFO, "Converting frame from %s to %s\n", av_get_pix_fmt_name(frame->format),
-               av_get_pix_fmt_name(enc_pix_fmt));
-        ret = conv_pix_fmt(conv_frame, frame, enc_pix_fmt);
+    for (int i = 0; i < n_frames; i++) {
+        int ret = px_frame_pool_get(fltr->frame_pool, &out_frames[i], width, height, pix_fmt, NULL);
         if (ret < 0) {
-            av_frame_free(&conv_frame);
-            goto end;
+            for (int j = 0; j < i; j++) {
+                px_frame_unref(&out_frames[j]);
+            }
+            return ret;
         }
+
+        // set from PXCodingContext::filter_out_pix_fmt on export if the format changed
+        out_frames[i].av_pix_fmt = pix_fmt == in_frame->pix_fmt ? in_frame->av_pix_fmt : AV_PIX_FMT_NONE;
     }
 
-    ret = encode_frame(pxc->media_ctx, conv_frame);
-    if (ret == AVERROR_EOF)
-        ret = 0;
+    return 0;
+}
 
-    if (conv_needed)
-        av_frame_free(&conv_frame);
+// slice-threaded over `pool` if the filter supports it and `pool` is not NULL, timed into `timing`
+// the task is marked as dropped or given extra frames if the filter output no frames or several
+static int apply_filter(PXFilter* fltr, FilterTask* task, PXThreadPool* pool, PXStageStats* timing) {
+    const PXFrame* in_frame = &task->frame;
+    const PXFrameProps* out_props = &fltr->out_props;
+    bool same_props = !fltr->config_output ||
+                      (out_props->width == in_frame->width && out_props->height == in_frame->height &&
+                       out_props->pix_fmt == in_frame->pix_fmt);
 
-end:
-    px_frame_free_internal(&px_frame);
-    return ret;
-}
+    // the window keeps referencing the input frame, so temporal filters always get a new output frame
+    // frames change size or format, or are multiplied, only into new frames
+    bool inplace =
+        fltr->flags & PX_FILTER_INPLACE && !fltr->window && same_props && fltr->max_out_frames <= 1;
 
-static int transcode_packet(PXContext* pxc, AVPacket* pkt) {
-    AVCodecContext* dec_ctx = pxc->media_ctx->coding_ctx_arr[pxc->media_ctx->stream_idx].dec_ctx;
-    int ret = avcodec_send_packet(dec_ctx, pkt);
-    if (ret < 0) {
-        LAV_THROW_MSG("avcodec_send_packet", ret);
+    // in-place filters write to the task's frame directly, copying it only if its data is shared
+    int n_out = inplace ? 1 : FFMAX(fltr->max_out_frames, 1);
+    PXFrame out_frames[n_out];
+    memset(out_frames, 0, sizeof out_frames);
+
+    int ret = 0;
+    if (inplace)
+        ret = px_frame_make_writable(&task->frame, fltr->frame_pool);
+    else
+        ret = alloc_out_frames(fltr, in_frame, out_frames, n_out);
+    if (ret < 0)
         return ret;
+
+    fltr->in_frame = in_frame;
+    fltr->out_frames = inplace ? &task->frame : out_frames;
+    fltr->out_frame = fltr->out_frames;
+    fltr->n_out_frames = 1;
+    fltr->frame_num = task->msg.frame_num;
+
+    PXStatsTimer timer = px_stats_timer_start();
+    bool use_slices = fltr->apply_slice && (!fltr->apply || (pool && px_thrd_pool_num_threads(pool) > 1));
+    if (!use_slices) {
+        ret = fltr->apply(fltr);
+        px_stats_add(timing, timer, 1);
+    } else if (pool) {
+        SliceJobs jobs = {.fltr = fltr, .timing = timing, .n_slices = px_thrd_pool_num_threads(pool)};
+        ret = px_thrd_pool_run(pool, apply_slice_job, &jobs, fltr->out_frame->n_planes * jobs.n_slices);
+        px_stats_add_wall(timing, timer, 1);
+    } else {
+        for (int i = 0; i < fltr->out_frame->n_planes && ret >= 0; i++) {
+            ret = fltr->apply_slice(fltr, i, 0, fltr->out_frame->planes[i].height);
+        }
+        px_stats_add(timing, timer, 1);
     }
 
-    if (pkt)
-        av_packet_unref(pkt);
+    int n_filled = fltr->n_out_frames;
+    fltr->in_frame = NULL;
+    fltr->out_frame = NULL;
+    fltr->out_frames = NULL;
 
-    AVFrame* frame = av_frame_alloc();
-    while (ret >= 0) {
-        ret = avcodec_receive_frame(dec_ctx, frame);
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            ret = 0;
-            break;
-        } else if (ret < 0) {
-            LAV_THROW_MSG("avcodec_receive_frame", ret);
-            break;
+    if (ret >= 0 && (n_filled < 0 || n_filled > n_out)) {
+        px_log(PX_LOG_ERROR, "Filter \"%s\" output %d frames, at most %d are allowed\n", fltr->name, n_filled,
+               n_out);
+        ret = PXERROR(EINVAL);
+    }
+
+    if (ret >= 0 && n_filled > 1) {
+        task->extra_frames = malloc((size_t)(n_filled - 1) * sizeof *task->extra_frames);
+        if (!task->extra_frames) {
+            px_oom_msg((size_t)(n_filled - 1) * sizeof *task->extra_frames);
+            ret = PXERROR(ENOMEM);
         }
-        pxc->media_ctx->frames_decoded++;
-        frame->pts = frame->best_effort_timestamp;
+    }
 
-        ret = filter_encode_frame(pxc, frame);
-        if (ret < 0)
-            break;
+    if (ret < 0) {
+        px_log(PX_LOG_ERROR, "Failed to apply filter \"%s\"\n", fltr->name);
+        for (int i = 0; !inplace && i < n_out; i++) {
+            px_frame_unref(&out_frames[i]);
+        }
+        return ret;
+    }
 
-        av_frame_unref(frame);
+    task->dropped = n_filled == 0;
+    if (inplace)
+        return 0;
+
+    px_frame_unref(&task->frame);
+    if (n_filled > 0)
+        task->frame = out_frames[0];
+    for (int i = 1; i < n_filled; i++) {
+        task->extra_frames[task->n_extra_frames++] = out_frames[i];
+    }
+    for (int i = n_filled; i < n_out; i++) {
+        px_frame_unref(&out_frames[i]);
     }
 
-    av_frame_free(&frame);
-    return ret;
+    return 0;
 }
 
-// june wuz here :3
-int px_transcode(PXContext* pxc) {
+/**
+ * move the frames the filter output for `task` to `out`, one task each, in order
+ * extra frames get their own copy of the input's AVFrame properties, and are spaced 1/fps apart
+ * `task` is left empty, and frames the filter dropped are counted in PXMediaContext::decoded_frames_dropped
+ */
+static int push_outputs(FilterChain* chain, const PXFilter* fltr, FilterTask* task, TaskList* out) {
+    PXMediaContext* ctx = chain->pxc->media_ctx;
     int ret = 0;
+    if (task->dropped) {
+        ctx->decoded_frames_dropped++;
+        goto end;
+    }
 
-    AVPacket* pkt = av_packet_alloc();
-    while (true) {
-        ret = read_frame(pxc->media_ctx, pkt);
-        if (ret == AVERROR(EAGAIN)) {
-            continue;
-        } else if (ret == AVERROR_EOF) {
-            ret = 0;
-            break;
-        } else if (ret < 0) {
+    FilterTask first = {.msg = task->msg, .frame = task->frame};
+    ret = task_list_push(out, &first);
+    if (ret < 0)
+        goto end;
+    task->msg.frame = NULL;
+    task->frame = (PXFrame) {0};
+
+    AVRational time_base = ctx->ifmt_ctx->streams[first.msg.stream_idx]->time_base;
+    AVRational frame_dur = {fltr->out_props.fps_den, fltr->out_props.fps_num};
+    int64_t pts_step = frame_dur.den > 0 ? FFMAX(av_rescale_q(1, frame_dur, time_base), 1) : 1;
+
+    for (int i = 0; i < task->n_extra_frames; i++) {
+        FilterTask extra = {.msg = first.msg, .frame = task->extra_frames[i]};
+        extra.msg.frame = get_spare_frame(&chain->spare_frames);
+        if (!extra.msg.frame) {
+            ret = AVERROR(ENOMEM);
             goto end;
         }
 
-        ret = transcode_packet(pxc, pkt);
-        if (ret < 0)
+        ret = av_frame_copy_props(extra.msg.frame, first.msg.frame);
+        if (ret >= 0) {
+            if (first.msg.frame->pts != AV_NOPTS_VALUE)
+                extra.msg.frame->pts = first.msg.frame->pts + (i + 1) * pts_step;
+            ret = task_list_push(out, &extra);
+        } else {
+            LAV_THROW_MSG("av_frame_copy_props", ret);
+        }
+        if (ret < 0) {
+            av_frame_free(&extra.msg.frame);
             goto end;
+        }
+        task->extra_frames[i] = (PXFrame) {0};
     }
 
-    // flush
-    for (unsigned i = 0; i < pxc->media_ctx->ifmt_ctx->nb_streams; i++) {
-        enum AVMediaType stream_type = pxc->media_ctx->ifmt_ctx->streams[i]->codecpar->codec_type;
-        if (stream_type != AVMEDIA_TYPE_VIDEO)
-            continue;
+end:
+    filter_task_free(task);
+    task->dropped = false;
+    return ret;
+}
 
-        pxc->media_ctx->stream_idx = (int)i;
+// after a filter has been applied to every task, replace them with the frames it output
+static int collect_outputs(FilterChain* chain, const PXFilter* fltr) {
+    TaskList* in = &chain->tasks;
+    TaskList* out = &chain->scratch;
 
-        if (pxc->media_ctx->coding_ctx_arr[i].dec_ctx->codec->capabilities & AV_CODEC_CAP_DELAY) {
-            ret = transcode_packet(pxc, NULL);
-            if (ret < 0)
-                goto end;
-        }
+    bool changed = false;
+    for (int i = 0; i < in->count && !changed; i++) {
+        changed = in->tasks[i].dropped || in->tasks[i].n_extra_frames > 0;
+    }
+    if (!changed)
+        return 0;
+
+    for (int i = 0; i < in->count; i++) {
+        int ret = push_outputs(chain, fltr, &in->tasks[i], out);
+        if (ret < 0)
+            return ret;
+    }
+    in->count = 0;
+
+    TaskList emptied = *in;
+    *in = *out;
+    *out = emptied;
+    return 0;
+}
+
+static int apply_filter_threaded(void* ctx, int task_idx, [[maybe_unused]] int thread_idx) {
+    FilterBatch* batch = ctx;
+
+    // in/out frames are per-call state, so every concurrent call needs its own copy
+    // frames are already spread over the pool, so slices are applied on this thread
+    PXFilter fltr = *batch->fltr;
+    return apply_filter(&fltr, &batch->tasks[task_idx], NULL, batch->fltr_timing);
+}
+
+typedef struct LutJobs {
+    const PXLut* lut;
+    FilterTask* tasks;
+    PXFrame* out_frames; // per task, the table is applied in place if the frame has no data
+    PXStageStats* timing;
+    int n_planes;
+    int n_slices; // per plane
+} LutJobs;
+
+static int apply_lut_job(void* ctx, int job_idx, [[maybe_unused]] int thread_idx) {
+    LutJobs* jobs = ctx;
+
+    int jobs_per_task = jobs->n_planes * jobs->n_slices;
+    int task = job_idx / jobs_per_task;
+    int plane = job_idx % jobs_per_task / jobs->n_slices;
+    int slice = job_idx % jobs->n_slices;
+
+    PXFrame* src = &jobs->tasks[task].frame;
+    PXFrame* dst = jobs->out_frames[task].buf ? &jobs->out_frames[task] : src;
+    int height = src->planes[plane].height;
+
+    int y_start = (int)((int64_t)height * slice / jobs->n_slices);
+    int y_end = (int)((int64_t)height * (slice + 1) / jobs->n_slices);
+    if (y_start == y_end)
+        return 0;
+
+    PXStatsTimer timer = px_stats_timer_start();
+    px_lut_apply(jobs->lut, plane, &src->planes[plane], &dst->planes[plane], y_start, y_end);
+    px_stats_add_cpu(jobs->timing, timer);
+
+    return 0;
+}
+
+/**
+ * apply the merged table of one or more filters to every task, sliced over the thread pool
+ * frames that are shared with something else get the table applied into a new frame, instead of being
+ * copied first. the time spent is counted towards the first filter merged into the table
+ */
+static int apply_lut(FilterChain* chain, const PXLut* lut) {
+    PXContext* pxc = chain->pxc;
+    TaskList* tasks = &chain->tasks;
+    if (tasks->count == 0)
+        return 0;
+
+    const PXFilter* first = pxc->fltr_ctx->filters[lut->first_filter];
+    PXFrame out_frames[tasks->count];
+    memset(out_frames, 0, sizeof out_frames);
+
+    int ret = 0;
+    for (int i = 0; i < tasks->count && ret >= 0; i++) {
+        const PXFrame* frame = &tasks->tasks[i].frame;
+        if (!px_frame_is_writable(frame))
+            ret = alloc_out_frames(first, frame, &out_frames[i], 1);
+    }
+
+    if (ret >= 0) {
+        LutJobs jobs = {
+            .lut = lut,
+            .tasks = tasks->tasks,
+            .out_frames = out_frames,
+            .timing = px_stats_filter(pxc->media_ctx->stats, lut->first_filter),
+            .n_planes = tasks->tasks[0].frame.n_planes,
+            .n_slices = px_thrd_pool_num_threads(pxc->thrd_pool),
+        };
+
+        PXStatsTimer timer = px_stats_timer_start();
+        int n_jobs = tasks->count * jobs.n_planes * jobs.n_slices;
+        ret = px_thrd_pool_run(pxc->thrd_pool, apply_lut_job, &jobs, n_jobs);
+        px_stats_add_wall(jobs.timing, timer, tasks->count);
+    }
 
-        if (pxc->media_ctx->coding_ctx_arr[i].enc_ctx->codec->capabilities & AV_CODEC_CAP_DELAY) {
-            ret = encode_frame(pxc->media_ctx, NULL);
-            if (ret != AVERROR_EOF && ret < 0)
-                goto end;
+    for (int i = 0; i < tasks->count; i++) {
+        if (ret < 0 || !out_frames[i].buf) {
+            px_frame_unref(&out_frames[i]);
+            continue;
         }
+
+        px_frame_unref(&tasks->tasks[i].frame);
+        tasks->tasks[i].frame = out_frames[i];
     }
 
-    ret = av_write_trailer(pxc->media_ctx->ofmt_ctx);
     if (ret < 0)
-        LAV_THROW_MSG("av_write_trailer", ret);
+        px_log(PX_LOG_ERROR, "Failed to apply the lookup table of filter \"%s\"\n", first->name);
+    return ret;
+}
 
-end:
-    pxc->transc_thread.done = true;
-    av_packet_free(&pkt);
+// strips are sized so that a strip of every frame a run of filters touches fits in this by default,
+// a conservative guess at the size of L2
+#define PX_STRIP_CACHE_SIZE (256 * 1024)
+
+// whether the filter can be applied strip by strip along with the filters next to it, see apply_strips()
+static bool can_run_strips(const PXFilter* fltr) {
+    const PXFrameProps* in = &fltr->in_props;
+    const PXFrameProps* out = &fltr->out_props;
+    bool same_props = out->width == in->width && out->height == in->height && out->pix_fmt == in->pix_fmt;
+
+    return fltr->flags & PX_FILTER_STRIPS && fltr->apply_slice && !px_filter_is_temporal(fltr) &&
+           fltr->max_out_frames <= 1 && same_props;
+}
+
+// number of filters from `first` on that are applied strip by strip together, only worth it if > 1
+static int strip_run_length(const PXContext* pxc, int first) {
+    const PXFilterContext* fltr_ctx = pxc->fltr_ctx;
+    if (pxc->strip_rows == 0)
+        return 0;
+
+    // filters applied through a lookup table break the run
+    int n = 0;
+    while (first + n < fltr_ctx->n_filters && can_run_strips(fltr_ctx->filters[first + n]) &&
+           !px_filter_ctx_find_lut(fltr_ctx, first + n)) {
+        n++;
+    }
+    return n;
+}
+
+typedef struct StripJobs {
+    PXFilter** filters;
+    PXStageStats** timing; // per filter, the time spent on each strip is added to these
+    const int* reach;      // [i] = halo_rows of filters 1 to i summed, the first one reads a complete frame
+    int n_filters;
+    int n_bands; // at most, per plane, see plane_bands()
+    int strip_rows;
+} StripJobs;
+
+// each thread gets a band of rows of each plane, tall enough that the rows left around its top and
+// bottom for strip_seam_job() don't overlap
+static int plane_bands(const StripJobs* jobs, int height) {
+    int min_height = 4 * jobs->reach[jobs->n_filters - 1] + jobs->strip_rows;
+    return FFMAX(FFMIN(jobs->n_bands, height / min_height), 1);
+}
+
+static inline int band_start(int height, int band, int n_bands) {
+    return (int)((int64_t)height * band / n_bands);
+}
+
+// apply the run's `idx`th filter to rows [y_start, y_end) of `plane`, if there are any
+static int apply_strip(const StripJobs* jobs, int idx, int plane, int y_start, int y_end, int calls) {
+    if (y_start >= y_end)
+        return 0;
+
+    PXFilter* fltr = jobs->filters[idx];
+    PXStatsTimer timer = px_stats_timer_start();
+    int ret = fltr->apply_slice(fltr, plane, y_start, y_end);
+    px_stats_add(jobs->timing[idx], timer, calls);
+
+    return ret;
+}
+
+/**
+ * apply every filter of the run to a band of a plane, one strip at a time. each filter lags behind the one
+ * before it by its halo, so the rows it reads have just been filtered and are likely still in cache
+ * rows within reach of the bands above and below are left to strip_seam_job()
+ */
+static int strip_band_job(void* ctx, int job_idx, [[maybe_unused]] int thread_idx) {
+    const StripJobs* jobs = ctx;
+    int plane = job_idx / jobs->n_bands;
+    int band = job_idx % jobs->n_bands;
+    int height = jobs->filters[0]->out_frame->planes[plane].height;
+    int n_bands = plane_bands(jobs, height);
+    if (band >= n_bands)
+        return 0;
+
+    int start = band_start(height, band, n_bands);
+    int end = band_start(height, band + 1, n_bands);
+
+    // each filter has rows [done[i], last[i]) of the band left
+    int n = jobs->n_filters;
+    int done[n];
+    int last[n];
+    for (int i = 0; i < n; i++) {
+        done[i] = band > 0 ? start + jobs->reach[i] : 0;
+        last[i] = band < n_bands - 1 ? end - jobs->reach[i] : height;
+    }
+
+    for (int y = start + jobs->strip_rows; done[n - 1] < last[n - 1]; y += jobs->strip_rows) {
+        for (int i = 0; i < n; i++) {
+            int y_end = FFMIN(FFMAX(y - jobs->reach[i], done[i]), last[i]);
+
+            // the first job always starts at the top of the first plane, and counts each filter once
+            int ret = apply_strip(jobs, i, plane, done[i], y_end, job_idx == 0 && done[i] == 0);
+            if (ret < 0)
+                return ret;
+            done[i] = y_end;
+        }
+    }
+
+    return 0;
+}
+
+// apply the run to the rows around the border between two bands, after strip_band_job() is done with both
+static int strip_seam_job(void* ctx, int job_idx, [[maybe_unused]] int thread_idx) {
+    const StripJobs* jobs = ctx;
+    int plane = job_idx / (jobs->n_bands - 1);
+    int seam = job_idx % (jobs->n_bands - 1);
+    int height = jobs->filters[0]->out_frame->planes[plane].height;
+    int n_bands = plane_bands(jobs, height);
+    if (seam >= n_bands - 1)
+        return 0;
+
+    int y = band_start(height, seam + 1, n_bands);
+    for (int i = 1; i < jobs->n_filters; i++) {
+        int ret = apply_strip(jobs, i, plane, y - jobs->reach[i], y + jobs->reach[i], 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+// apply the run to a single task's frame, see apply_strips()
+static int apply_strips_task(StripJobs* jobs, FilterTask* task, PXContext* pxc) {
+    int n = jobs->n_filters;
+
+    // outputs of the filters that don't work in place
+    PXFrame frames[n];
+    memset(frames, 0, sizeof frames);
+
+    PXFrame* cur = &task->frame;
+    int n_touched = 1;
+    int ret = 0;
+    for (int i = 0; i < n && ret >= 0; i++) {
+        PXFilter* fltr = jobs->filters[i];
+        fltr->in_frame = cur;
+        if (fltr->flags & PX_FILTER_INPLACE && fltr->halo_rows == 0) {
+            ret = px_frame_make_writable(cur, fltr->frame_pool);
+        } else {
+            ret = alloc_out_frames(fltr, cur, &frames[i], 1);
+            if (ret < 0)
+                break;
+            cur = &frames[i];
+            n_touched++;
+        }
+        fltr->out_frame = cur;
+        fltr->out_frames = cur;
+        fltr->n_out_frames = 1;
+        fltr->frame_num = task->msg.frame_num;
+    }
+
+    if (ret >= 0) {
+        jobs->strip_rows = pxc->strip_rows;
+        if (jobs->strip_rows < 0) {
+            size_t row_size = (size_t)cur->planes[0].stride * (size_t)n_touched;
+            jobs->strip_rows = (int)FFMAX(PX_STRIP_CACHE_SIZE / row_size, 1);
+        }
+
+        int n_planes = cur->n_planes;
+        ret = px_thrd_pool_run(pxc->thrd_pool, strip_band_job, jobs, n_planes * jobs->n_bands);
+        if (ret >= 0 && jobs->n_bands > 1 && jobs->reach[n - 1] > 0)
+            ret = px_thrd_pool_run(pxc->thrd_pool, strip_seam_job, jobs, n_planes * (jobs->n_bands - 1));
+    }
+
+    for (int i = 0; i < n; i++) {
+        jobs->filters[i]->in_frame = NULL;
+        jobs->filters[i]->out_frame = NULL;
+        jobs->filters[i]->out_frames = NULL;
+    }
+
+    if (ret < 0) {
+        px_log(PX_LOG_ERROR, "Failed to apply filters \"%s\" to \"%s\"\n", jobs->filters[0]->name,
+               jobs->filters[n - 1]->name);
+    } else if (cur != &task->frame) {
+        px_frame_unref(&task->frame);
+        task->frame = *cur;
+        *cur = (PXFrame) {0};
+    }
+
+    for (int i = 0; i < n; i++) {
+        px_frame_unref(&frames[i]);
+    }
+    return ret;
+}
+
+/**
+ * apply `n_filters` filters from `first` on to every task, passing each strip of a frame through all
+ * of them before moving on to the next, see PXContext::strip_rows
+ * frames in between the filters are still allocated whole, but each strip of them is read back right
+ * after it's written instead of once the whole frame has been
+ */
+static int apply_strips(FilterChain* chain, int first, int n_filters) {
+    PXContext* pxc = chain->pxc;
+
+    PXStageStats* timing[n_filters];
+    int reach[n_filters];
+    PXFilter** filters = &pxc->fltr_ctx->filters[first];
+    for (int i = 0; i < n_filters; i++) {
+        timing[i] = px_stats_filter(pxc->media_ctx->stats, first + i);
+        reach[i] = i > 0 ? reach[i - 1] + filters[i]->halo_rows : 0;
+    }
+
+    StripJobs jobs = {
+        .filters = filters,
+        .timing = timing,
+        .reach = reach,
+        .n_filters = n_filters,
+        .n_bands = px_thrd_pool_num_threads(pxc->thrd_pool),
+    };
+
+    int ret = 0;
+    for (int i = 0; i < chain->tasks.count && ret >= 0; i++) {
+        ret = apply_strips_task(&jobs, &chain->tasks.tasks[i], pxc);
+    }
+    return ret;
+}
+
+// take ownership of the task's frame, holding it back until the filter's future frames have been added
+static int window_add(FilterWindow* win, FilterTask* task) {
+    int ret = px_fb_add(&win->frames, &task->frame);
+    if (ret < 0)
+        return ret;
+    px_frame_unref(&task->frame);
+
+    assert(win->n_pending < win->max_pending);
+    win->pending[(win->first_pending + win->n_pending) % win->max_pending] = task->msg;
+    win->n_pending++;
+    task->msg.frame = NULL;
+
+    return 0;
+}
+
+// apply the filter to the oldest frame that hasn't been filtered yet, appending the results to `out`
+static int window_apply(FilterChain* chain, FilterWindow* win, PXFilter* fltr, PXStageStats* timing,
+                        TaskList* out) {
+    FilterTask task = {.msg = win->pending[win->first_pending]};
+    int pos = win->frames.num_frames - win->n_pending;
+    win->first_pending = (win->first_pending + 1) % win->max_pending;
+    win->n_pending--;
+
+    px_frame_ref(&task.frame, px_fb_get(&win->frames, pos));
+    fltr->window = &win->frames;
+    fltr->window_pos = pos;
+
+    int ret = apply_filter(fltr, &task, chain->pxc->thrd_pool, timing);
+    fltr->window = NULL;
+    if (ret >= 0)
+        ret = push_outputs(chain, fltr, &task, out);
+
+    filter_task_free(&task);
+    return ret;
+}
+
+/**
+ * apply a filter that sees several frames at once, to one frame at a time and in order
+ * each frame is filtered once the filter's future frames have been added after it, or when flushing
+ * on success, `chain->tasks` holds the frames that were filtered, which may be fewer or more than before
+ */
+static int apply_temporal_filter(FilterChain* chain, int fltr_idx, bool flush) {
+    PXContext* pxc = chain->pxc;
+    PXFilter* fltr = pxc->fltr_ctx->filters[fltr_idx];
+    PXStageStats* timing = px_stats_filter(pxc->media_ctx->stats, fltr_idx);
+    int n_filters = pxc->fltr_ctx->n_filters;
+
+    TaskList* in = &chain->tasks;
+    TaskList* out = &chain->scratch;
+
+    for (int i = 0; i < in->count; i++) {
+        FilterTask* task = &in->tasks[i];
+        FilterWindow* win = &chain->windows[task->msg.stream_idx * n_filters + fltr_idx];
+
+        int ret = window_add(win, task);
+        if (ret < 0)
+            return ret;
+
+        while (win->n_pending > fltr->future_frames) {
+            ret = window_apply(chain, win, fltr, timing, out);
+            if (ret < 0)
+                return ret;
+        }
+    }
+    in->count = 0;
+
+    for (int i = fltr_idx; flush && i < chain->n_windows; i += n_filters) {
+        FilterWindow* win = &chain->windows[i];
+        while (win->n_pending > 0) {
+            int ret = window_apply(chain, win, fltr, timing, out);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    TaskList emptied = *in;
+    *in = *out;
+    *out = emptied;
+    return 0;
+}
+
+// convert `frame` to the encoder's pixel format in place, or copy it to an aligned buffer if it's in it
+// already
+static int conv_enc_pix_fmt(PXContext* pxc, AVFrame* frame, int stream_idx, int thread_idx) {
+    PXCodingContext* coding_ctx = &pxc->media_ctx->coding_ctx_arr[stream_idx];
+    const AVCodecContext* enc_ctx = coding_ctx->enc_ctx;
+
+    AVFrame** conv_frame = &coding_ctx->conv_frames[thread_idx];
+    if (!*conv_frame) {
+        *conv_frame = av_frame_alloc();
+        if (!*conv_frame) {
+            px_oom_msg(sizeof(AVFrame));
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    struct SwsContext** sws = &coding_ctx->sws_export[thread_idx];
+    if (!*sws && frame->format != enc_ctx->pix_fmt) {
+        px_log(PX_LOG_INFO, "Converting frames from %s to %s\n", av_get_pix_fmt_name(frame->format),
+               av_get_pix_fmt_name(enc_ctx->pix_fmt));
+    }
+
+    // the pool's buffers only fit frames of the size the encoder was opened with
+    bool pooled = frame->width == enc_ctx->width && frame->height == enc_ctx->height;
+    AVBufferPool* buf_pool = pooled ? coding_ctx->enc_buf_pool : NULL;
+    int ret = conv_pix_fmt(*conv_frame, frame, enc_ctx->pix_fmt, buf_pool, sws);
+    if (ret < 0) {
+        av_frame_unref(*conv_frame);
+        return ret;
+    }
+
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, *conv_frame);
+
+    return 0;
+}
+
+// whether the encoder can be given `frame` as it is, its planes aligned like av_frame_get_buffer() would
+static bool enc_can_ref(const AVFrame* frame, const AVCodecContext* enc_ctx) {
+    if (frame->format != enc_ctx->pix_fmt)
+        return false;
+
+    size_t align = av_cpu_max_align();
+    for (int i = 0; i < av_pix_fmt_count_planes(frame->format); i++) {
+        if ((uintptr_t)frame->data[i] % align || (size_t)frame->linesize[i] % align)
+            return false;
+    }
+
+    return true;
+}
+
+// convert the filtered frame back to `msg.frame` in the encoder's pixel format
+// on success, `msg.frame` holds its own reference to the output data
+static int export_frame(void* ctx, int task_idx, int thread_idx) {
+    FilterBatch* batch = ctx;
+    FilterTask* task = &batch->tasks[task_idx];
+    AVFrame* frame = task->msg.frame;
+    PXMediaContext* media_ctx = batch->pxc->media_ctx;
+    const PXCodingContext* coding_ctx = &media_ctx->coding_ctx_arr[task->msg.stream_idx];
+
+    PXStatsTimer timer = px_stats_timer_start();
+
+    // a filter changed the format, see alloc_out_frames()
+    if (task->frame.av_pix_fmt == AV_PIX_FMT_NONE)
+        task->frame.av_pix_fmt = coding_ctx->filter_out_pix_fmt;
+    int ret = px_frame_to_av(frame, &task->frame);
+
+    // the frame references pixie's buffer, which goes back to its pool once the encoder is done with it
+    // so it's only converted if the encoder needs another format or alignment
+    if (ret >= 0 && !enc_can_ref(frame, coding_ctx->enc_ctx))
+        ret = conv_enc_pix_fmt(batch->pxc, frame, task->msg.stream_idx, thread_idx);
+    px_stats_add(px_stats_stage(media_ctx->stats, PX_STAGE_EXPORT), timer, 1);
+
+    return ret;
+}
+
+// without filters, decoded frames only have to be converted if the encoder doesn't take their format
+static int passthrough_frame(void* ctx, int task_idx, int thread_idx) {
+    FilterBatch* batch = ctx;
+    FrameMsg* msg = &batch->tasks[task_idx].msg;
+
+    PXMediaContext* media_ctx = batch->pxc->media_ctx;
+    const AVCodecContext* enc_ctx = media_ctx->coding_ctx_arr[msg->stream_idx].enc_ctx;
+    if (msg->frame->format == enc_ctx->pix_fmt)
+        return 0;
+
+    PXStatsTimer timer = px_stats_timer_start();
+    int ret = conv_enc_pix_fmt(batch->pxc, msg->frame, msg->stream_idx, thread_idx);
+    px_stats_add(px_stats_stage(media_ctx->stats, PX_STAGE_EXPORT), timer, 1);
+
+    return ret;
+}
+
+/**
+ * run `n_msgs` frames through the filter chain, spreading the work over `pxc->thrd_pool`
+ * filters without PX_FILTER_FRAME_THREADS still see the frames one at a time, in order
+ * consecutive filters with PX_FILTER_STRIPS are applied strip by strip if PXContext::strip_rows is set
+ * and those with PXFilter::get_lut() through their merged lookup table
+ * temporal filters hold frames back until their future frames arrive, `flush` passes on all of them
+ * the chain takes ownership of `msgs`, and on success `chain->tasks` holds the output frames in order,
+ * ready for encoding. the caller takes them out and resets `chain->tasks.count`
+ */
+static int filter_frames(FilterChain* chain, FrameMsg* msgs, int n_msgs, bool flush) {
+    PXContext* pxc = chain->pxc;
+    TaskList* tasks = &chain->tasks;
+
+    int ret = 0;
+    for (int i = 0; i < n_msgs; i++) {
+        ret = task_list_push(tasks, &(FilterTask) {.msg = msgs[i]});
+        if (ret < 0) {
+            for (int j = i; j < n_msgs; j++) {
+                av_frame_free(&msgs[j].frame);
+            }
+            goto fail;
+        }
+    }
+
+    FilterBatch batch = {.pxc = pxc, .tasks = tasks->tasks};
+    if (pxc->fltr_ctx->n_filters == 0) {
+        ret = px_thrd_pool_run(pxc->thrd_pool, passthrough_frame, &batch, tasks->count);
+        if (ret < 0)
+            goto fail;
+        return 0;
+    }
+
+    ret = px_thrd_pool_run(pxc->thrd_pool, import_frame, &batch, tasks->count);
+    if (ret < 0)
+        goto fail;
+
+    for (int i = 0; i < pxc->fltr_ctx->n_filters; i++) {
+        batch.fltr = pxc->fltr_ctx->filters[i];
+        batch.fltr_timing = px_stats_filter(pxc->media_ctx->stats, i);
+
+        if (px_filter_is_temporal(batch.fltr)) {
+            ret = apply_temporal_filter(chain, i, flush);
+            if (ret < 0)
+                goto fail;
+            batch.tasks = tasks->tasks;
+            continue;
+        }
+
+        const PXLut* lut = px_filter_ctx_find_lut(pxc->fltr_ctx, i);
+        if (lut) {
+            ret = apply_lut(chain, lut);
+            if (ret < 0)
+                goto fail;
+            i += lut->n_filters - 1;
+            continue;
+        }
+
+        int n_strips = strip_run_length(pxc, i);
+        if (n_strips > 1) {
+            ret = apply_strips(chain, i, n_strips);
+            if (ret < 0)
+                goto fail;
+            i += n_strips - 1;
+            continue;
+        }
+
+        if (batch.fltr->flags & PX_FILTER_FRAME_THREADS) {
+            ret = px_thrd_pool_run(pxc->thrd_pool, apply_filter_threaded, &batch, tasks->count);
+        } else {
+            for (int j = 0; j < tasks->count && ret >= 0; j++) {
+                ret = apply_filter(batch.fltr, &tasks->tasks[j], pxc->thrd_pool, batch.fltr_timing);
+            }
+        }
+        if (ret < 0)
+            goto fail;
+
+        ret = collect_outputs(chain, batch.fltr);
+        if (ret < 0)
+            goto fail;
+        batch.tasks = tasks->tasks;
+    }
+
+    ret = px_thrd_pool_run(pxc->thrd_pool, export_frame, &batch, tasks->count);
+    if (ret < 0)
+        goto fail;
+
+    for (int i = 0; i < tasks->count; i++) {
+        px_frame_unref(&tasks->tasks[i].frame);
+    }
+    return 0;
+
+fail:
+    task_list_clear(&chain->tasks);
+    task_list_clear(&chain->scratch);
+    return ret;
+}
+
+// called with each decoded frame, which is unreferenced afterwards
+typedef int (*FrameCallback)(void* opaque, AVFrame* frame, int stream_idx, uint64_t frame_num);
+
+// decode `pkt` (NULL to flush the decoder) and pass each resulting frame to `on_frame`
+static int decode_packet(PXMediaContext* ctx, int stream_idx, AVPacket* pkt, FrameCallback on_frame,
+                         void* opaque) {
+    AVCodecContext* dec_ctx = ctx->coding_ctx_arr[stream_idx].dec_ctx;
+    PXStageStats* timing = px_stats_stage(ctx->stats, PX_STAGE_DECODE);
+
+    PXStatsTimer timer = px_stats_timer_start();
+    int ret = avcodec_send_packet(dec_ctx, pkt);
+    px_stats_add(timing, timer, 1);
+    if (ret < 0) {
+        LAV_THROW_MSG("avcodec_send_packet", ret);
+        return ret;
+    }
+
+    if (pkt)
+        av_packet_unref(pkt);
+
+    AVFrame* frame = ctx->coding_ctx_arr[stream_idx].dec_frame;
+    while (ret >= 0) {
+        timer = px_stats_timer_start();
+        ret = avcodec_receive_frame(dec_ctx, frame);
+        px_stats_add(timing, timer, 0);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            LAV_THROW_MSG("avcodec_receive_frame", ret);
+            break;
+        }
+        frame->pts = frame->best_effort_timestamp;
+
+        // decoded from packets read to complete the segment, but shown in a neighbouring one
+        if (ctx->segmented && frame->pts != AV_NOPTS_VALUE &&
+            (frame->pts < ctx->segment.start || frame->pts >= ctx->segment.end)) {
+            av_frame_unref(frame);
+            continue;
+        }
+
+        uint64_t frame_num = ++ctx->frames_decoded;
+
+        ret = on_frame(opaque, frame, stream_idx, frame_num);
+        if (ret < 0)
+            break;
+
+        av_frame_unref(frame);
+    }
+
+    av_frame_unref(frame);
+    return ret;
+}
+
+void px_get_progress(const PXContext* pxc, PXProgress* progress) {
+    const PXMediaContext* ctx = pxc->media_ctx;
+    int64_t start_ns = pxc->start_ns;
+
+    *progress = (PXProgress) {
+        .frames_decoded = ctx->frames_decoded,
+        .frames_dropped = ctx->decoded_frames_dropped,
+        .frames_output = ctx->frames_output,
+        .duration_us = ctx->duration_us,
+        .out_time_us = ctx->out_time_us,
+        .elapsed_ns = start_ns ? px_time_ns() - start_ns : 0,
+        .done = pxc->transc_thread.done,
+    };
+}
+
+// call PXContext::progress_cb if its interval has passed or another milestone was reached since the last call
+static void report_progress(PXContext* pxc) {
+    if (!pxc->progress_cb)
+        return;
+
+    uint64_t frames = pxc->media_ctx->frames_output;
+    bool due = pxc->progress_frames > 0 && frames >= pxc->next_progress_frame;
+    if (!due && pxc->progress_interval_ms > 0)
+        due = px_time_ns() >= pxc->next_progress_ns;
+    if (!due)
+        return;
+
+    PXProgress progress;
+    px_get_progress(pxc, &progress);
+
+    if (pxc->progress_frames > 0) {
+        uint64_t every = (uint64_t)pxc->progress_frames;
+        pxc->next_progress_frame = (frames / every + 1) * every;
+    }
+    if (pxc->progress_interval_ms > 0)
+        pxc->next_progress_ns = px_time_ns() + pxc->progress_interval_ms * INT64_C(1000000);
+
+    pxc->progress_cb(pxc->progress_opaque, &progress);
+}
+
+// encode the frames that came out of the filter chain
+static int encode_filtered(FilterChain* chain) {
+    int ret = 0;
+    for (int i = 0; i < chain->tasks.count && ret >= 0; i++) {
+        FrameMsg* msg = &chain->tasks.tasks[i].msg;
+        ret = encode_frame(chain->pxc->media_ctx, msg->stream_idx, msg->frame);
+        put_spare_frame(&chain->spare_frames, &msg->frame);
+    }
+
+    task_list_clear(&chain->tasks);
+    report_progress(chain->pxc);
+    return ret;
+}
+
+static int filter_encode_frame(void* opaque, AVFrame* frame, int stream_idx, uint64_t frame_num) {
+    FilterChain* chain = opaque;
+
+    FrameMsg msg = {.stream_idx = stream_idx, .frame_num = frame_num};
+    msg.frame = get_spare_frame(&chain->spare_frames);
+    if (!msg.frame)
+        return AVERROR(ENOMEM);
+    av_frame_move_ref(msg.frame, frame);
+
+    int ret = filter_frames(chain, &msg, 1, false);
+    if (ret < 0)
+        return ret;
+
+    return encode_filtered(chain);
+}
+
+static int transcode_serial(PXContext* pxc) {
+    FilterChain chain;
+    int ret = filter_chain_init(&chain, pxc);
+    if (ret < 0)
+        return ret;
+
+    PXMediaContext* ctx = pxc->media_ctx;
+    AVPacket* pkt = av_packet_alloc();
+    while (true) {
+        ret = read_frame(ctx, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            continue;
+        } else if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            goto end;
+        }
+
+        ret = decode_packet(ctx, pkt->stream_index, pkt, filter_encode_frame, &chain);
+        if (ret < 0)
+            goto end;
+    }
+
+    // flush the decoders, then the frames temporal filters are holding back, then the encoders
+    for (unsigned i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        const AVCodecContext* dec_ctx = ctx->coding_ctx_arr[i].dec_ctx;
+        if (!dec_ctx || !(dec_ctx->codec->capabilities & AV_CODEC_CAP_DELAY))
+            continue;
+
+        ctx->stream_idx = (int)i;
+        ret = decode_packet(ctx, (int)i, NULL, filter_encode_frame, &chain);
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = filter_frames(&chain, NULL, 0, true);
+    if (ret < 0)
+        goto end;
+
+    ret = encode_filtered(&chain);
+    if (ret < 0)
+        goto end;
+
+    for (unsigned i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        const AVCodecContext* enc_ctx = ctx->coding_ctx_arr[i].enc_ctx;
+        if (!enc_ctx || !(enc_ctx->codec->capabilities & AV_CODEC_CAP_DELAY))
+            continue;
+
+        ctx->stream_idx = (int)i;
+        ret = encode_frame(ctx, (int)i, NULL);
+        if (ret != AVERROR_EOF && ret < 0)
+            goto end;
+    }
+
+end:
+    av_packet_free(&pkt);
+    filter_chain_free(&chain);
+    return ret;
+}
+
+typedef struct Pipeline {
+    PXContext* pxc;
+
+    PXQueue pkt_queue; // AVPacket*: demux -> decode, NULL marks the end of input
+    PXQueue dec_queue; // FrameMsg: decode -> filter
+    PXQueue enc_queue; // FrameMsg: filter -> encode
+
+    FilterChain chain; // only used by the filter stage, except for its thread-safe `spare_frames`
+    PXQueue spare_pkts; // AVPacket*: demux <- decode
+
+    // first error returned by any stage, the queues are aborted when this is set
+    atomic_int err;
+} Pipeline;
+
+static void pipeline_fail(Pipeline* pl, int err) {
+    int no_err = 0;
+    atomic_compare_exchange_strong(&pl->err, &no_err, err);
+
+    px_queue_abort(&pl->pkt_queue);
+    px_queue_abort(&pl->dec_queue);
+    px_queue_abort(&pl->enc_queue);
+}
+
+static int pipeline_init(Pipeline* pl, PXContext* pxc) {
+    *pl = (Pipeline) {.pxc = pxc};
+
+    int ret = px_queue_init(&pl->pkt_queue, sizeof(AVPacket*), pxc->queue_depth);
+    if (ret < 0)
+        return ret;
+
+    ret = px_queue_init(&pl->dec_queue, sizeof(FrameMsg), pxc->queue_depth);
+    if (ret < 0)
+        return ret;
+
+    ret = px_queue_init(&pl->enc_queue, sizeof(FrameMsg), pxc->queue_depth);
+    if (ret < 0)
+        return ret;
+
+    // the queued packets, plus the ones being read and decoded
+    ret = px_queue_init(&pl->spare_pkts, sizeof(AVPacket*), pxc->queue_depth + 2);
+    if (ret < 0)
+        return ret;
+
+    return filter_chain_init(&pl->chain, pxc);
+}
+
+// px_queue_push(), recording how full the queue is afterwards
+static int push_counted(Pipeline* pl, PXQueue* queue, PXQueueKind kind, const void* elem) {
+    int ret = px_queue_push(queue, elem);
+    if (ret >= 0)
+        px_stats_queue_pushed(pl->pxc->media_ctx->stats, kind, px_queue_len(queue), queue->capacity);
+    return ret;
+}
+
+static void drain_frame_queue(PXQueue* queue) {
+    if (!queue->elems)
+        return;
+
+    FrameMsg msg;
+    while (px_queue_try_pop(queue, &msg) == 0) {
+        av_frame_free(&msg.frame);
+    }
+}
+
+static void pipeline_free(Pipeline* pl) {
+    AVPacket* pkt;
+    while (pl->pkt_queue.elems && px_queue_try_pop(&pl->pkt_queue, &pkt) == 0) {
+        av_packet_free(&pkt);
+    }
+    drain_frame_queue(&pl->dec_queue);
+    drain_frame_queue(&pl->enc_queue);
+
+    px_queue_free(&pl->pkt_queue);
+    px_queue_free(&pl->dec_queue);
+    px_queue_free(&pl->enc_queue);
+    free_spare_packets(&pl->spare_pkts);
+
+    filter_chain_free(&pl->chain);
+}
+
+static int push_decoded_frame(void* opaque, AVFrame* frame, int stream_idx, uint64_t frame_num) {
+    Pipeline* pl = opaque;
+
+    FrameMsg msg = {.stream_idx = stream_idx, .frame_num = frame_num};
+    msg.frame = get_spare_frame(&pl->chain.spare_frames);
+    if (!msg.frame)
+        return AVERROR(ENOMEM);
+    av_frame_move_ref(msg.frame, frame);
+
+    int ret = push_counted(pl, &pl->dec_queue, PX_QUEUE_DECODED, &msg);
+    if (ret < 0)
+        av_frame_free(&msg.frame);
+    return ret;
+}
+
+static int demux_stage(Pipeline* pl) {
+    PXMediaContext* ctx = pl->pxc->media_ctx;
+    int ret = 0;
+
+    AVPacket* pkt = NULL;
+    while (true) {
+        if (!pkt) {
+            pkt = get_spare_packet(&pl->spare_pkts);
+            if (!pkt) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+        }
+
+        ret = read_frame(ctx, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            continue;
+        } else if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret < 0) {
+            goto fail;
+        }
+
+        ret = push_counted(pl, &pl->pkt_queue, PX_QUEUE_PACKETS, &pkt);
+        if (ret < 0)
+            goto end;
+        pkt = NULL;
+    }
+
+    av_packet_free(&pkt);
+    ret = px_queue_push(&pl->pkt_queue, &pkt);
+    goto end;
+
+fail:
+    pipeline_fail(pl, ret);
+end:
+    av_packet_free(&pkt);
+    return ret;
+}
+
+static int decode_stage(Pipeline* pl) {
+    PXMediaContext* ctx = pl->pxc->media_ctx;
+
+    AVPacket* pkt;
+    int ret = 0;
+    while ((ret = px_queue_pop(&pl->pkt_queue, &pkt)) == 0 && pkt) {
+        ret = decode_packet(ctx, pkt->stream_index, pkt, push_decoded_frame, pl);
+        put_spare_packet(&pl->spare_pkts, &pkt);
+        if (ret < 0)
+            goto fail;
+    }
+    if (ret < 0)
+        return ret;
+
+    // flush
+    for (unsigned i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        const AVCodecContext* dec_ctx = ctx->coding_ctx_arr[i].dec_ctx;
+        if (!dec_ctx || !(dec_ctx->codec->capabilities & AV_CODEC_CAP_DELAY))
+            continue;
+
+        ret = decode_packet(ctx, (int)i, NULL, push_decoded_frame, pl);
+        if (ret < 0)
+            goto fail;
+    }
+
+    return px_queue_push(&pl->dec_queue, &(FrameMsg) {0});
+
+fail:
+    pipeline_fail(pl, ret);
+    return ret;
+}
+
+static int filter_stage(Pipeline* pl) {
+    int batch_size = px_thrd_pool_num_threads(pl->pxc->thrd_pool);
+    FrameMsg msgs[batch_size];
+    TaskList* filtered = &pl->chain.tasks;
+
+    bool eof = false;
+    int n_msgs = 0;
+    int ret = 0;
+    while (!eof) {
+        // gather up to one frame per thread, filter them together and pass them on in decode order
+        n_msgs = 0;
+        while (n_msgs < batch_size) {
+            ret = px_queue_pop(&pl->dec_queue, &msgs[n_msgs]);
+            if (ret < 0)
+                goto abort;
+
+            if (!msgs[n_msgs].frame) {
+                eof = true;
+                break;
+            }
+            n_msgs++;
+        }
+
+        // at the end, the frames temporal filters are holding back are passed on too
+        ret = filter_frames(&pl->chain, msgs, n_msgs, eof);
+        n_msgs = 0;
+        if (ret < 0) {
+            pipeline_fail(pl, ret);
+            goto abort;
+        }
+
+        for (int i = 0; i < filtered->count; i++) {
+            ret = push_counted(pl, &pl->enc_queue, PX_QUEUE_FILTERED, &filtered->tasks[i].msg);
+            if (ret < 0)
+                goto abort; // the rest of the frames are freed below
+            filtered->tasks[i].msg.frame = NULL;
+        }
+        filtered->count = 0;
+    }
+
+    return px_queue_push(&pl->enc_queue, &(FrameMsg) {0});
+
+abort:
+    for (int i = 0; i < n_msgs; i++) {
+        av_frame_free(&msgs[i].frame);
+    }
+    task_list_clear(filtered);
+    return ret;
+}
+
+static int encode_stage(Pipeline* pl) {
+    PXMediaContext* ctx = pl->pxc->media_ctx;
+
+    FrameMsg msg;
+    int ret = 0;
+    while ((ret = px_queue_pop(&pl->enc_queue, &msg)) == 0 && msg.frame) {
+        ret = encode_frame(ctx, msg.stream_idx, msg.frame);
+        put_spare_frame(&pl->chain.spare_frames, &msg.frame);
+        if (ret < 0)
+            goto fail;
+
+        report_progress(pl->pxc);
+    }
+    if (ret < 0)
+        return ret;
+
+    // flush
+    for (unsigned i = 0; i < ctx->ifmt_ctx->nb_streams; i++) {
+        const AVCodecContext* enc_ctx = ctx->coding_ctx_arr[i].enc_ctx;
+        if (!enc_ctx || !(enc_ctx->codec->capabilities & AV_CODEC_CAP_DELAY))
+            continue;
+
+        ret = encode_frame(ctx, (int)i, NULL);
+        if (ret != AVERROR_EOF && ret < 0)
+            goto fail;
+    }
+
+    return 0;
+
+fail:
+    pipeline_fail(pl, ret);
+    return ret;
+}
+
+// demux on the calling thread, decode, filter and encode each on their own thread
+static int transcode_pipelined(PXContext* pxc) {
+    Pipeline pl;
+    int ret = pipeline_init(&pl, pxc);
+    if (ret < 0)
+        goto end;
+
+    PXThread stages[] = {
+        {.func = (PXThreadFunc)decode_stage, .args = &pl},
+        {.func = (PXThreadFunc)filter_stage, .args = &pl},
+        {.func = (PXThreadFunc)encode_stage, .args = &pl},
+    };
+    int n_launched = 0;
+    for (; n_launched < (int)FF_ARRAY_ELEMS(stages); n_launched++) {
+        ret = px_thrd_launch(&stages[n_launched]);
+        if (ret != 0) {
+            pipeline_fail(&pl, PXERROR(EAGAIN));
+            break;
+        }
+    }
+
+    if (n_launched == (int)FF_ARRAY_ELEMS(stages))
+        demux_stage(&pl);
+
+    for (int i = 0; i < n_launched; i++) {
+        int stage_ret = 0;
+        px_thrd_join(&stages[i], &stage_ret);
+    }
+
+    ret = pl.err;
+
+end:
+    pipeline_free(&pl);
+    return ret;
+}
+
+// june wuz here :3
+int px_transcode(PXContext* pxc) {
+    int64_t start_ns = px_time_ns();
+    pxc->start_ns = start_ns;
+    pxc->next_progress_ns = start_ns + pxc->progress_interval_ms * INT64_C(1000000);
+    pxc->next_progress_frame = pxc->progress_frames > 0 ? (uint64_t)pxc->progress_frames : 0;
+
+    int ret = 0;
+    if (!pxc->thrd_pool) {
+        int n_threads = pxc->filter_threads > 0 ? pxc->filter_threads : px_get_available_threads();
+        ret = px_thrd_pool_new(&pxc->thrd_pool, n_threads);
+        if (ret < 0)
+            goto end;
+    }
+
+    // filters share the pool through px_parallel_for()
+    for (int i = 0; i < pxc->fltr_ctx->n_filters; i++) {
+        pxc->fltr_ctx->filters[i]->thread_pool = pxc->thrd_pool;
+    }
+
+    ret = px_media_ctx_alloc_sws(pxc->media_ctx, px_thrd_pool_num_threads(pxc->thrd_pool));
+    if (ret < 0)
+        goto end;
+
+    ret = pxc->queue_depth > 0 ? transcode_pipelined(pxc) : transcode_serial(pxc);
+    if (ret < 0)
+        goto end;
+
+    ret = av_write_trailer(pxc->media_ctx->ofmt_ctx);
+    if (ret < 0)
+        LAV_THROW_MSG("av_write_trailer", ret);
+
+end:
+    pxc->transc_thread.done = true;
+    if (pxc->progress_cb) {
+        PXProgress progress;
+        px_get_progress(pxc, &progress);
+        pxc->progress_cb(pxc->progress_opaque, &progress);
+    }
     return ret;
 }
 
@@ -271,6 +1785,7 @@ void px_ctx_free(PXContext** pxc) {
 
     px_filter_ctx_free(&ppxc->fltr_ctx);
     px_media_ctx_free(&ppxc->media_ctx);
+    px_thrd_pool_free(&ppxc->thrd_pool);
 
     px_free(pxc);
 }
@@ -0,0 +1,688 @@
+#include "internals.h"
+
+#include <pixie/simd.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef PX_ARCH_X86
+#include <immintrin.h>
+#elif defined(PX_ARCH_AARCH64)
+#include <arm_neon.h>
+#endif
+
+typedef enum RepackLayout : uint8_t {
+    REPACK_SEMIPLANAR_8,  // full plane + interleaved 8-bit chroma plane (nvXX)
+    REPACK_SEMIPLANAR_16, // full plane + interleaved 16-bit chroma plane, MSB-aligned (pXXX)
+    REPACK_PACKED_4X8,    // 4 interleaved 8-bit components ([a]rgb[a], [a]bgr[a])
+} RepackLayout;
+
+typedef struct RepackDesc {
+    enum AVPixelFormat packed_fmt;
+    enum AVPixelFormat planar_fmt;
+    RepackLayout layout;
+    int depth; // bits per component in the planar format
+    int log2_chroma_w;
+    int log2_chroma_h;
+    // planar plane of each interleaved component, in memory order
+    // for semi-planar formats, only the chroma plane is listed
+    int plane_order[4];
+} RepackDesc;
+
+static const RepackDesc repack_descs[] = {
+    {AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P, REPACK_SEMIPLANAR_8, 8, 1, 1, {1, 2}},
+    {AV_PIX_FMT_NV21, AV_PIX_FMT_YUV420P, REPACK_SEMIPLANAR_8, 8, 1, 1, {2, 1}},
+    {AV_PIX_FMT_NV16, AV_PIX_FMT_YUV422P, REPACK_SEMIPLANAR_8, 8, 1, 0, {1, 2}},
+    {AV_PIX_FMT_NV24, AV_PIX_FMT_YUV444P, REPACK_SEMIPLANAR_8, 8, 0, 0, {1, 2}},
+    {AV_PIX_FMT_NV42, AV_PIX_FMT_YUV444P, REPACK_SEMIPLANAR_8, 8, 0, 0, {2, 1}},
+
+    {AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE, REPACK_SEMIPLANAR_16, 10, 1, 1, {1, 2}},
+    {AV_PIX_FMT_P012LE, AV_PIX_FMT_YUV420P12LE, REPACK_SEMIPLANAR_16, 12, 1, 1, {1, 2}},
+    {AV_PIX_FMT_P016LE, AV_PIX_FMT_YUV420P16LE, REPACK_SEMIPLANAR_16, 16, 1, 1, {1, 2}},
+    {AV_PIX_FMT_P210LE, AV_PIX_FMT_YUV422P10LE, REPACK_SEMIPLANAR_16, 10, 1, 0, {1, 2}},
+    {AV_PIX_FMT_P212LE, AV_PIX_FMT_YUV422P12LE, REPACK_SEMIPLANAR_16, 12, 1, 0, {1, 2}},
+    {AV_PIX_FMT_P216LE, AV_PIX_FMT_YUV422P16LE, REPACK_SEMIPLANAR_16, 16, 1, 0, {1, 2}},
+    {AV_PIX_FMT_P410LE, AV_PIX_FMT_YUV444P10LE, REPACK_SEMIPLANAR_16, 10, 0, 0, {1, 2}},
+    {AV_PIX_FMT_P412LE, AV_PIX_FMT_YUV444P12LE, REPACK_SEMIPLANAR_16, 12, 0, 0, {1, 2}},
+    {AV_PIX_FMT_P416LE, AV_PIX_FMT_YUV444P16LE, REPACK_SEMIPLANAR_16, 16, 0, 0, {1, 2}},
+
+    // gbrap planes are ordered G, B, R, A
+    {AV_PIX_FMT_RGBA, AV_PIX_FMT_GBRAP, REPACK_PACKED_4X8, 8, 0, 0, {2, 0, 1, 3}},
+    {AV_PIX_FMT_BGRA, AV_PIX_FMT_GBRAP, REPACK_PACKED_4X8, 8, 0, 0, {1, 0, 2, 3}},
+    {AV_PIX_FMT_ARGB, AV_PIX_FMT_GBRAP, REPACK_PACKED_4X8, 8, 0, 0, {3, 2, 0, 1}},
+    {AV_PIX_FMT_ABGR, AV_PIX_FMT_GBRAP, REPACK_PACKED_4X8, 8, 0, 0, {3, 1, 0, 2}},
+};
+
+// row kernels, `n` is the number of output (deinterleave) or input (interleave) elements per plane
+typedef struct RepackKernels {
+    void (*deint2_u8)(const uint8_t* src, uint8_t* dst0, uint8_t* dst1, int n);
+    void (*int2_u8)(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int n);
+    // 16-bit variants shift right when deinterleaving and left when interleaving
+    void (*deint2_u16)(const uint16_t* src, uint16_t* dst0, uint16_t* dst1, int n, int shift);
+    void (*int2_u16)(const uint16_t* src0, const uint16_t* src1, uint16_t* dst, int n, int shift);
+    void (*shr_u16)(const uint16_t* src, uint16_t* dst, int n, int shift);
+    void (*shl_u16)(const uint16_t* src, uint16_t* dst, int n, int shift);
+    void (*deint4_u8)(const uint8_t* src, uint8_t* const dst[4], int n);
+    void (*int4_u8)(const uint8_t* const src[4], uint8_t* dst, int n);
+} RepackKernels;
+
+static void deint2_u8_c(const uint8_t* src, uint8_t* dst0, uint8_t* dst1, int n) {
+    for (int i = 0; i < n; i++) {
+        dst0[i] = src[2 * i];
+        dst1[i] = src[2 * i + 1];
+    }
+}
+
+static void int2_u8_c(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[2 * i] = src0[i];
+        dst[2 * i + 1] = src1[i];
+    }
+}
+
+static void deint2_u16_c(const uint16_t* src, uint16_t* dst0, uint16_t* dst1, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        dst0[i] = (uint16_t)(src[2 * i] >> shift);
+        dst1[i] = (uint16_t)(src[2 * i + 1] >> shift);
+    }
+}
+
+static void int2_u16_c(const uint16_t* src0, const uint16_t* src1, uint16_t* dst, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        dst[2 * i] = (uint16_t)(src0[i] << shift);
+        dst[2 * i + 1] = (uint16_t)(src1[i] << shift);
+    }
+}
+
+static void shr_u16_c(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = (uint16_t)(src[i] >> shift);
+    }
+}
+
+static void shl_u16_c(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = (uint16_t)(src[i] << shift);
+    }
+}
+
+static void deint4_u8_c(const uint8_t* src, uint8_t* const dst[4], int n) {
+    for (int i = 0; i < n; i++) {
+        dst[0][i] = src[4 * i];
+        dst[1][i] = src[4 * i + 1];
+        dst[2][i] = src[4 * i + 2];
+        dst[3][i] = src[4 * i + 3];
+    }
+}
+
+static void int4_u8_c(const uint8_t* const src[4], uint8_t* dst, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[4 * i] = src[0][i];
+        dst[4 * i + 1] = src[1][i];
+        dst[4 * i + 2] = src[2][i];
+        dst[4 * i + 3] = src[3][i];
+    }
+}
+
+static const RepackKernels kernels_c = {
+    .deint2_u8 = deint2_u8_c,
+    .int2_u8 = int2_u8_c,
+    .deint2_u16 = deint2_u16_c,
+    .int2_u16 = int2_u16_c,
+    .shr_u16 = shr_u16_c,
+    .shl_u16 = shl_u16_c,
+    .deint4_u8 = deint4_u8_c,
+    .int4_u8 = int4_u8_c,
+};
+
+// the vector kernels process as many full vectors as they can and leave the rest to the C ones
+
+#ifdef PX_ARCH_X86
+
+#define LOAD128(p) _mm_loadu_si128((const __m128i*)(p))
+#define STORE128(p, v) _mm_storeu_si128((__m128i*)(p), v)
+
+[[gnu::target("sse4.1")]] static void deint2_u8_sse4(const uint8_t* src, uint8_t* dst0, uint8_t* dst1,
+                                                     int n) {
+    const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = LOAD128(src + 2 * i);
+        __m128i b = LOAD128(src + 2 * i + 16);
+        STORE128(dst0 + i, _mm_packus_epi16(_mm_and_si128(a, lo_mask), _mm_and_si128(b, lo_mask)));
+        STORE128(dst1 + i, _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    deint2_u8_c(src + 2 * i, dst0 + i, dst1 + i, n - i);
+}
+
+[[gnu::target("sse4.1")]] static void int2_u8_sse4(const uint8_t* src0, const uint8_t* src1, uint8_t* dst,
+                                                   int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = LOAD128(src0 + i);
+        __m128i b = LOAD128(src1 + i);
+        STORE128(dst + 2 * i, _mm_unpacklo_epi8(a, b));
+        STORE128(dst + 2 * i + 16, _mm_unpackhi_epi8(a, b));
+    }
+
+    int2_u8_c(src0 + i, src1 + i, dst + 2 * i, n - i);
+}
+
+[[gnu::target("sse4.1")]] static void deint2_u16_sse4(const uint16_t* src, uint16_t* dst0, uint16_t* dst1,
+                                                      int n, int shift) {
+    const __m128i lo_mask = _mm_set1_epi32(0x0000ffff);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = LOAD128(src + 2 * i);
+        __m128i b = LOAD128(src + 2 * i + 8);
+        __m128i even = _mm_packus_epi32(_mm_and_si128(a, lo_mask), _mm_and_si128(b, lo_mask));
+        __m128i odd = _mm_packus_epi32(_mm_srli_epi32(a, 16), _mm_srli_epi32(b, 16));
+        STORE128(dst0 + i, _mm_srl_epi16(even, count));
+        STORE128(dst1 + i, _mm_srl_epi16(odd, count));
+    }
+
+    deint2_u16_c(src + 2 * i, dst0 + i, dst1 + i, n - i, shift);
+}
+
+[[gnu::target("sse4.1")]] static void int2_u16_sse4(const uint16_t* src0, const uint16_t* src1, uint16_t* dst,
+                                                    int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_sll_epi16(LOAD128(src0 + i), count);
+        __m128i b = _mm_sll_epi16(LOAD128(src1 + i), count);
+        STORE128(dst + 2 * i, _mm_unpacklo_epi16(a, b));
+        STORE128(dst + 2 * i + 8, _mm_unpackhi_epi16(a, b));
+    }
+
+    int2_u16_c(src0 + i, src1 + i, dst + 2 * i, n - i, shift);
+}
+
+[[gnu::target("sse4.1")]] static void shr_u16_sse4(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        STORE128(dst + i, _mm_srl_epi16(LOAD128(src + i), count));
+    }
+
+    shr_u16_c(src + i, dst + i, n - i, shift);
+}
+
+[[gnu::target("sse4.1")]] static void shl_u16_sse4(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        STORE128(dst + i, _mm_sll_epi16(LOAD128(src + i), count));
+    }
+
+    shl_u16_c(src + i, dst + i, n - i, shift);
+}
+
+[[gnu::target("sse4.1")]] static void deint4_u8_sse4(const uint8_t* src, uint8_t* const dst[4], int n) {
+    // gather each component of 4 pixels into one dword
+    const __m128i shuf = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i t0 = _mm_shuffle_epi8(LOAD128(src + 4 * i), shuf);
+        __m128i t1 = _mm_shuffle_epi8(LOAD128(src + 4 * i + 16), shuf);
+        __m128i t2 = _mm_shuffle_epi8(LOAD128(src + 4 * i + 32), shuf);
+        __m128i t3 = _mm_shuffle_epi8(LOAD128(src + 4 * i + 48), shuf);
+
+        // 4x4 dword transpose
+        __m128i c01_lo = _mm_unpacklo_epi32(t0, t1);
+        __m128i c01_hi = _mm_unpacklo_epi32(t2, t3);
+        __m128i c23_lo = _mm_unpackhi_epi32(t0, t1);
+        __m128i c23_hi = _mm_unpackhi_epi32(t2, t3);
+
+        STORE128(dst[0] + i, _mm_unpacklo_epi64(c01_lo, c01_hi));
+        STORE128(dst[1] + i, _mm_unpackhi_epi64(c01_lo, c01_hi));
+        STORE128(dst[2] + i, _mm_unpacklo_epi64(c23_lo, c23_hi));
+        STORE128(dst[3] + i, _mm_unpackhi_epi64(c23_lo, c23_hi));
+    }
+
+    uint8_t* const dst_tail[4] = {dst[0] + i, dst[1] + i, dst[2] + i, dst[3] + i};
+    deint4_u8_c(src + 4 * i, dst_tail, n - i);
+}
+
+[[gnu::target("sse4.1")]] static void int4_u8_sse4(const uint8_t* const src[4], uint8_t* dst, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i c0 = LOAD128(src[0] + i);
+        __m128i c1 = LOAD128(src[1] + i);
+        __m128i c2 = LOAD128(src[2] + i);
+        __m128i c3 = LOAD128(src[3] + i);
+
+        __m128i c01_lo = _mm_unpacklo_epi8(c0, c1);
+        __m128i c01_hi = _mm_unpackhi_epi8(c0, c1);
+        __m128i c23_lo = _mm_unpacklo_epi8(c2, c3);
+        __m128i c23_hi = _mm_unpackhi_epi8(c2, c3);
+
+        STORE128(dst + 4 * i, _mm_unpacklo_epi16(c01_lo, c23_lo));
+        STORE128(dst + 4 * i + 16, _mm_unpackhi_epi16(c01_lo, c23_lo));
+        STORE128(dst + 4 * i + 32, _mm_unpacklo_epi16(c01_hi, c23_hi));
+        STORE128(dst + 4 * i + 48, _mm_unpackhi_epi16(c01_hi, c23_hi));
+    }
+
+    const uint8_t* const src_tail[4] = {src[0] + i, src[1] + i, src[2] + i, src[3] + i};
+    int4_u8_c(src_tail, dst + 4 * i, n - i);
+}
+
+static const RepackKernels kernels_sse4 = {
+    .deint2_u8 = deint2_u8_sse4,
+    .int2_u8 = int2_u8_sse4,
+    .deint2_u16 = deint2_u16_sse4,
+    .int2_u16 = int2_u16_sse4,
+    .shr_u16 = shr_u16_sse4,
+    .shl_u16 = shl_u16_sse4,
+    .deint4_u8 = deint4_u8_sse4,
+    .int4_u8 = int4_u8_sse4,
+};
+
+#define LOAD256(p) _mm256_loadu_si256((const __m256i*)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+
+// AVX2 packs and unpacks work within 128-bit lanes, so the results need their qwords or lanes reordered
+
+[[gnu::target("avx2")]] static void deint2_u8_avx2(const uint8_t* src, uint8_t* dst0, uint8_t* dst1, int n) {
+    const __m256i lo_mask = _mm256_set1_epi16(0x00ff);
+
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = LOAD256(src + 2 * i);
+        __m256i b = LOAD256(src + 2 * i + 32);
+        __m256i even = _mm256_packus_epi16(_mm256_and_si256(a, lo_mask), _mm256_and_si256(b, lo_mask));
+        __m256i odd = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        STORE256(dst0 + i, _mm256_permute4x64_epi64(even, 0xd8));
+        STORE256(dst1 + i, _mm256_permute4x64_epi64(odd, 0xd8));
+    }
+
+    deint2_u8_sse4(src + 2 * i, dst0 + i, dst1 + i, n - i);
+}
+
+[[gnu::target("avx2")]] static void int2_u8_avx2(const uint8_t* src0, const uint8_t* src1, uint8_t* dst,
+                                                 int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = LOAD256(src0 + i);
+        __m256i b = LOAD256(src1 + i);
+        __m256i lo = _mm256_unpacklo_epi8(a, b);
+        __m256i hi = _mm256_unpackhi_epi8(a, b);
+        STORE256(dst + 2 * i, _mm256_permute2x128_si256(lo, hi, 0x20));
+        STORE256(dst + 2 * i + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    int2_u8_sse4(src0 + i, src1 + i, dst + 2 * i, n - i);
+}
+
+[[gnu::target("avx2")]] static void deint2_u16_avx2(const uint16_t* src, uint16_t* dst0, uint16_t* dst1,
+                                                    int n, int shift) {
+    const __m256i lo_mask = _mm256_set1_epi32(0x0000ffff);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = LOAD256(src + 2 * i);
+        __m256i b = LOAD256(src + 2 * i + 16);
+        __m256i even = _mm256_packus_epi32(_mm256_and_si256(a, lo_mask), _mm256_and_si256(b, lo_mask));
+        __m256i odd = _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16));
+        STORE256(dst0 + i, _mm256_srl_epi16(_mm256_permute4x64_epi64(even, 0xd8), count));
+        STORE256(dst1 + i, _mm256_srl_epi16(_mm256_permute4x64_epi64(odd, 0xd8), count));
+    }
+
+    deint2_u16_sse4(src + 2 * i, dst0 + i, dst1 + i, n - i, shift);
+}
+
+[[gnu::target("avx2")]] static void int2_u16_avx2(const uint16_t* src0, const uint16_t* src1, uint16_t* dst,
+                                                  int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_sll_epi16(LOAD256(src0 + i), count);
+        __m256i b = _mm256_sll_epi16(LOAD256(src1 + i), count);
+        __m256i lo = _mm256_unpacklo_epi16(a, b);
+        __m256i hi = _mm256_unpackhi_epi16(a, b);
+        STORE256(dst + 2 * i, _mm256_permute2x128_si256(lo, hi, 0x20));
+        STORE256(dst + 2 * i + 16, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    int2_u16_sse4(src0 + i, src1 + i, dst + 2 * i, n - i, shift);
+}
+
+[[gnu::target("avx2")]] static void shr_u16_avx2(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        STORE256(dst + i, _mm256_srl_epi16(LOAD256(src + i), count));
+    }
+
+    shr_u16_sse4(src + i, dst + i, n - i, shift);
+}
+
+[[gnu::target("avx2")]] static void shl_u16_avx2(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        STORE256(dst + i, _mm256_sll_epi16(LOAD256(src + i), count));
+    }
+
+    shl_u16_sse4(src + i, dst + i, n - i, shift);
+}
+
+[[gnu::target("avx2")]] static void deint4_u8_avx2(const uint8_t* src, uint8_t* const dst[4], int n) {
+    const __m256i shuf = _mm256_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15, //
+                                          0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    // after the per-lane transpose, dword k of the low lane holds pixels 8k..8k+3 and
+    // dword k of the high lane holds pixels 8k+4..8k+7
+    const __m256i dword_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i t0 = _mm256_shuffle_epi8(LOAD256(src + 4 * i), shuf);
+        __m256i t1 = _mm256_shuffle_epi8(LOAD256(src + 4 * i + 32), shuf);
+        __m256i t2 = _mm256_shuffle_epi8(LOAD256(src + 4 * i + 64), shuf);
+        __m256i t3 = _mm256_shuffle_epi8(LOAD256(src + 4 * i + 96), shuf);
+
+        __m256i c01_lo = _mm256_unpacklo_epi32(t0, t1);
+        __m256i c01_hi = _mm256_unpacklo_epi32(t2, t3);
+        __m256i c23_lo = _mm256_unpackhi_epi32(t0, t1);
+        __m256i c23_hi = _mm256_unpackhi_epi32(t2, t3);
+
+        __m256i c0 = _mm256_unpacklo_epi64(c01_lo, c01_hi);
+        __m256i c1 = _mm256_unpackhi_epi64(c01_lo, c01_hi);
+        __m256i c2 = _mm256_unpacklo_epi64(c23_lo, c23_hi);
+        __m256i c3 = _mm256_unpackhi_epi64(c23_lo, c23_hi);
+
+        STORE256(dst[0] + i, _mm256_permutevar8x32_epi32(c0, dword_order));
+        STORE256(dst[1] + i, _mm256_permutevar8x32_epi32(c1, dword_order));
+        STORE256(dst[2] + i, _mm256_permutevar8x32_epi32(c2, dword_order));
+        STORE256(dst[3] + i, _mm256_permutevar8x32_epi32(c3, dword_order));
+    }
+
+    uint8_t* const dst_tail[4] = {dst[0] + i, dst[1] + i, dst[2] + i, dst[3] + i};
+    deint4_u8_sse4(src + 4 * i, dst_tail, n - i);
+}
+
+[[gnu::target("avx2")]] static void int4_u8_avx2(const uint8_t* const src[4], uint8_t* dst, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i c0 = LOAD256(src[0] + i);
+        __m256i c1 = LOAD256(src[1] + i);
+        __m256i c2 = LOAD256(src[2] + i);
+        __m256i c3 = LOAD256(src[3] + i);
+
+        __m256i c01_lo = _mm256_unpacklo_epi8(c0, c1);
+        __m256i c01_hi = _mm256_unpackhi_epi8(c0, c1);
+        __m256i c23_lo = _mm256_unpacklo_epi8(c2, c3);
+        __m256i c23_hi = _mm256_unpackhi_epi8(c2, c3);
+
+        // pixels {0-3, 16-19}, {4-7, 20-23}, {8-11, 24-27}, {12-15, 28-31}
+        __m256i p0 = _mm256_unpacklo_epi16(c01_lo, c23_lo);
+        __m256i p1 = _mm256_unpackhi_epi16(c01_lo, c23_lo);
+        __m256i p2 = _mm256_unpacklo_epi16(c01_hi, c23_hi);
+        __m256i p3 = _mm256_unpackhi_epi16(c01_hi, c23_hi);
+
+        STORE256(dst + 4 * i, _mm256_permute2x128_si256(p0, p1, 0x20));
+        STORE256(dst + 4 * i + 32, _mm256_permute2x128_si256(p2, p3, 0x20));
+        STORE256(dst + 4 * i + 64, _mm256_permute2x128_si256(p0, p1, 0x31));
+        STORE256(dst + 4 * i + 96, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+
+    const uint8_t* const src_tail[4] = {src[0] + i, src[1] + i, src[2] + i, src[3] + i};
+    int4_u8_sse4(src_tail, dst + 4 * i, n - i);
+}
+
+static const RepackKernels kernels_avx2 = {
+    .deint2_u8 = deint2_u8_avx2,
+    .int2_u8 = int2_u8_avx2,
+    .deint2_u16 = deint2_u16_avx2,
+    .int2_u16 = int2_u16_avx2,
+    .shr_u16 = shr_u16_avx2,
+    .shl_u16 = shl_u16_avx2,
+    .deint4_u8 = deint4_u8_avx2,
+    .int4_u8 = int4_u8_avx2,
+};
+
+#endif // PX_ARCH_X86
+
+#ifdef PX_ARCH_AARCH64
+
+static void deint2_u8_neon(const uint8_t* src, uint8_t* dst0, uint8_t* dst1, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t v = vld2q_u8(src + 2 * i);
+        vst1q_u8(dst0 + i, v.val[0]);
+        vst1q_u8(dst1 + i, v.val[1]);
+    }
+
+    deint2_u8_c(src + 2 * i, dst0 + i, dst1 + i, n - i);
+}
+
+static void int2_u8_neon(const uint8_t* src0, const uint8_t* src1, uint8_t* dst, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t v = {{vld1q_u8(src0 + i), vld1q_u8(src1 + i)}};
+        vst2q_u8(dst + 2 * i, v);
+    }
+
+    int2_u8_c(src0 + i, src1 + i, dst + 2 * i, n - i);
+}
+
+static void deint2_u16_neon(const uint16_t* src, uint16_t* dst0, uint16_t* dst1, int n, int shift) {
+    const int16x8_t count = vdupq_n_s16((int16_t)-shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t v = vld2q_u16(src + 2 * i);
+        vst1q_u16(dst0 + i, vshlq_u16(v.val[0], count));
+        vst1q_u16(dst1 + i, vshlq_u16(v.val[1], count));
+    }
+
+    deint2_u16_c(src + 2 * i, dst0 + i, dst1 + i, n - i, shift);
+}
+
+static void int2_u16_neon(const uint16_t* src0, const uint16_t* src1, uint16_t* dst, int n, int shift) {
+    const int16x8_t count = vdupq_n_s16((int16_t)shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t v = {{vshlq_u16(vld1q_u16(src0 + i), count), vshlq_u16(vld1q_u16(src1 + i), count)}};
+        vst2q_u16(dst + 2 * i, v);
+    }
+
+    int2_u16_c(src0 + i, src1 + i, dst + 2 * i, n - i, shift);
+}
+
+static void shr_u16_neon(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    const int16x8_t count = vdupq_n_s16((int16_t)-shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u16(dst + i, vshlq_u16(vld1q_u16(src + i), count));
+    }
+
+    shr_u16_c(src + i, dst + i, n - i, shift);
+}
+
+static void shl_u16_neon(const uint16_t* src, uint16_t* dst, int n, int shift) {
+    const int16x8_t count = vdupq_n_s16((int16_t)shift);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u16(dst + i, vshlq_u16(vld1q_u16(src + i), count));
+    }
+
+    shl_u16_c(src + i, dst + i, n - i, shift);
+}
+
+static void deint4_u8_neon(const uint8_t* src, uint8_t* const dst[4], int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t v = vld4q_u8(src + 4 * i);
+        vst1q_u8(dst[0] + i, v.val[0]);
+        vst1q_u8(dst[1] + i, v.val[1]);
+        vst1q_u8(dst[2] + i, v.val[2]);
+        vst1q_u8(dst[3] + i, v.val[3]);
+    }
+
+    uint8_t* const dst_tail[4] = {dst[0] + i, dst[1] + i, dst[2] + i, dst[3] + i};
+    deint4_u8_c(src + 4 * i, dst_tail, n - i);
+}
+
+static void int4_u8_neon(const uint8_t* const src[4], uint8_t* dst, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t v = {
+            {vld1q_u8(src[0] + i), vld1q_u8(src[1] + i), vld1q_u8(src[2] + i), vld1q_u8(src[3] + i)},
+        };
+        vst4q_u8(dst + 4 * i, v);
+    }
+
+    const uint8_t* const src_tail[4] = {src[0] + i, src[1] + i, src[2] + i, src[3] + i};
+    int4_u8_c(src_tail, dst + 4 * i, n - i);
+}
+
+static const RepackKernels kernels_neon = {
+    .deint2_u8 = deint2_u8_neon,
+    .int2_u8 = int2_u8_neon,
+    .deint2_u16 = deint2_u16_neon,
+    .int2_u16 = int2_u16_neon,
+    .shr_u16 = shr_u16_neon,
+    .shl_u16 = shl_u16_neon,
+    .deint4_u8 = deint4_u8_neon,
+    .int4_u8 = int4_u8_neon,
+};
+
+#endif // PX_ARCH_AARCH64
+
+static const RepackKernels* get_kernels(void) {
+    [[maybe_unused]] int cpu_flags = px_cpu_flags();
+
+#ifdef PX_ARCH_X86
+    if (cpu_flags & PX_CPU_AVX2)
+        return &kernels_avx2;
+    if (cpu_flags & PX_CPU_SSE4)
+        return &kernels_sse4;
+#elif defined(PX_ARCH_AARCH64)
+    if (cpu_flags & PX_CPU_NEON)
+        return &kernels_neon;
+#endif
+
+    return &kernels_c;
+}
+
+// find the repack between `src_fmt` and `dst_fmt`, `*unpack` is set if `src_fmt` is the packed one
+static const RepackDesc* find_repack(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt, bool* unpack) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // only little-endian formats are listed
+    return NULL;
+#endif
+
+    for (size_t i = 0; i < sizeof repack_descs / sizeof repack_descs[0]; i++) {
+        const RepackDesc* desc = &repack_descs[i];
+        if (desc->packed_fmt == src_fmt && desc->planar_fmt == dst_fmt) {
+            *unpack = true;
+            return desc;
+        }
+        if (desc->planar_fmt == src_fmt && desc->packed_fmt == dst_fmt) {
+            *unpack = false;
+            return desc;
+        }
+    }
+
+    return NULL;
+}
+
+bool px_can_repack(enum AVPixelFormat src_fmt, enum AVPixelFormat dst_fmt) {
+    bool unpack;
+    return find_repack(src_fmt, dst_fmt, &unpack);
+}
+
+static void repack_luma(const RepackKernels* kernels, const RepackDesc* desc, bool unpack, const uint8_t* src,
+                        int src_stride, uint8_t* dst, int dst_stride, int width, int height) {
+    int shift = 16 - desc->depth;
+    bool copy = desc->layout == REPACK_SEMIPLANAR_8 || shift == 0;
+    size_t row_size = (size_t)width * (desc->layout == REPACK_SEMIPLANAR_8 ? 1 : 2);
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src_row = PX_ROW(src, src_stride, y);
+        uint8_t* dst_row = PX_ROW(dst, dst_stride, y);
+
+        if (copy)
+            memcpy(dst_row, src_row, row_size);
+        else if (unpack)
+            kernels->shr_u16((const uint16_t*)src_row, (uint16_t*)dst_row, width, shift);
+        else
+            kernels->shl_u16((const uint16_t*)src_row, (uint16_t*)dst_row, width, shift);
+    }
+}
+
+void px_repack(const uint8_t* const src[4], const int src_stride[4], enum AVPixelFormat src_fmt,
+               uint8_t* const dst[4], const int dst_stride[4], enum AVPixelFormat dst_fmt, int width,
+               int height) {
+    bool unpack = false;
+    const RepackDesc* desc = find_repack(src_fmt, dst_fmt, &unpack);
+    assert(desc);
+
+    const RepackKernels* kernels = get_kernels();
+    const int* order = desc->plane_order;
+
+    if (desc->layout == REPACK_PACKED_4X8) {
+        for (int y = 0; y < height; y++) {
+            if (unpack) {
+                uint8_t* const planes[4] = {PX_ROW(dst[order[0]], dst_stride[order[0]], y),
+                                            PX_ROW(dst[order[1]], dst_stride[order[1]], y),
+                                            PX_ROW(dst[order[2]], dst_stride[order[2]], y),
+                                            PX_ROW(dst[order[3]], dst_stride[order[3]], y)};
+                kernels->deint4_u8(PX_ROW(src[0], src_stride[0], y), planes, width);
+            } else {
+                const uint8_t* const planes[4] = {PX_ROW(src[order[0]], src_stride[order[0]], y),
+                                                  PX_ROW(src[order[1]], src_stride[order[1]], y),
+                                                  PX_ROW(src[order[2]], src_stride[order[2]], y),
+                                                  PX_ROW(src[order[3]], src_stride[order[3]], y)};
+                kernels->int4_u8(planes, PX_ROW(dst[0], dst_stride[0], y), width);
+            }
+        }
+        return;
+    }
+
+    repack_luma(kernels, desc, unpack, src[0], src_stride[0], dst[0], dst_stride[0], width, height);
+
+    int chroma_w = -((-width) >> desc->log2_chroma_w);
+    int chroma_h = -((-height) >> desc->log2_chroma_h);
+    int shift = 16 - desc->depth;
+
+    for (int y = 0; y < chroma_h; y++) {
+        if (unpack) {
+            const uint8_t* src_row = PX_ROW(src[1], src_stride[1], y);
+            uint8_t* dst0 = PX_ROW(dst[order[0]], dst_stride[order[0]], y);
+            uint8_t* dst1 = PX_ROW(dst[order[1]], dst_stride[order[1]], y);
+
+            if (desc->layout == REPACK_SEMIPLANAR_8)
+                kernels->deint2_u8(src_row, dst0, dst1, chroma_w);
+            else
+                kernels->deint2_u16((const uint16_t*)src_row, (uint16_t*)dst0, (uint16_t*)dst1, chroma_w,
+                                    shift);
+        } else {
+            const uint8_t* src0 = PX_ROW(src[order[0]], src_stride[order[0]], y);
+            const uint8_t* src1 = PX_ROW(src[order[1]], src_stride[order[1]], y);
+            uint8_t* dst_row = PX_ROW(dst[1], dst_stride[1], y);
+
+            if (desc->layout == REPACK_SEMIPLANAR_8)
+                kernels->int2_u8(src0, src1, dst_row, chroma_w);
+            else
+                kernels->int2_u16((const uint16_t*)src0, (const uint16_t*)src1, (uint16_t*)dst_row, chroma_w,
+                                  shift);
+        }
+    }
+}
@@ -0,0 +1,373 @@
+#include "internals.h"
+
+#include <pixie/coding.h>
+#include <pixie/util/utils.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mathematics.h>
+
+static int open_input(AVFormatContext** fmt_ctx, const char* file) {
+    int ret = avformat_open_input(fmt_ctx, file, NULL, NULL);
+    if (ret < 0) {
+        LAV_THROW_MSG("avformat_open_input", ret);
+        return ret;
+    }
+
+    ret = avformat_find_stream_info(*fmt_ctx, NULL);
+    if (ret < 0) {
+        LAV_THROW_MSG("avformat_find_stream_info", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+// index of the only video stream, error if there isn't exactly one
+static int find_video_stream(const AVFormatContext* fmt_ctx, const char* file) {
+    int video_idx = -1;
+    for (unsigned i = 0; i < fmt_ctx->nb_streams; i++) {
+        if (fmt_ctx->streams[i]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO)
+            continue;
+
+        if (video_idx >= 0) {
+            px_log(PX_LOG_ERROR, "File \"%s\" has more than one video stream, it can't be split\n", file);
+            return AVERROR(EINVAL);
+        }
+        video_idx = (int)i;
+    }
+
+    if (video_idx < 0) {
+        px_log(PX_LOG_ERROR, "No video streams found in file \"%s\"\n", file);
+        return AVERROR_INVALIDDATA;
+    }
+
+    return video_idx;
+}
+
+typedef struct Keyframes {
+    int64_t* pts;
+    int count;
+    int capacity;
+} Keyframes;
+
+static int add_keyframe(Keyframes* kfs, int64_t pts) {
+    if (kfs->count == kfs->capacity) {
+        int capacity = kfs->capacity ? kfs->capacity * 2 : 256;
+        int64_t* new_pts = realloc(kfs->pts, (size_t)capacity * sizeof *new_pts);
+        if (!new_pts) {
+            px_oom_msg((size_t)capacity * sizeof *new_pts);
+            return PXERROR(ENOMEM);
+        }
+
+        kfs->pts = new_pts;
+        kfs->capacity = capacity;
+    }
+
+    kfs->pts[kfs->count++] = pts;
+    return 0;
+}
+
+int px_find_segments(PXSegment** segments, int* n_found, const char* in_file, int n_segments) {
+    *segments = NULL;
+    *n_found = 0;
+
+    AVFormatContext* ifmt_ctx = NULL;
+    AVPacket* pkt = NULL;
+    Keyframes kfs = {0};
+
+    int ret = open_input(&ifmt_ctx, in_file);
+    if (ret < 0)
+        goto end;
+
+    int video_idx = find_video_stream(ifmt_ctx, in_file);
+    if (video_idx < 0) {
+        ret = video_idx;
+        goto end;
+    }
+
+    // only the video stream's packet timestamps are needed, nothing is decoded
+    for (unsigned i = 0; i < ifmt_ctx->nb_streams; i++) {
+        if ((int)i != video_idx)
+            ifmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    pkt = av_packet_alloc();
+    if (!pkt) {
+        px_oom_msg(sizeof *pkt);
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    int64_t last_pts = AV_NOPTS_VALUE;
+    while ((ret = av_read_frame(ifmt_ctx, pkt)) >= 0) {
+        int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        bool key = pkt->stream_index == video_idx && pkt->flags & AV_PKT_FLAG_KEY;
+        av_packet_unref(pkt);
+
+        if (pts == AV_NOPTS_VALUE)
+            continue;
+        if (last_pts == AV_NOPTS_VALUE || pts > last_pts)
+            last_pts = pts;
+
+        // segments have to be in presentation order
+        if (!key || (kfs.count && pts <= kfs.pts[kfs.count - 1]))
+            continue;
+
+        ret = add_keyframe(&kfs, pts);
+        if (ret < 0)
+            goto end;
+    }
+
+    if (ret != AVERROR_EOF) {
+        LAV_THROW_MSG("av_read_frame", ret);
+        goto end;
+    }
+
+    *segments = malloc((size_t)n_segments * sizeof **segments);
+    if (!*segments) {
+        px_oom_msg((size_t)n_segments * sizeof **segments);
+        ret = PXERROR(ENOMEM);
+        goto end;
+    }
+    PXSegment* segs = *segments;
+
+    // cut at the first keyframe at or after each multiple of the duration / `n_segments`
+    int n_segs = 0;
+    segs[0].start = INT64_MIN;
+    for (int i = 1, kf = 1; i < n_segments && kfs.count > 0; i++) {
+        int64_t target = kfs.pts[0] + av_rescale(last_pts - kfs.pts[0], i, n_segments);
+        while (kf < kfs.count && kfs.pts[kf] < target) {
+            kf++;
+        }
+        if (kf == kfs.count)
+            break;
+
+        segs[n_segs].end = kfs.pts[kf];
+        segs[++n_segs].start = kfs.pts[kf++];
+    }
+    segs[n_segs++].end = INT64_MAX;
+
+    *n_found = n_segs;
+    px_log(PX_LOG_INFO, "Split \"%s\" into %d segment(s) at keyframes\n", in_file, n_segs);
+    ret = 0;
+
+end:
+    px_free(&kfs.pts);
+    av_packet_free(&pkt);
+    avformat_close_input(&ifmt_ctx);
+    return ret;
+}
+
+// reads the video packets of each segment file in turn, as if they were a single file
+typedef struct SegmentReader {
+    const char* const* files;
+    int n_files;
+    int next_file;
+
+    AVFormatContext* fmt_ctx; // of the current file
+    int video_idx;
+
+    // decode timestamp of the last packet read, in the output's time base
+    int64_t last_dts;
+} SegmentReader;
+
+/**
+ * read the next video packet, with timestamps rescaled to `tb`
+ * every segment's encoder starts with its own delay, so the first packets of a segment can have decode
+ * timestamps up to a few frames before the previous segment's last ones. those are moved forward so that the
+ * muxer accepts them
+ */
+static int read_segment_packet(SegmentReader* reader, AVPacket* pkt, AVRational tb) {
+    while (true) {
+        if (!reader->fmt_ctx) {
+            if (reader->next_file == reader->n_files)
+                return AVERROR_EOF;
+
+            const char* file = reader->files[reader->next_file++];
+            int ret = open_input(&reader->fmt_ctx, file);
+            if (ret < 0) {
+                px_log(PX_LOG_ERROR, "Error occurred while processing segment file \"%s\"\n", file);
+                return ret;
+            }
+        }
+
+        int ret = av_read_frame(reader->fmt_ctx, pkt);
+        if (ret == AVERROR_EOF) {
+            avformat_close_input(&reader->fmt_ctx);
+            continue;
+        } else if (ret < 0) {
+            LAV_THROW_MSG("av_read_frame", ret);
+            return ret;
+        }
+
+        if (pkt->stream_index != reader->video_idx) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        av_packet_rescale_ts(pkt, reader->fmt_ctx->streams[pkt->stream_index]->time_base, tb);
+        break;
+    }
+
+    if (pkt->dts != AV_NOPTS_VALUE) {
+        if (reader->last_dts != AV_NOPTS_VALUE && pkt->dts <= reader->last_dts)
+            pkt->dts = reader->last_dts + 1;
+        reader->last_dts = pkt->dts;
+    }
+
+    return 0;
+}
+
+// read the next packet that isn't video, with timestamps rescaled to the output's time base
+static int read_passthrough_packet(AVFormatContext* ifmt_ctx, AVPacket* pkt,
+                                   const AVFormatContext* ofmt_ctx) {
+    int ret = av_read_frame(ifmt_ctx, pkt);
+    if (ret == AVERROR_EOF) {
+        return ret;
+    } else if (ret < 0) {
+        LAV_THROW_MSG("av_read_frame", ret);
+        return ret;
+    }
+
+    av_packet_rescale_ts(pkt, ifmt_ctx->streams[pkt->stream_index]->time_base,
+                         ofmt_ctx->streams[pkt->stream_index]->time_base);
+    return 0;
+}
+
+static int init_concat_output(AVFormatContext** ofmt_ctx, const char* out_file,
+                              const AVFormatContext* ifmt_ctx, const AVFormatContext* seg_ctx,
+                              int video_idx) {
+    int ret = avformat_alloc_output_context2(ofmt_ctx, NULL, NULL, out_file);
+    if (ret < 0) {
+        LAV_THROW_MSG("avformat_alloc_output_context2", ret);
+        return ret;
+    }
+
+    for (unsigned i = 0; i < ifmt_ctx->nb_streams; i++) {
+        AVStream* ostream = avformat_new_stream(*ofmt_ctx, NULL);
+        if (!ostream) {
+            LAV_THROW_MSG("avformat_new_stream", AVERROR(ENOMEM));
+            return AVERROR(ENOMEM);
+        }
+
+        // the encoded video comes from the segments, everything else from the input
+        const AVStream* src = (int)i == video_idx ? seg_ctx->streams[i] : ifmt_ctx->streams[i];
+        ret = avcodec_parameters_copy(ostream->codecpar, src->codecpar);
+        if (ret < 0) {
+            LAV_THROW_MSG("avcodec_parameters_copy", ret);
+            return ret;
+        }
+        ostream->codecpar->codec_tag = 0; // may not be valid in the output's container
+        ostream->time_base = src->time_base;
+    }
+
+    if (!((*ofmt_ctx)->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&(*ofmt_ctx)->pb, out_file, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            LAV_THROW_MSG("avio_open", ret);
+            return ret;
+        }
+    }
+
+    ret = avformat_write_header(*ofmt_ctx, NULL);
+    if (ret < 0) {
+        LAV_THROW_MSG("avformat_write_header", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+int px_concat_segments(const char* out_file, const char* in_file, const char* const* seg_files, int n_segs) {
+    AVFormatContext* ifmt_ctx = NULL;
+    AVFormatContext* ofmt_ctx = NULL;
+    SegmentReader reader = {.files = seg_files, .n_files = n_segs, .last_dts = AV_NOPTS_VALUE};
+    AVPacket* pkts[2] = {av_packet_alloc(), av_packet_alloc()}; // video, passthrough
+    int ret = 0;
+
+    if (!pkts[0] || !pkts[1]) {
+        px_oom_msg(sizeof *pkts[0]);
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = open_input(&ifmt_ctx, in_file);
+    if (ret < 0)
+        goto end;
+
+    reader.video_idx = find_video_stream(ifmt_ctx, in_file);
+    if (reader.video_idx < 0) {
+        ret = reader.video_idx;
+        goto end;
+    }
+    ifmt_ctx->streams[reader.video_idx]->discard = AVDISCARD_ALL;
+
+    // the first segment decides the video stream's parameters, every segment was encoded with the same ones
+    ret = open_input(&reader.fmt_ctx, seg_files[reader.next_file++]);
+    if (ret < 0)
+        goto end;
+
+    ret = init_concat_output(&ofmt_ctx, out_file, ifmt_ctx, reader.fmt_ctx, reader.video_idx);
+    if (ret < 0)
+        goto end;
+
+    AVRational video_tb = ofmt_ctx->streams[reader.video_idx]->time_base;
+    bool has_pkt[2] = {false, false};
+    bool eof[2] = {false, false};
+
+    // interleave by decode timestamp so that the muxer doesn't have to buffer a whole stream
+    while (true) {
+        if (!has_pkt[0] && !eof[0]) {
+            ret = read_segment_packet(&reader, pkts[0], video_tb);
+            if (ret < 0 && ret != AVERROR_EOF)
+                goto end;
+            has_pkt[0] = ret == 0;
+            eof[0] = ret == AVERROR_EOF;
+        }
+        if (!has_pkt[1] && !eof[1]) {
+            ret = read_passthrough_packet(ifmt_ctx, pkts[1], ofmt_ctx);
+            if (ret < 0 && ret != AVERROR_EOF)
+                goto end;
+            has_pkt[1] = ret == 0;
+            eof[1] = ret == AVERROR_EOF;
+        }
+
+        if (!has_pkt[0] && !has_pkt[1])
+            break;
+
+        int next = has_pkt[0] ? 0 : 1;
+        if (has_pkt[0] && has_pkt[1] && pkts[0]->dts != AV_NOPTS_VALUE && pkts[1]->dts != AV_NOPTS_VALUE) {
+            AVRational passthrough_tb = ofmt_ctx->streams[pkts[1]->stream_index]->time_base;
+            if (av_compare_ts(pkts[1]->dts, passthrough_tb, pkts[0]->dts, video_tb) < 0)
+                next = 1;
+        }
+
+        ret = av_interleaved_write_frame(ofmt_ctx, pkts[next]);
+        if (ret < 0) {
+            LAV_THROW_MSG("av_interleaved_write_frame", ret);
+            goto end;
+        }
+        has_pkt[next] = false;
+    }
+
+    ret = av_write_trailer(ofmt_ctx);
+    if (ret < 0)
+        LAV_THROW_MSG("av_write_trailer", ret);
+
+end:
+    av_packet_free(&pkts[0]);
+    av_packet_free(&pkts[1]);
+    avformat_close_input(&reader.fmt_ctx);
+    avformat_close_input(&ifmt_ctx);
+
+    if (ofmt_ctx) {
+        if (!(ofmt_ctx->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&ofmt_ctx->pb);
+        avformat_free_context(ofmt_ctx);
+    }
+
+    if (ret < 0)
+        px_log(PX_LOG_ERROR, "Error occurred while joining the segments of \"%s\"\n", in_file);
+    return ret;
+}
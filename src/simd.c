@@ -0,0 +1,359 @@
+#include "internals.h"
+
+#include <pixie/simd.h>
+
+#include <libavutil/cpu.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+// how components of each depth are stored, see pixie/simd.h
+typedef enum CompKind : uint8_t {
+    COMP_U8,
+    COMP_U16,
+    COMP_F32,
+} CompKind;
+
+static inline CompKind comp_kind(int depth) {
+    return depth <= 8 ? COMP_U8 : depth <= 16 ? COMP_U16 : COMP_F32;
+}
+
+// largest value of an integer component, float components aren't clamped
+static inline float comp_max(int depth) {
+    return depth <= 16 ? (float)((1 << depth) - 1) : 1.0f;
+}
+
+/**
+ * every kernel is written once, as an always inlined body taking the component kind as its last argument
+ * the bodies are then compiled for each instruction set by simd_template.h, called through WITH_KIND()
+ * with the kind as a constant, so the compiler vectorizes a specialized loop for each kind
+ */
+
+#define WITH_KIND(depth, body, ...)              \
+    switch (comp_kind(depth)) {                  \
+        case COMP_U8:                            \
+            body(__VA_ARGS__, COMP_U8);          \
+            break;                               \
+        case COMP_U16:                           \
+            body(__VA_ARGS__, COMP_U16);         \
+            break;                               \
+        case COMP_F32:                           \
+            body(__VA_ARGS__, COMP_F32);         \
+            break;                               \
+    }
+
+[[gnu::always_inline]] static inline float load(const void* row, int i, CompKind kind) {
+    switch (kind) {
+        case COMP_U8:
+            return ((const uint8_t*)row)[i];
+        case COMP_U16:
+            return ((const uint16_t*)row)[i];
+        default:
+            return ((const float*)row)[i];
+    }
+}
+
+[[gnu::always_inline]] static inline void store(void* row, int i, float v, float max, CompKind kind) {
+    if (kind == COMP_F32) {
+        ((float*)row)[i] = v;
+        return;
+    }
+
+    v = v < 0.0f ? 0.0f : v;
+    v = v > max ? max : v;
+    if (kind == COMP_U8)
+        ((uint8_t*)row)[i] = (uint8_t)(v + 0.5f);
+    else
+        ((uint16_t*)row)[i] = (uint16_t)(v + 0.5f);
+}
+
+[[gnu::always_inline]] static inline void add_body(void* dst, const void* a, const void* b, int n, float max,
+                                                   CompKind kind) {
+    for (int i = 0; i < n; i++) {
+        store(dst, i, load(a, i, kind) + load(b, i, kind), max, kind);
+    }
+}
+
+[[gnu::always_inline]] static inline void mul_add_body(void* dst, const void* src, float mul, float add,
+                                                       int n, float max, CompKind kind) {
+    for (int i = 0; i < n; i++) {
+        store(dst, i, load(src, i, kind) * mul + add, max, kind);
+    }
+}
+
+[[gnu::always_inline]] static inline void clamp_body(void* dst, const void* src, float lo, float hi, int n,
+                                                     float max, CompKind kind) {
+    for (int i = 0; i < n; i++) {
+        float v = load(src, i, kind);
+        v = v < lo ? lo : v;
+        v = v > hi ? hi : v;
+        store(dst, i, v, max, kind);
+    }
+}
+
+[[gnu::always_inline]] static inline void blend_body(void* dst, const void* a, const void* b, float weight,
+                                                     int n, float max, CompKind kind) {
+    for (int i = 0; i < n; i++) {
+        float va = load(a, i, kind);
+        store(dst, i, va + (load(b, i, kind) - va) * weight, max, kind);
+    }
+}
+
+[[gnu::always_inline]] static inline void convert_body(void* dst, const void* src, int n, float scale,
+                                                       float max, CompKind dst_kind, CompKind src_kind) {
+    for (int i = 0; i < n; i++) {
+        store(dst, i, load(src, i, src_kind) * scale, max, dst_kind);
+    }
+}
+
+// dst = sum of each row of `rows` times its tap
+[[gnu::always_inline]] static inline void conv_v_body(float* dst, const void* const* rows,
+                                                      const float* kernel, int taps, int n, CompKind kind) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = kernel[0] * load(rows[0], i, kind);
+    }
+    for (int t = 1; t < taps; t++) {
+        const void* row = rows[t];
+        float k = kernel[t];
+        for (int i = 0; i < n; i++) {
+            dst[i] += k * load(row, i, kind);
+        }
+    }
+}
+
+// `src` has `taps` - 1 more values than `dst`, `acc` is scratch space for `n` values
+[[gnu::always_inline]] static inline void conv_h_body(void* dst, float* acc, const float* src,
+                                                      const float* kernel, int taps, int n, float max,
+                                                      CompKind kind) {
+    for (int i = 0; i < n; i++) {
+        acc[i] = kernel[0] * src[i];
+    }
+    for (int t = 1; t < taps; t++) {
+        float k = kernel[t];
+        for (int i = 0; i < n; i++) {
+            acc[i] += k * src[i + t];
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        store(dst, i, acc[i], max, kind);
+    }
+}
+
+// slide the column sums of a box blur down by a row
+[[gnu::always_inline]] static inline void box_v_body(float* sums, const void* add_row, const void* sub_row,
+                                                     int n, CompKind kind) {
+    for (int i = 0; i < n; i++) {
+        sums[i] += load(add_row, i, kind) - load(sub_row, i, kind);
+    }
+}
+
+typedef struct SimdKernels {
+    const char* name;
+    void (*add)(void* dst, const void* a, const void* b, int n, int depth);
+    void (*mul_add)(void* dst, const void* src, float mul, float add, int n, int depth);
+    void (*clamp)(void* dst, const void* src, float lo, float hi, int n, int depth);
+    void (*blend)(void* dst, const void* a, const void* b, float weight, int n, int depth);
+    void (*convert)(void* dst, int dst_depth, const void* src, int src_depth, int n);
+    void (*conv_v)(float* dst, const void* const* rows, const float* kernel, int taps, int n, int depth);
+    void (*conv_h)(void* dst, float* acc, const float* src, const float* kernel, int taps, int n, int depth);
+    void (*box_v)(float* sums, const void* add_row, const void* sub_row, int n, int depth);
+} SimdKernels;
+
+#define SIMD_ISA c
+#define SIMD_TARGET
+#include "simd_template.h"
+
+#ifdef PX_ARCH_X86
+
+#define SIMD_ISA avx2
+#define SIMD_TARGET [[gnu::target("avx2")]]
+#include "simd_template.h"
+
+#define SIMD_ISA avx512
+#define SIMD_TARGET [[gnu::target("avx512f,avx512bw,avx512cd,avx512dq,avx512vl")]]
+#include "simd_template.h"
+
+#endif // PX_ARCH_X86
+
+// AArch64 always has NEON, so the compiler already uses it for the C kernels
+static const SimdKernels* get_kernels(void) {
+    [[maybe_unused]] int cpu_flags = px_cpu_flags();
+
+#ifdef PX_ARCH_X86
+    if (cpu_flags & PX_CPU_AVX512)
+        return &kernels_avx512;
+    if (cpu_flags & PX_CPU_AVX2)
+        return &kernels_avx2;
+#endif
+
+    return &kernels_c;
+}
+
+int px_cpu_flags(void) {
+    [[maybe_unused]] int av_flags = av_get_cpu_flags();
+    int flags = 0;
+
+    // libavutil's flags mean different things on each architecture
+#ifdef PX_ARCH_X86
+    if (av_flags & AV_CPU_FLAG_SSE4)
+        flags |= PX_CPU_SSE4;
+    if (av_flags & AV_CPU_FLAG_AVX2)
+        flags |= PX_CPU_AVX2;
+    if (av_flags & AV_CPU_FLAG_AVX512)
+        flags |= PX_CPU_AVX512;
+#elif defined(__aarch64__) || defined(__arm__)
+    if (av_flags & AV_CPU_FLAG_NEON)
+        flags |= PX_CPU_NEON;
+#endif
+
+    return flags;
+}
+
+const char* px_simd_impl_name(void) {
+    return get_kernels()->name;
+}
+
+void px_row_add(void* dst, const void* a, const void* b, int n, int depth) {
+    get_kernels()->add(dst, a, b, n, depth);
+}
+
+void px_row_mul_add(void* dst, const void* src, float mul, float add, int n, int depth) {
+    get_kernels()->mul_add(dst, src, mul, add, n, depth);
+}
+
+void px_row_clamp(void* dst, const void* src, float lo, float hi, int n, int depth) {
+    get_kernels()->clamp(dst, src, lo, hi, n, depth);
+}
+
+void px_row_blend(void* dst, const void* a, const void* b, float weight, int n, int depth) {
+    get_kernels()->blend(dst, a, b, weight, n, depth);
+}
+
+void px_row_convert(void* dst, int dst_depth, const void* src, int src_depth, int n) {
+    get_kernels()->convert(dst, dst_depth, src, src_depth, n);
+}
+
+// histograms don't vectorize, every value is a read-modify-write of a bin that may repeat
+void px_row_histogram(uint32_t* hist, const void* src, int n, int depth) {
+    switch (comp_kind(depth)) {
+        case COMP_U8:
+            for (int i = 0; i < n; i++) {
+                hist[((const uint8_t*)src)[i]]++;
+            }
+            break;
+        case COMP_U16: {
+            int mask = (1 << depth) - 1;
+            for (int i = 0; i < n; i++) {
+                hist[((const uint16_t*)src)[i] & mask]++;
+            }
+            break;
+        }
+        case COMP_F32:
+            for (int i = 0; i < n; i++) {
+                float v = ((const float*)src)[i];
+                v = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+                hist[(int)(v * 65535.0f + 0.5f)]++;
+            }
+            break;
+    }
+}
+
+static inline const uint8_t* clamped_row(const PXVideoPlane* plane, int y) {
+    return PX_ROW(plane->data, plane->stride, y < 0 ? 0 : y >= plane->height ? plane->height - 1 : y);
+}
+
+// repeat the edges of a row of `width` values into the `radius` values before and after it
+static void pad_row(float* row, int width, int radius) {
+    for (int i = 0; i < radius; i++) {
+        row[i] = row[radius];
+        row[radius + width + i] = row[radius + width - 1];
+    }
+}
+
+int px_plane_convolve(PXVideoPlane* dst, const PXVideoPlane* src, int depth, const float* kernel_h,
+                      const float* kernel_v, int radius, int y_start, int y_end) {
+    assert(dst->data != src->data);
+    const SimdKernels* kernels = get_kernels();
+    int width = src->width;
+    int taps = 2 * radius + 1;
+
+    // the vertically filtered row, padded by `radius` on each side, then the horizontal sums
+    size_t size = (size_t)(2 * width + 2 * radius) * sizeof(float);
+    float* tmp = malloc(size);
+    if (!tmp) {
+        px_oom_msg(size);
+        return PXERROR(ENOMEM);
+    }
+    float* acc = tmp + width + 2 * radius;
+
+    const void* rows[taps];
+    for (int y = y_start; y < y_end; y++) {
+        for (int t = 0; t < taps; t++) {
+            rows[t] = clamped_row(src, y + t - radius);
+        }
+
+        kernels->conv_v(tmp + radius, rows, kernel_v, taps, width, depth);
+        pad_row(tmp, width, radius);
+        kernels->conv_h(PX_ROW(dst->data, dst->stride, y), acc, tmp, kernel_h, taps, width, depth);
+    }
+
+    px_free(&tmp);
+    return 0;
+}
+
+// the running sum of `taps` column sums, for each value of the row
+[[gnu::always_inline]] static inline void box_h_body(void* dst, const float* sums, int taps, int n,
+                                                     float scale, float max, CompKind kind) {
+    float sum = 0.0f;
+    for (int t = 0; t < taps; t++) {
+        sum += sums[t];
+    }
+
+    for (int i = 0; i < n; i++) {
+        store(dst, i, sum * scale, max, kind);
+        if (i + 1 < n)
+            sum += sums[i + taps] - sums[i];
+    }
+}
+
+int px_plane_box_blur(PXVideoPlane* dst, const PXVideoPlane* src, int depth, int radius, int y_start,
+                      int y_end) {
+    assert(dst->data != src->data);
+    const SimdKernels* kernels = get_kernels();
+    int width = src->width;
+    int taps = 2 * radius + 1;
+    float scale = 1.0f / (float)(taps * taps);
+    float max = comp_max(depth);
+
+    // sums of the `taps` rows around the current one for each column, padded by `radius` on each side
+    size_t size = (size_t)(width + 2 * radius) * sizeof(float);
+    float* sums = malloc(size);
+    if (!sums) {
+        px_oom_msg(size);
+        return PXERROR(ENOMEM);
+    }
+
+    const void* rows[taps];
+    float ones[taps];
+    for (int t = 0; t < taps; t++) {
+        rows[t] = clamped_row(src, y_start + t - radius);
+        ones[t] = 1.0f;
+    }
+    kernels->conv_v(sums + radius, rows, ones, taps, width, depth);
+
+    for (int y = y_start; y < y_end; y++) {
+        pad_row(sums, width, radius);
+        WITH_KIND(depth, box_h_body, PX_ROW(dst->data, dst->stride, y), sums, taps, width, scale, max);
+
+        if (y + 1 < y_end) {
+            const void* add_row = clamped_row(src, y + radius + 1);
+            const void* sub_row = clamped_row(src, y - radius);
+            kernels->box_v(sums + radius, add_row, sub_row, width, depth);
+        }
+    }
+
+    px_free(&sums);
+    return 0;
+}
@@ -0,0 +1,84 @@
+// compiles the kernel bodies of simd.c for one instruction set, included once for each
+// simd.c defines SIMD_ISA (the suffix of the kernels' names) and SIMD_TARGET (their attributes) first
+
+#define SIMD_CAT2(a, b) a##_##b
+#define SIMD_CAT(a, b) SIMD_CAT2(a, b)
+#define SIMD_FN(name) SIMD_CAT(name, SIMD_ISA)
+#define SIMD_STR2(x) #x
+#define SIMD_STR(x) SIMD_STR2(x)
+
+SIMD_TARGET static void SIMD_FN(add)(void* dst, const void* a, const void* b, int n, int depth) {
+    WITH_KIND(depth, add_body, dst, a, b, n, comp_max(depth));
+}
+
+SIMD_TARGET static void SIMD_FN(mul_add)(void* dst, const void* src, float mul, float add, int n, int depth) {
+    WITH_KIND(depth, mul_add_body, dst, src, mul, add, n, comp_max(depth));
+}
+
+SIMD_TARGET static void SIMD_FN(clamp)(void* dst, const void* src, float lo, float hi, int n, int depth) {
+    WITH_KIND(depth, clamp_body, dst, src, lo, hi, n, comp_max(depth));
+}
+
+SIMD_TARGET static void SIMD_FN(blend)(void* dst, const void* a, const void* b, float weight, int n,
+                                       int depth) {
+    WITH_KIND(depth, blend_body, dst, a, b, weight, n, comp_max(depth));
+}
+
+SIMD_TARGET static void SIMD_FN(convert)(void* dst, int dst_depth, const void* src, int src_depth, int n) {
+    // float components are in [0, 1], integer ones are shifted
+    float scale = 1.0f;
+    if (comp_kind(dst_depth) == COMP_F32 && comp_kind(src_depth) != COMP_F32)
+        scale = 1.0f / comp_max(src_depth);
+    else if (comp_kind(dst_depth) != COMP_F32 && comp_kind(src_depth) == COMP_F32)
+        scale = comp_max(dst_depth);
+    else if (comp_kind(dst_depth) != COMP_F32)
+        scale = ldexpf(1.0f, dst_depth - src_depth);
+
+    float max = comp_max(dst_depth);
+    switch (comp_kind(dst_depth)) {
+        case COMP_U8:
+            WITH_KIND(src_depth, convert_body, dst, src, n, scale, max, COMP_U8);
+            break;
+        case COMP_U16:
+            WITH_KIND(src_depth, convert_body, dst, src, n, scale, max, COMP_U16);
+            break;
+        case COMP_F32:
+            WITH_KIND(src_depth, convert_body, dst, src, n, scale, max, COMP_F32);
+            break;
+    }
+}
+
+SIMD_TARGET static void SIMD_FN(conv_v)(float* dst, const void* const* rows, const float* kernel, int taps,
+                                        int n, int depth) {
+    WITH_KIND(depth, conv_v_body, dst, rows, kernel, taps, n);
+}
+
+SIMD_TARGET static void SIMD_FN(conv_h)(void* dst, float* acc, const float* src, const float* kernel,
+                                        int taps, int n, int depth) {
+    WITH_KIND(depth, conv_h_body, dst, acc, src, kernel, taps, n, comp_max(depth));
+}
+
+SIMD_TARGET static void SIMD_FN(box_v)(float* sums, const void* add_row, const void* sub_row, int n,
+                                       int depth) {
+    WITH_KIND(depth, box_v_body, sums, add_row, sub_row, n);
+}
+
+static const SimdKernels SIMD_FN(kernels) = {
+    .name = SIMD_STR(SIMD_ISA),
+    .add = SIMD_FN(add),
+    .mul_add = SIMD_FN(mul_add),
+    .clamp = SIMD_FN(clamp),
+    .blend = SIMD_FN(blend),
+    .convert = SIMD_FN(convert),
+    .conv_v = SIMD_FN(conv_v),
+    .conv_h = SIMD_FN(conv_h),
+    .box_v = SIMD_FN(box_v),
+};
+
+#undef SIMD_CAT2
+#undef SIMD_CAT
+#undef SIMD_FN
+#undef SIMD_STR2
+#undef SIMD_STR
+#undef SIMD_ISA
+#undef SIMD_TARGET
@@ -0,0 +1,171 @@
+#include "internals.h"
+
+#include <pixie/stats.h>
+
+#include <stdlib.h>
+#include <errno.h>
+
+typedef struct QueueStats {
+    atomic_int capacity;
+    atomic_int max_len;
+    atomic_uint_fast64_t pushes;
+    atomic_uint_fast64_t total_len;
+} QueueStats;
+
+struct PXStats {
+    PXStageStats stages[PX_STAGE_COUNT];
+    QueueStats queues[PX_QUEUE_COUNT];
+
+    PXStageStats* filters;
+    int n_filters;
+
+    bool has_cpu_time; // px_thread_cpu_time_ns() works on this platform
+};
+
+static const char* const stage_names[PX_STAGE_COUNT] = {
+    [PX_STAGE_DEMUX] = "demux",
+    [PX_STAGE_DECODE] = "decode",
+    [PX_STAGE_IMPORT] = "import",
+    [PX_STAGE_EXPORT] = "export",
+    [PX_STAGE_ENCODE] = "encode",
+    [PX_STAGE_MUX] = "mux",
+};
+
+static const char* const queue_names[PX_QUEUE_COUNT] = {
+    [PX_QUEUE_PACKETS] = "packets",
+    [PX_QUEUE_DECODED] = "decoded",
+    [PX_QUEUE_FILTERED] = "filtered",
+};
+
+PXStats* px_stats_alloc(int n_filters) {
+    PXStats* stats = calloc(1, sizeof *stats);
+    if (!stats) {
+        px_oom_msg(sizeof *stats);
+        return NULL;
+    }
+
+    if (n_filters > 0) {
+        stats->filters = calloc((size_t)n_filters, sizeof *stats->filters);
+        if (!stats->filters) {
+            px_oom_msg((size_t)n_filters * sizeof *stats->filters);
+            px_free(&stats);
+            return NULL;
+        }
+        stats->n_filters = n_filters;
+    }
+
+    stats->has_cpu_time = px_thread_cpu_time_ns() >= 0;
+    return stats;
+}
+
+void px_stats_free(PXStats** stats) {
+    if (!stats || !*stats)
+        return;
+
+    px_free(&(*stats)->filters);
+    px_free(stats);
+}
+
+int px_stats_num_stages(void) {
+    return PX_STAGE_COUNT;
+}
+
+int px_stats_num_queues(void) {
+    return PX_QUEUE_COUNT;
+}
+
+int px_stats_num_filters(const PXStats* stats) {
+    return stats->n_filters;
+}
+
+const char* px_stage_name(PXStage stage) {
+    return stage >= 0 && stage < PX_STAGE_COUNT ? stage_names[stage] : NULL;
+}
+
+const char* px_queue_name(PXQueueKind queue) {
+    return queue >= 0 && queue < PX_QUEUE_COUNT ? queue_names[queue] : NULL;
+}
+
+static void get_stage_time(const PXStats* stats, const PXStageStats* entry, PXStageTime* dest) {
+    *dest = (PXStageTime) {
+        .calls = entry->calls,
+        .wall_ns = entry->wall_ns,
+        .cpu_ns = stats->has_cpu_time ? entry->cpu_ns : -1,
+    };
+}
+
+int px_stats_get_stage(const PXStats* stats, PXStage stage, PXStageTime* dest) {
+    if (stage < 0 || stage >= PX_STAGE_COUNT)
+        return PXERROR(EINVAL);
+
+    get_stage_time(stats, &stats->stages[stage], dest);
+    return 0;
+}
+
+int px_stats_get_filter(const PXStats* stats, int filter_idx, PXStageTime* dest) {
+    if (filter_idx < 0 || filter_idx >= stats->n_filters)
+        return PXERROR(EINVAL);
+
+    get_stage_time(stats, &stats->filters[filter_idx], dest);
+    return 0;
+}
+
+int px_stats_get_queue(const PXStats* stats, PXQueueKind queue, PXQueueUsage* dest) {
+    if (queue < 0 || queue >= PX_QUEUE_COUNT)
+        return PXERROR(EINVAL);
+
+    const QueueStats* qs = &stats->queues[queue];
+    *dest = (PXQueueUsage) {
+        .capacity = qs->capacity,
+        .max_len = qs->max_len,
+        .pushes = qs->pushes,
+        .total_len = qs->total_len,
+    };
+    return 0;
+}
+
+PXStatsTimer px_stats_timer_start(void) {
+    return (PXStatsTimer) {.wall_ns = px_time_ns(), .cpu_ns = px_thread_cpu_time_ns()};
+}
+
+PXStageStats* px_stats_stage(PXStats* stats, PXStage stage) {
+    return stats ? &stats->stages[stage] : NULL;
+}
+
+PXStageStats* px_stats_filter(PXStats* stats, int filter_idx) {
+    return stats && filter_idx < stats->n_filters ? &stats->filters[filter_idx] : NULL;
+}
+
+void px_stats_add_wall(PXStageStats* entry, PXStatsTimer start, int calls) {
+    if (!entry)
+        return;
+
+    entry->wall_ns += px_time_ns() - start.wall_ns;
+    entry->calls += (uint_fast64_t)calls;
+}
+
+void px_stats_add_cpu(PXStageStats* entry, PXStatsTimer start) {
+    if (!entry || start.cpu_ns < 0)
+        return;
+
+    entry->cpu_ns += px_thread_cpu_time_ns() - start.cpu_ns;
+}
+
+void px_stats_add(PXStageStats* entry, PXStatsTimer start, int calls) {
+    px_stats_add_wall(entry, start, calls);
+    px_stats_add_cpu(entry, start);
+}
+
+void px_stats_queue_pushed(PXStats* stats, PXQueueKind queue, int len, int capacity) {
+    if (!stats)
+        return;
+
+    QueueStats* qs = &stats->queues[queue];
+    qs->capacity = capacity;
+    qs->pushes++;
+    qs->total_len += (uint_fast64_t)len;
+
+    int max_len = qs->max_len;
+    while (len > max_len && !atomic_compare_exchange_weak(&qs->max_len, &max_len, len)) {
+    }
+}
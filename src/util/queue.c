@@ -0,0 +1,159 @@
+#include <pixie/util/queue.h>
+#include <pixie/util/utils.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+int px_queue_init(PXQueue* queue, size_t elem_size, int capacity) {
+    assert(elem_size > 0);
+    assert(capacity > 0);
+
+    *queue = (PXQueue) {
+        .elem_size = elem_size,
+        .capacity = capacity,
+    };
+
+    size_t elems_size = elem_size * (size_t)capacity;
+    queue->elems = malloc(elems_size);
+    if (!queue->elems) {
+        px_oom_msg(elems_size);
+        return PXERROR(ENOMEM);
+    }
+
+    int ret = px_mutex_init(&queue->lock);
+    if (ret != 0)
+        goto fail_lock;
+
+    ret = px_cond_init(&queue->not_empty);
+    if (ret != 0)
+        goto fail_not_empty;
+
+    ret = px_cond_init(&queue->not_full);
+    if (ret != 0)
+        goto fail_not_full;
+
+    return 0;
+
+fail_not_full:
+    px_cond_destroy(&queue->not_empty);
+fail_not_empty:
+    px_mutex_destroy(&queue->lock);
+fail_lock:
+    px_free(&queue->elems);
+    return PXERROR(EAGAIN);
+}
+
+void px_queue_free(PXQueue* queue) {
+    if (!queue || !queue->elems)
+        return;
+
+    px_cond_destroy(&queue->not_full);
+    px_cond_destroy(&queue->not_empty);
+    px_mutex_destroy(&queue->lock);
+    px_free(&queue->elems);
+}
+
+static inline uint8_t* elem_at(PXQueue* queue, int idx) {
+    return queue->elems + (size_t)(idx % queue->capacity) * queue->elem_size;
+}
+
+// assumes `queue->lock` is held and the queue is not full
+static void push_locked(PXQueue* queue, const void* elem) {
+    memcpy(elem_at(queue, queue->head + queue->len), elem, queue->elem_size);
+    queue->len++;
+
+    px_cond_signal(&queue->not_empty);
+}
+
+int px_queue_push(PXQueue* queue, const void* elem) {
+    px_mutex_lock(&queue->lock);
+
+    while (queue->len == queue->capacity && !queue->aborted) {
+        px_cond_wait(&queue->not_full, &queue->lock);
+    }
+    if (queue->aborted) {
+        px_mutex_unlock(&queue->lock);
+        return PXERROR(EPIPE);
+    }
+
+    push_locked(queue, elem);
+
+    px_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+int px_queue_try_push(PXQueue* queue, const void* elem) {
+    px_mutex_lock(&queue->lock);
+
+    if (queue->aborted) {
+        px_mutex_unlock(&queue->lock);
+        return PXERROR(EPIPE);
+    }
+    if (queue->len == queue->capacity) {
+        px_mutex_unlock(&queue->lock);
+        return PXERROR(EAGAIN);
+    }
+
+    push_locked(queue, elem);
+
+    px_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+// assumes `queue->lock` is held and the queue is not empty
+static void pop_locked(PXQueue* queue, void* dest) {
+    memcpy(dest, elem_at(queue, queue->head), queue->elem_size);
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->len--;
+
+    px_cond_signal(&queue->not_full);
+}
+
+int px_queue_pop(PXQueue* queue, void* dest) {
+    px_mutex_lock(&queue->lock);
+
+    while (queue->len == 0 && !queue->aborted) {
+        px_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->aborted) {
+        px_mutex_unlock(&queue->lock);
+        return PXERROR(EPIPE);
+    }
+
+    pop_locked(queue, dest);
+
+    px_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+int px_queue_try_pop(PXQueue* queue, void* dest) {
+    px_mutex_lock(&queue->lock);
+
+    if (queue->len == 0) {
+        px_mutex_unlock(&queue->lock);
+        return PXERROR(EAGAIN);
+    }
+
+    pop_locked(queue, dest);
+
+    px_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+void px_queue_abort(PXQueue* queue) {
+    px_mutex_lock(&queue->lock);
+
+    queue->aborted = true;
+    px_cond_broadcast(&queue->not_empty);
+    px_cond_broadcast(&queue->not_full);
+
+    px_mutex_unlock(&queue->lock);
+}
+
+int px_queue_len(PXQueue* queue) {
+    px_mutex_lock(&queue->lock);
+    int len = queue->len;
+    px_mutex_unlock(&queue->lock);
+    return len;
+}
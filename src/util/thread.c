@@ -4,6 +4,7 @@
 #include <pixie/util/thread.h>
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #ifdef PX_THREADS_C11
@@ -30,6 +31,7 @@ static inline const char* c11_thrd_strerror(int err) {
 
 int px_thrd_launch(PXThread* thread) {
     assert(thread->func);
+    thread->done = false;
 
 #ifdef PX_THREADS_C11
     int res = thrd_create(&thread->thrd, thread->func, thread->args);
@@ -113,3 +115,418 @@ void px_thrd_exit(int ret) {
     pthread_exit((void*)(intptr_t)ret);
 #endif
 }
+
+int px_mutex_init(PXMutex* mutex) {
+#ifdef PX_THREADS_C11
+    int res = mtx_init(mutex, mtx_plain);
+    if (res != thrd_success)
+        CTHRD_THROW_MSG("mtx_init", res);
+    return res;
+#endif
+#ifdef PX_THREADS_WIN32
+    InitializeCriticalSection(mutex);
+    return 0;
+#endif
+#ifdef PX_THREADS_POSIX
+    int res = pthread_mutex_init(mutex, NULL);
+    if (res != 0)
+        OS_THROW_MSG("pthread_mutex_init", res);
+    return res;
+#endif
+}
+
+void px_mutex_destroy(PXMutex* mutex) {
+#ifdef PX_THREADS_C11
+    mtx_destroy(mutex);
+#endif
+#ifdef PX_THREADS_WIN32
+    DeleteCriticalSection(mutex);
+#endif
+#ifdef PX_THREADS_POSIX
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void px_mutex_lock(PXMutex* mutex) {
+#ifdef PX_THREADS_C11
+    mtx_lock(mutex);
+#endif
+#ifdef PX_THREADS_WIN32
+    EnterCriticalSection(mutex);
+#endif
+#ifdef PX_THREADS_POSIX
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void px_mutex_unlock(PXMutex* mutex) {
+#ifdef PX_THREADS_C11
+    mtx_unlock(mutex);
+#endif
+#ifdef PX_THREADS_WIN32
+    LeaveCriticalSection(mutex);
+#endif
+#ifdef PX_THREADS_POSIX
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+int px_cond_init(PXCond* cond) {
+#ifdef PX_THREADS_C11
+    int res = cnd_init(cond);
+    if (res != thrd_success)
+        CTHRD_THROW_MSG("cnd_init", res);
+    return res;
+#endif
+#ifdef PX_THREADS_WIN32
+    InitializeConditionVariable(cond);
+    return 0;
+#endif
+#ifdef PX_THREADS_POSIX
+    int res = pthread_cond_init(cond, NULL);
+    if (res != 0)
+        OS_THROW_MSG("pthread_cond_init", res);
+    return res;
+#endif
+}
+
+void px_cond_destroy(PXCond* cond) {
+#ifdef PX_THREADS_C11
+    cnd_destroy(cond);
+#endif
+#ifdef PX_THREADS_WIN32
+    (void)cond; // nothing to free
+#endif
+#ifdef PX_THREADS_POSIX
+    pthread_cond_destroy(cond);
+#endif
+}
+
+void px_cond_wait(PXCond* cond, PXMutex* mutex) {
+#ifdef PX_THREADS_C11
+    cnd_wait(cond, mutex);
+#endif
+#ifdef PX_THREADS_WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#endif
+#ifdef PX_THREADS_POSIX
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void px_cond_signal(PXCond* cond) {
+#ifdef PX_THREADS_C11
+    cnd_signal(cond);
+#endif
+#ifdef PX_THREADS_WIN32
+    WakeConditionVariable(cond);
+#endif
+#ifdef PX_THREADS_POSIX
+    pthread_cond_signal(cond);
+#endif
+}
+
+void px_cond_broadcast(PXCond* cond) {
+#ifdef PX_THREADS_C11
+    cnd_broadcast(cond);
+#endif
+#ifdef PX_THREADS_WIN32
+    WakeAllConditionVariable(cond);
+#endif
+#ifdef PX_THREADS_POSIX
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+typedef struct PoolWorker {
+    PXThread thread;
+    PXThreadPool* pool;
+    int idx;
+} PoolWorker;
+
+/**
+ * the jobs of a px_thrd_pool_run() call, split into a contiguous range for each thread of the pool
+ * each thread runs the jobs of its own range first, then steals the back half of the largest range left,
+ * so slow or busy threads don't hold up the others and neighbouring jobs mostly stay on the same thread
+ */
+typedef struct PoolBatch {
+    PXPoolJobFunc func;
+    void* ctx;
+    _Atomic uint64_t* ranges; // [begin, end) of each thread's jobs, packed as begin << 32 | end
+    int n_ranges;
+
+    atomic_int ret;
+    atomic_bool exhausted; // every job has been taken, some may still be running
+
+    // guarded by the pool's lock
+    int n_helpers; // threads other than the caller running jobs of the batch
+    struct PoolBatch* next;
+} PoolBatch;
+
+struct PXThreadPool {
+    PoolWorker* workers;
+    int n_threads;
+
+    PXMutex run_lock; // held by threads outside of the pool while their px_thrd_pool_run() call runs
+
+    PXMutex lock; // guards everything below
+    PXCond work_cond; // signaled when jobs are posted or the pool is shutting down
+    PXCond done_cond; // signaled when a batch's last helper is done with it
+
+    PoolBatch* batches; // batches being run, most recently posted first
+    bool shutdown;
+};
+
+// the pool the current thread is running jobs for and its index in it, NULL outside of jobs
+static _Thread_local PXThreadPool* cur_pool;
+static _Thread_local int cur_thread_idx;
+
+static inline uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return (uint64_t)begin << 32 | end;
+}
+
+// take the first job of `range`, -1 if it's empty
+static int range_pop(_Atomic uint64_t* range) {
+    uint64_t r = atomic_load(range);
+    while ((uint32_t)(r >> 32) < (uint32_t)r) {
+        uint32_t begin = (uint32_t)(r >> 32);
+        if (atomic_compare_exchange_weak(range, &r, pack_range(begin + 1, (uint32_t)r)))
+            return (int)begin;
+    }
+    return -1;
+}
+
+// move the back half of the largest range of `batch` into the empty range `own`, false if all are empty
+static bool range_steal(PoolBatch* batch, _Atomic uint64_t* own) {
+    while (true) {
+        int victim = -1;
+        uint64_t victim_range = 0;
+        uint32_t most = 0;
+        for (int i = 0; i < batch->n_ranges; i++) {
+            uint64_t r = atomic_load(&batch->ranges[i]);
+            uint32_t begin = (uint32_t)(r >> 32);
+            uint32_t end = (uint32_t)r;
+            if (begin < end && end - begin > most) {
+                victim = i;
+                victim_range = r;
+                most = end - begin;
+            }
+        }
+        if (victim < 0)
+            return false;
+
+        uint32_t begin = (uint32_t)(victim_range >> 32);
+        uint32_t end = (uint32_t)victim_range;
+        uint32_t mid = end - (most + 1) / 2;
+        // fails if the owner or another thief got to it first
+        if (atomic_compare_exchange_strong(&batch->ranges[victim], &victim_range, pack_range(begin, mid))) {
+            atomic_store(own, pack_range(mid, end));
+            return true;
+        }
+    }
+}
+
+// run jobs of `batch` until there are none left to take
+static void batch_run(PoolBatch* batch, int thread_idx) {
+    _Atomic uint64_t* own = &batch->ranges[thread_idx];
+
+    while (true) {
+        int job_idx = range_pop(own);
+        if (job_idx < 0) {
+            if (!range_steal(batch, own))
+                break;
+            continue;
+        }
+
+        int ret = batch->func(batch->ctx, job_idx, thread_idx);
+        if (ret < 0) {
+            int expected = 0;
+            atomic_compare_exchange_strong(&batch->ret, &expected, ret);
+        }
+    }
+
+    atomic_store(&batch->exhausted, true);
+}
+
+// the most recently posted batch with jobs left to take, assumes `pool->lock` is held
+static PoolBatch* pool_find_batch(PXThreadPool* pool) {
+    for (PoolBatch* batch = pool->batches; batch; batch = batch->next) {
+        if (!atomic_load(&batch->exhausted))
+            return batch;
+    }
+    return NULL;
+}
+
+static int pool_worker_main(PoolWorker* worker) {
+    PXThreadPool* pool = worker->pool;
+    cur_pool = pool;
+    cur_thread_idx = worker->idx;
+
+    px_mutex_lock(&pool->lock);
+    while (true) {
+        PoolBatch* batch = NULL;
+        while (!pool->shutdown && !(batch = pool_find_batch(pool))) {
+            px_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        if (pool->shutdown)
+            break;
+
+        batch->n_helpers++;
+        px_mutex_unlock(&pool->lock);
+
+        batch_run(batch, worker->idx);
+
+        px_mutex_lock(&pool->lock);
+        if (--batch->n_helpers == 0)
+            px_cond_broadcast(&pool->done_cond);
+    }
+    px_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+int px_thrd_pool_new(PXThreadPool** pool, int n_threads) {
+    assert(n_threads > 0);
+
+    *pool = calloc(1, sizeof **pool);
+    if (!*pool) {
+        px_oom_msg(sizeof **pool);
+        return PXERROR(ENOMEM);
+    }
+    PXThreadPool* ppool = *pool;
+
+    int ret = 0;
+    if (px_mutex_init(&ppool->run_lock) != 0 || px_mutex_init(&ppool->lock) != 0 ||
+        px_cond_init(&ppool->work_cond) != 0 || px_cond_init(&ppool->done_cond) != 0) {
+        ret = PXERROR(EAGAIN);
+        goto fail;
+    }
+
+    // the thread calling px_thrd_pool_run() is thread 0
+    size_t workers_size = (size_t)(n_threads - 1) * sizeof *ppool->workers;
+    if (workers_size) {
+        ppool->workers = calloc(1, workers_size);
+        if (!ppool->workers) {
+            px_oom_msg(workers_size);
+            ret = PXERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+    ppool->n_threads = 1;
+    for (int i = 1; i < n_threads; i++) {
+        PoolWorker* worker = &ppool->workers[i - 1];
+        *worker = (PoolWorker) {
+            .thread = {.func = (PXThreadFunc)pool_worker_main, .args = worker},
+            .pool = ppool,
+            .idx = i,
+        };
+
+        if (px_thrd_launch(&worker->thread) != 0) {
+            ret = PXERROR(EAGAIN);
+            goto fail;
+        }
+        ppool->n_threads++;
+    }
+
+    return 0;
+
+fail:
+    px_thrd_pool_free(pool);
+    return ret;
+}
+
+void px_thrd_pool_free(PXThreadPool** pool) {
+    if (!pool || !*pool)
+        return;
+    PXThreadPool* ppool = *pool;
+
+    px_mutex_lock(&ppool->lock);
+    ppool->shutdown = true;
+    px_cond_broadcast(&ppool->work_cond);
+    px_mutex_unlock(&ppool->lock);
+
+    for (int i = 0; i < ppool->n_threads - 1; i++) {
+        int ret;
+        px_thrd_join(&ppool->workers[i].thread, &ret);
+    }
+
+    px_cond_destroy(&ppool->done_cond);
+    px_cond_destroy(&ppool->work_cond);
+    px_mutex_destroy(&ppool->lock);
+    px_mutex_destroy(&ppool->run_lock);
+
+    px_free(&ppool->workers);
+    px_free(pool);
+}
+
+int px_thrd_pool_num_threads(const PXThreadPool* pool) {
+    return pool->n_threads;
+}
+
+// post `n_jobs` jobs to every thread of the pool and run them along with it as `thread_idx`
+static int pool_run_batch(PXThreadPool* pool, PXPoolJobFunc func, void* ctx, int n_jobs, int thread_idx) {
+    _Atomic uint64_t ranges[pool->n_threads];
+    for (int i = 0; i < pool->n_threads; i++) {
+        uint32_t begin = (uint32_t)((int64_t)n_jobs * i / pool->n_threads);
+        uint32_t end = (uint32_t)((int64_t)n_jobs * (i + 1) / pool->n_threads);
+        atomic_init(&ranges[i], pack_range(begin, end));
+    }
+    PoolBatch batch = {.func = func, .ctx = ctx, .ranges = ranges, .n_ranges = pool->n_threads};
+
+    px_mutex_lock(&pool->lock);
+    batch.next = pool->batches;
+    pool->batches = &batch;
+    px_cond_broadcast(&pool->work_cond);
+    px_mutex_unlock(&pool->lock);
+
+    batch_run(&batch, thread_idx);
+
+    // nobody can start helping once the batch is unlinked, wait for those who did
+    px_mutex_lock(&pool->lock);
+    PoolBatch** link = &pool->batches;
+    while (*link != &batch) {
+        link = &(*link)->next;
+    }
+    *link = batch.next;
+    while (batch.n_helpers > 0) {
+        px_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    px_mutex_unlock(&pool->lock);
+
+    return atomic_load(&batch.ret);
+}
+
+int px_thrd_pool_run(PXThreadPool* pool, PXPoolJobFunc func, void* ctx, int n_jobs) {
+    assert(func);
+
+    // jobs posted from a job of the same pool run as the thread that posted them,
+    // other threads take the place of thread 0 and wait for each other
+    bool nested = cur_pool == pool;
+    PXThreadPool* prev_pool = cur_pool;
+    int prev_thread_idx = cur_thread_idx;
+    if (!nested) {
+        px_mutex_lock(&pool->run_lock);
+        cur_pool = pool;
+        cur_thread_idx = 0;
+    }
+
+    int ret = 0;
+    // not worth waking anyone up for
+    if (pool->n_threads == 1 || n_jobs <= 1) {
+        for (int i = 0; i < n_jobs && ret >= 0; i++) {
+            ret = func(ctx, i, cur_thread_idx);
+        }
+        ret = FFMIN(ret, 0);
+    } else {
+        ret = pool_run_batch(pool, func, ctx, n_jobs, cur_thread_idx);
+    }
+
+    if (!nested) {
+        cur_pool = prev_pool;
+        cur_thread_idx = prev_thread_idx;
+        px_mutex_unlock(&pool->run_lock);
+    }
+
+    return ret;
+}
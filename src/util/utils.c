@@ -1,3 +1,6 @@
+// clock_gettime() and its clocks are only declared with POSIX features enabled
+#define _POSIX_C_SOURCE 200809L
+
 #include "../internals.h"
 
 #include <pixie/util/utils.h>
@@ -12,7 +15,14 @@ void px_oom_msg(size_t alloc_size) {
 }
 
 char* px_get_basename(const char* path) {
-    return strrchr(path, *PX_PATH_SEP);
+    const char* sep = strrchr(path, *PX_PATH_SEP);
+#ifdef PX_PLATFORM_WINDOWS
+    // forward slashes are valid separators too
+    const char* fwd_sep = strrchr(path, '/');
+    if (fwd_sep && (!sep || fwd_sep > sep))
+        sep = fwd_sep;
+#endif
+    return (char*)(sep ? sep + 1 : path);
 }
 
 void px_strip_str_end(char* str) {
@@ -83,6 +93,19 @@ void px_aligned_free(void* ptr) {
     free(ptr);
 }
 
+int64_t px_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int64_t px_thread_cpu_time_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)
+        return -1;
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 #elif defined(PX_PLATFORM_WINDOWS)
 
 int px_get_available_threads(void) {
@@ -129,6 +152,24 @@ void px_aligned_free(void* ptr) {
     _aligned_free(ptr);
 }
 
+int64_t px_time_ns(void) {
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (int64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+
+int64_t px_thread_cpu_time_ns(void) {
+    FILETIME creation_time, exit_time, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation_time, &exit_time, &kernel, &user))
+        return -1;
+
+    // in units of 100 ns
+    uint64_t kernel_time = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t user_time = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (int64_t)(kernel_time + user_time) * 100;
+}
+
 char* strndup(const char* src, size_t len) {
     char* dest = malloc(len + 1);
     if (!dest)
@@ -37,29 +37,59 @@ int test_filter_init(PXFilter* filter, const PXMap* args) {
     return 0;
 }
 
-int test_filter_apply(PXFilter* filter) {
+int test_filter_apply_slice(PXFilter* filter, int plane, int y_start, int y_end) {
     TestFilterOptions* opts = filter->user_data;
 
-    for (int p = 0; p < filter->in_frame->n_planes; p++) {
-        const PXVideoPlane* in_plane = &filter->in_frame->planes[p];
-        PXVideoPlane* out_plane = &filter->out_frame->planes[p];
-
-        for (int y = 0; y < in_plane->height; y++) {
-            for (int x = 0; x < in_plane->width; x++) {
-                uint8_t pixel = in_plane->data[y * in_plane->stride + x];
-                if (opts->bar) {
-                    pixel = ~pixel;
-                }
-                pixel += opts->foo;
-
-                out_plane->data[y * out_plane->stride + x] = pixel;
+    const PXVideoPlane* in_plane = &filter->in_frame->planes[plane];
+    PXVideoPlane* out_plane = &filter->out_frame->planes[plane];
+
+    for (int y = y_start; y < y_end; y++) {
+        for (int x = 0; x < in_plane->width; x++) {
+            uint8_t pixel = in_plane->data[y * in_plane->stride + x];
+            if (opts->bar) {
+                pixel = ~pixel;
             }
+            pixel += opts->foo;
+
+            out_plane->data[y * out_plane->stride + x] = pixel;
+        }
+    }
+
+    return 0;
+}
+
+int test_filter_apply(PXFilter* filter) {
+    for (int p = 0; p < filter->in_frame->n_planes; p++) {
+        int ret = test_filter_apply_slice(filter, p, 0, filter->in_frame->planes[p].height);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+// the filter maps each value to another regardless of where it is, so pixie can apply it through
+// a lookup table instead, merged with those of other such filters around it
+int test_filter_get_lut(PXFilter* filter, [[maybe_unused]] int plane, uint16_t* lut, int n_entries) {
+    TestFilterOptions* opts = filter->user_data;
+
+    for (int v = 0; v < n_entries; v++) {
+        uint8_t pixel = (uint8_t)v;
+        if (opts->bar) {
+            pixel = ~pixel;
         }
+        lut[v] = (uint8_t)(pixel + opts->foo);
     }
 
     return 0;
 }
 
+// the filter works on bytes, so only 8-bit formats are supported
+static const PXPixelFormat test_filter_pix_fmts[] = {
+    PX_PIX_FMT_YUV420P8, PX_PIX_FMT_YUV422P8, PX_PIX_FMT_YUV444P8, PX_PIX_FMT_Y8, PX_PIX_FMT_GBRP8,
+    PX_PIX_FMT_NONE,
+};
+
 PXFilter* pixie_export_filter(void) {
     PXFilter* filter = px_filter_alloc();
     if (!filter) {
@@ -70,7 +100,11 @@ PXFilter* pixie_export_filter(void) {
         .name = "test",
         .init = test_filter_init,
         .apply = test_filter_apply,
+        .apply_slice = test_filter_apply_slice,
+        .get_lut = test_filter_get_lut,
         .free = test_filter_free,
+        .flags = PX_FILTER_FRAME_THREADS | PX_FILTER_INPLACE | PX_FILTER_STRIPS,
+        .pix_fmts = test_filter_pix_fmts,
     };
 
     return filter;
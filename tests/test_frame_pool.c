@@ -0,0 +1,109 @@
+#include "../src/internals.h"
+
+#include <pixie/frame.h>
+#include <pixie/util/utils.h>
+#include <libavutil/frame.h>
+#include <assert.h>
+#include <errno.h>
+
+int main(void) {
+    PXFramePool* pool;
+    int ret = px_frame_pool_new(&pool);
+    assert(ret == 0);
+
+    PXFrame frame = {0};
+    ret = px_frame_pool_get(pool, &frame, 64, 32, PX_PIX_FMT_YUV420P8, NULL);
+    assert(ret == 0);
+    assert(frame.buf);
+    assert(px_frame_is_writable(&frame));
+    const uint8_t* first_data = frame.planes[0].data;
+
+    PXFrame ref = {0};
+    px_frame_ref(&ref, &frame);
+    assert(ref.planes[0].data == first_data);
+    assert(!px_frame_is_writable(&frame));
+    assert(!px_frame_is_writable(&ref));
+
+    // buffer is still referenced by `ref`, so a new one has to be allocated
+    px_frame_unref(&frame);
+    assert(!frame.buf);
+    ret = px_frame_pool_get(pool, &frame, 64, 32, PX_PIX_FMT_YUV420P8, NULL);
+    assert(ret == 0);
+    assert(frame.planes[0].data != first_data);
+    px_frame_unref(&frame);
+
+    // last reference dropped, the buffer is reused for the same layout
+    px_frame_unref(&ref);
+    assert(!ref.buf);
+    ret = px_frame_pool_get(pool, &frame, 64, 32, PX_PIX_FMT_YUV420P8, NULL);
+    assert(ret == 0);
+    assert(frame.planes[0].data == first_data);
+    assert(frame.planes[1].data == frame.planes[0].data + px_plane_size(&frame, 0));
+
+    // but not for a different one
+    PXFrame other = {0};
+    ret = px_frame_pool_get(pool, &other, 64, 32, PX_PIX_FMT_YUV420P10, NULL);
+    assert(ret == 0);
+    assert(other.planes[0].data != frame.planes[0].data);
+    assert(other.bytes_per_comp == 2);
+
+    // a shared frame gets its own copy of the data once made writable
+    other.planes[0].data[0] = 42;
+    px_frame_ref(&ref, &other);
+    ret = px_frame_make_writable(&ref, pool);
+    assert(ret == 0);
+    assert(px_frame_is_writable(&ref));
+    assert(px_frame_is_writable(&other));
+    assert(ref.planes[0].data != other.planes[0].data);
+    assert(ref.planes[0].data[0] == 42);
+    px_frame_unref(&ref);
+
+    // a frame buffer only references the frames it holds, dropping the oldest when full
+    PXFrameBuffer fb;
+    ret = px_fb_init(&fb, 2);
+    assert(ret == 0);
+    ret = px_fb_add(&fb, &frame);
+    assert(ret == 0);
+    ret = px_fb_add(&fb, &other);
+    assert(ret == 0);
+    assert(px_fb_get(&fb, 0)->planes[0].data == frame.planes[0].data);
+    assert(!px_frame_is_writable(&frame));
+
+    ret = px_fb_add(&fb, &other);
+    assert(ret == 0);
+    assert(fb.num_frames == 2);
+    assert(px_fb_get(&fb, 0)->planes[0].data == other.planes[0].data);
+    assert(!px_fb_get(&fb, 2));
+    assert(px_frame_is_writable(&frame));
+
+    px_fb_free(&fb);
+    assert(px_frame_is_writable(&other));
+
+    // an AVFrame referencing a frame keeps its buffer out of the pool until the AVFrame is freed
+    AVFrame* av_frame = av_frame_alloc();
+    assert(av_frame);
+    ret = px_frame_to_av(av_frame, &frame);
+    assert(ret == 0);
+    assert(av_frame->data[0] == frame.planes[0].data);
+    assert(!av_buffer_is_writable(av_frame->buf[0]));
+    assert(!px_frame_is_writable(&frame));
+
+    const uint8_t* exported_data = frame.planes[0].data;
+    px_frame_unref(&frame);
+    ret = px_frame_pool_get(pool, &frame, 64, 32, PX_PIX_FMT_YUV420P8, NULL);
+    assert(ret == 0);
+    assert(frame.planes[0].data != exported_data);
+    px_frame_unref(&frame);
+
+    av_frame_free(&av_frame);
+    ret = px_frame_pool_get(pool, &frame, 64, 32, PX_PIX_FMT_YUV420P8, NULL);
+    assert(ret == 0);
+    assert(frame.planes[0].data == exported_data);
+
+    // frames outlive the pool
+    px_frame_pool_free(&pool);
+    assert(!pool);
+    other.planes[0].data[0] = 1;
+    px_frame_unref(&other);
+    px_frame_unref(&frame);
+}
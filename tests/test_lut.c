@@ -0,0 +1,126 @@
+#include "../src/internals.h"
+
+#include <assert.h>
+#include <string.h>
+
+// two passes of the 16-value vector kernels and 8 values for the C ones
+enum : int {
+    width = 40,
+    height = 3,
+};
+
+// halves every value
+static int halve_get_lut([[maybe_unused]] PXFilter* filter, [[maybe_unused]] int plane, uint16_t* lut,
+                         int n_entries) {
+    for (int v = 0; v < n_entries; v++) {
+        lut[v] = (uint16_t)(v / 2);
+    }
+    return 0;
+}
+
+// inverts the values of plane 0 and leaves the others alone
+static int invert_get_lut([[maybe_unused]] PXFilter* filter, int plane, uint16_t* lut, int n_entries) {
+    for (int v = 0; v < n_entries; v++) {
+        lut[v] = (uint16_t)(plane == 0 ? n_entries - 1 - v : v);
+    }
+    return 0;
+}
+
+static int overflow_get_lut([[maybe_unused]] PXFilter* filter, [[maybe_unused]] int plane, uint16_t* lut,
+                            int n_entries) {
+    for (int v = 0; v < n_entries; v++) {
+        lut[v] = (uint16_t)n_entries;
+    }
+    return 0;
+}
+
+static void make_filters(PXFilter filters[2], PXFilter* ptrs[2], PXPixelFormat pix_fmt) {
+    for (int i = 0; i < 2; i++) {
+        filters[i] = (PXFilter) {
+            .name = "lut",
+            .get_lut = i == 0 ? halve_get_lut : invert_get_lut,
+            .in_props = {.width = width, .height = height, .pix_fmt = pix_fmt},
+        };
+        ptrs[i] = &filters[i];
+    }
+}
+
+// what halving and then inverting does to `v` in `plane`
+static int expected(int v, int plane, int max) {
+    return plane == 0 ? max - v / 2 : v / 2;
+}
+
+static int get(const uint16_t* data, int i, int bits) {
+    return bits == 8 ? ((const uint8_t*)data)[i] : data[i];
+}
+
+static void test_pix_fmt(PXPixelFormat pix_fmt) {
+    PXFilter filters[2];
+    PXFilter* ptrs[2];
+    make_filters(filters, ptrs, pix_fmt);
+
+    PXLut lut;
+    int ret = px_lut_build(&lut, ptrs, 0, 2);
+    assert(ret == 0);
+    PXPixFmtDescriptor desc = px_pix_fmt_get_desc(pix_fmt);
+    assert(lut.n_planes == desc.n_planes && lut.bits_per_comp == desc.bits_per_comp);
+
+    int bits = lut.bits_per_comp;
+    int max = (1 << bits) - 1;
+    int stride = width * (bits == 8 ? 1 : 2);
+
+    uint16_t src[height * width];
+    uint16_t dst[height * width];
+    for (int i = 0; i < height * width; i++) {
+        // the last entries of the table make the gathers read into its padding
+        int v = i % 2 ? max - i % 5 : i;
+        if (bits == 8) {
+            ((uint8_t*)src)[i] = (uint8_t)v;
+        } else {
+            // bits above the format's depth are ignored
+            src[i] = (uint16_t)(i % 3 ? v : v | (0xffff & ~max));
+        }
+    }
+
+    for (int p = 0; p < lut.n_planes; p++) {
+        PXVideoPlane src_plane = {.width = width, .height = height, .data = (uint8_t*)src, .stride = stride};
+        PXVideoPlane dst_plane = {.width = width, .height = height, .data = (uint8_t*)dst, .stride = stride};
+        px_lut_apply(&lut, p, &src_plane, &dst_plane, 0, height);
+        for (int i = 0; i < height * width; i++) {
+            assert(get(dst, i, bits) == expected(get(src, i, bits) & max, p, max));
+        }
+
+        // in place, and only the given rows
+        memcpy(dst, src, sizeof dst);
+        px_lut_apply(&lut, p, &dst_plane, &dst_plane, 1, 2);
+        for (int i = 0; i < height * width; i++) {
+            int v = get(src, i, bits);
+            assert(get(dst, i, bits) == (i / width == 1 ? expected(v & max, p, max) : v));
+        }
+    }
+
+    px_lut_free(&lut);
+}
+
+static void test_invalid(void) {
+    PXFilter filters[2];
+    PXFilter* ptrs[2];
+    make_filters(filters, ptrs, PX_PIX_FMT_Y8);
+    filters[1].get_lut = overflow_get_lut;
+
+    PXLut lut;
+    int ret = px_lut_build(&lut, ptrs, 0, 2);
+    assert(ret == PXERROR(EINVAL));
+
+    assert(px_lut_supports_pix_fmt(PX_PIX_FMT_YUV420P16));
+    assert(!px_lut_supports_pix_fmt(PX_PIX_FMT_YF32));
+    assert(!px_lut_supports_pix_fmt(PX_PIX_FMT_NONE));
+}
+
+int main(void) {
+    test_pix_fmt(PX_PIX_FMT_YUV444P8);
+    test_pix_fmt(PX_PIX_FMT_Y10);
+    test_pix_fmt(PX_PIX_FMT_Y16);
+    test_invalid();
+    return 0;
+}
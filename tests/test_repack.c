@@ -0,0 +1,143 @@
+#include "../src/internals.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+// odd sizes so that every kernel also has to handle a tail
+static const int width = 101;
+static const int height = 7;
+
+static void fill_random(uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)rand();
+    }
+}
+
+static void test_nv12(void) {
+    int chroma_w = (width + 1) / 2;
+    int chroma_h = (height + 1) / 2;
+
+    uint8_t nv12[2][128 * 8];
+    fill_random(nv12[0], sizeof nv12[0]);
+    fill_random(nv12[1], sizeof nv12[1]);
+    const uint8_t* const nv12_data[4] = {nv12[0], nv12[1]};
+    const int nv12_stride[4] = {128, 128};
+
+    uint8_t yuv[3][128 * 8] = {0};
+    uint8_t* const yuv_data[4] = {yuv[0], yuv[1], yuv[2]};
+    const int yuv_stride[4] = {128, 64, 64};
+
+    assert(px_can_repack(AV_PIX_FMT_NV12, AV_PIX_FMT_YUV420P));
+    px_repack(nv12_data, nv12_stride, AV_PIX_FMT_NV12, yuv_data, yuv_stride, AV_PIX_FMT_YUV420P, width,
+              height);
+
+    for (int y = 0; y < height; y++) {
+        assert(memcmp(&yuv[0][y * 128], &nv12[0][y * 128], (size_t)width) == 0);
+    }
+    for (int y = 0; y < chroma_h; y++) {
+        for (int x = 0; x < chroma_w; x++) {
+            assert(yuv[1][y * 64 + x] == nv12[1][y * 128 + 2 * x]);
+            assert(yuv[2][y * 64 + x] == nv12[1][y * 128 + 2 * x + 1]);
+        }
+    }
+
+    uint8_t out[2][128 * 8] = {0};
+    uint8_t* const out_data[4] = {out[0], out[1]};
+    const uint8_t* const yuv_const_data[4] = {yuv[0], yuv[1], yuv[2]};
+    px_repack(yuv_const_data, yuv_stride, AV_PIX_FMT_YUV420P, out_data, nv12_stride, AV_PIX_FMT_NV12, width,
+              height);
+
+    for (int y = 0; y < chroma_h; y++) {
+        assert(memcmp(&out[1][y * 128], &nv12[1][y * 128], (size_t)(2 * chroma_w)) == 0);
+    }
+}
+
+static void test_p010(void) {
+    int chroma_w = (width + 1) / 2;
+    int chroma_h = (height + 1) / 2;
+
+    uint16_t p010[2][128 * 8];
+    for (size_t i = 0; i < 128 * 8; i++) {
+        p010[0][i] = (uint16_t)((rand() & 0x3ff) << 6);
+        p010[1][i] = (uint16_t)((rand() & 0x3ff) << 6);
+    }
+    const uint8_t* const p010_data[4] = {(uint8_t*)p010[0], (uint8_t*)p010[1]};
+    const int p010_stride[4] = {256, 256};
+
+    uint16_t yuv[3][128 * 8] = {0};
+    uint8_t* const yuv_data[4] = {(uint8_t*)yuv[0], (uint8_t*)yuv[1], (uint8_t*)yuv[2]};
+    const int yuv_stride[4] = {256, 128, 128};
+
+    assert(px_can_repack(AV_PIX_FMT_P010LE, AV_PIX_FMT_YUV420P10LE));
+    px_repack(p010_data, p010_stride, AV_PIX_FMT_P010LE, yuv_data, yuv_stride, AV_PIX_FMT_YUV420P10LE, width,
+              height);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            assert(yuv[0][y * 128 + x] == p010[0][y * 128 + x] >> 6);
+        }
+    }
+    for (int y = 0; y < chroma_h; y++) {
+        for (int x = 0; x < chroma_w; x++) {
+            assert(yuv[1][y * 64 + x] == p010[1][y * 128 + 2 * x] >> 6);
+            assert(yuv[2][y * 64 + x] == p010[1][y * 128 + 2 * x + 1] >> 6);
+        }
+    }
+
+    uint16_t out[2][128 * 8] = {0};
+    uint8_t* const out_data[4] = {(uint8_t*)out[0], (uint8_t*)out[1]};
+    const uint8_t* const yuv_const_data[4] = {(uint8_t*)yuv[0], (uint8_t*)yuv[1], (uint8_t*)yuv[2]};
+    px_repack(yuv_const_data, yuv_stride, AV_PIX_FMT_YUV420P10LE, out_data, p010_stride, AV_PIX_FMT_P010LE,
+              width, height);
+
+    for (int y = 0; y < height; y++) {
+        assert(memcmp(&out[0][y * 128], &p010[0][y * 128], (size_t)width * 2) == 0);
+    }
+    for (int y = 0; y < chroma_h; y++) {
+        assert(memcmp(&out[1][y * 128], &p010[1][y * 128], (size_t)chroma_w * 4) == 0);
+    }
+}
+
+static void test_rgba(void) {
+    uint8_t rgba[512 * 8];
+    fill_random(rgba, sizeof rgba);
+    const uint8_t* const rgba_data[4] = {rgba};
+    const int rgba_stride[4] = {512};
+
+    uint8_t gbrap[4][128 * 8] = {0};
+    uint8_t* const gbrap_data[4] = {gbrap[0], gbrap[1], gbrap[2], gbrap[3]};
+    const int gbrap_stride[4] = {128, 128, 128, 128};
+
+    assert(px_can_repack(AV_PIX_FMT_RGBA, AV_PIX_FMT_GBRAP));
+    px_repack(rgba_data, rgba_stride, AV_PIX_FMT_RGBA, gbrap_data, gbrap_stride, AV_PIX_FMT_GBRAP, width,
+              height);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const uint8_t* pixel = &rgba[y * 512 + 4 * x];
+            assert(gbrap[0][y * 128 + x] == pixel[1]);
+            assert(gbrap[1][y * 128 + x] == pixel[2]);
+            assert(gbrap[2][y * 128 + x] == pixel[0]);
+            assert(gbrap[3][y * 128 + x] == pixel[3]);
+        }
+    }
+
+    uint8_t out[512 * 8] = {0};
+    uint8_t* const out_data[4] = {out};
+    const uint8_t* const gbrap_const_data[4] = {gbrap[0], gbrap[1], gbrap[2], gbrap[3]};
+    px_repack(gbrap_const_data, gbrap_stride, AV_PIX_FMT_GBRAP, out_data, rgba_stride, AV_PIX_FMT_RGBA, width,
+              height);
+
+    for (int y = 0; y < height; y++) {
+        assert(memcmp(&out[y * 512], &rgba[y * 512], (size_t)width * 4) == 0);
+    }
+}
+
+int main(void) {
+    assert(!px_can_repack(AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV444P));
+
+    test_nv12();
+    test_p010();
+    test_rgba();
+}
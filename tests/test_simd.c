@@ -0,0 +1,208 @@
+#include "../src/internals.h"
+
+#include <pixie/simd.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the kernels are vectorized 64 8-bit, 32 16-bit or 16 float components at a time with AVX-512, and half
+// as many with AVX2, so 3 * 64 - 1 ends on a partial vector with all of them, unrolled twice or not
+// 8 rows leave some of them clear of the edges with the radius 2 kernels of test_convolve()
+enum : int {
+    width = 191,
+    height = 8,
+    stride = 192,
+};
+
+static const int depths[] = {8, 10, 16, 32};
+
+static float comp_max(int depth) {
+    return depth == 32 ? 1.0f : (float)((1 << depth) - 1);
+}
+
+static float get(const void* row, int i, int depth) {
+    if (depth <= 8)
+        return ((const uint8_t*)row)[i];
+    if (depth <= 16)
+        return ((const uint16_t*)row)[i];
+    return ((const float*)row)[i];
+}
+
+static void fill(void* row, int n, int depth) {
+    for (int i = 0; i < n; i++) {
+        if (depth <= 8)
+            ((uint8_t*)row)[i] = (uint8_t)rand();
+        else if (depth <= 16)
+            ((uint16_t*)row)[i] = (uint16_t)(rand() & ((1 << depth) - 1));
+        else
+            ((float*)row)[i] = (float)rand() / (float)RAND_MAX;
+    }
+}
+
+// `v` stored as a `depth` component
+static float expect(float v, int depth) {
+    if (depth == 32)
+        return v;
+    return floorf(fminf(fmaxf(v, 0.0f), comp_max(depth)) + 0.5f);
+}
+
+static void assert_near(float got, float want, float tolerance) {
+    assert(fabsf(got - want) <= tolerance);
+}
+
+static void test_rows(int depth) {
+    float buf_a[width], buf_b[width], buf_dst[width];
+    fill(buf_a, width, depth);
+    fill(buf_b, width, depth);
+    float max = comp_max(depth);
+    float tolerance = depth == 32 ? 1e-5f : 0.0f;
+
+    px_row_add(buf_dst, buf_a, buf_b, width, depth);
+    for (int i = 0; i < width; i++) {
+        float want = expect(get(buf_a, i, depth) + get(buf_b, i, depth), depth);
+        assert_near(get(buf_dst, i, depth), want, tolerance);
+    }
+
+    px_row_mul_add(buf_dst, buf_a, -1.0f, max, width, depth);
+    for (int i = 0; i < width; i++) {
+        assert_near(get(buf_dst, i, depth), expect(max - get(buf_a, i, depth), depth), tolerance);
+    }
+
+    px_row_clamp(buf_dst, buf_a, max / 4, max / 2, width, depth);
+    for (int i = 0; i < width; i++) {
+        float v = fminf(fmaxf(get(buf_a, i, depth), max / 4), max / 2);
+        assert_near(get(buf_dst, i, depth), expect(v, depth), tolerance);
+    }
+
+    // may be fused into a multiply-add, which can round the other way
+    px_row_blend(buf_dst, buf_a, buf_b, 0.25f, width, depth);
+    for (int i = 0; i < width; i++) {
+        float a = get(buf_a, i, depth);
+        float want = expect(a + (get(buf_b, i, depth) - a) * 0.25f, depth);
+        assert_near(get(buf_dst, i, depth), want, depth == 32 ? tolerance : 1.0f);
+    }
+
+    // in place
+    memcpy(buf_dst, buf_a, sizeof buf_a);
+    px_row_add(buf_a, buf_a, buf_b, width, depth);
+    for (int i = 0; i < width; i++) {
+        float want = expect(get(buf_dst, i, depth) + get(buf_b, i, depth), depth);
+        assert_near(get(buf_a, i, depth), want, tolerance);
+    }
+}
+
+static void test_convert(void) {
+    uint8_t u8[width];
+    uint16_t u10[width], u16[width];
+    float f32[width];
+    fill(u8, width, 8);
+    fill(u10, width, 10);
+
+    px_row_convert(u16, 16, u8, 8, width);
+    px_row_convert(f32, 32, u10, 10, width);
+    for (int i = 0; i < width; i++) {
+        assert(u16[i] == u8[i] << 8);
+        assert_near(f32[i], u10[i] / 1023.0f, 1e-6f);
+    }
+
+    px_row_convert(u8, 8, u10, 10, width);
+    for (int i = 0; i < width; i++) {
+        assert(u8[i] == FFMIN((u10[i] + 2) >> 2, 255));
+    }
+
+    px_row_convert(u16, 10, f32, 32, width);
+    for (int i = 0; i < width; i++) {
+        assert(u16[i] == u10[i]);
+    }
+}
+
+static void test_histogram(void) {
+    static uint32_t hist[1 << 16];
+    uint16_t row[width];
+    fill(row, width, 10);
+    row[0] = 0xfc00 | 5; // only the low bits count
+
+    px_row_histogram(hist, row, width, 10);
+    uint32_t total = 0;
+    for (int v = 0; v < 1024; v++) {
+        total += hist[v];
+    }
+    assert(total == width);
+    assert(hist[5] >= 1);
+
+    float frow[3] = {-1.0f, 0.5f, 2.0f};
+    memset(hist, 0, sizeof hist);
+    px_row_histogram(hist, frow, 3, 32);
+    assert(hist[0] == 1 && hist[32768] == 1 && hist[65535] == 1);
+}
+
+// the value of `src` at (x, y) with the edges repeated
+static float pixel(const PXVideoPlane* plane, int x, int y, int depth) {
+    x = FFMIN(FFMAX(x, 0), plane->width - 1);
+    y = FFMIN(FFMAX(y, 0), plane->height - 1);
+    return get(plane->data + (ptrdiff_t)y * plane->stride, x, depth);
+}
+
+static void test_convolve(int depth) {
+    int bytes = depth <= 8 ? 1 : depth <= 16 ? 2 : 4;
+    float src_data[stride * height], dst_data[stride * height];
+    PXVideoPlane src = {
+        .width = width, .height = height, .data = (uint8_t*)src_data, .stride = stride * bytes};
+    PXVideoPlane dst = {
+        .width = width, .height = height, .data = (uint8_t*)dst_data, .stride = stride * bytes};
+    for (int y = 0; y < height; y++) {
+        fill(src.data + y * src.stride, width, depth);
+    }
+
+    const int radius = 2;
+    const float kernel_h[] = {0.1f, 0.2f, 0.4f, 0.2f, 0.1f};
+    const float kernel_v[] = {-0.25f, 0.5f, 0.5f, 0.5f, -0.25f};
+    float tolerance = depth == 32 ? 1e-4f : 1.0f;
+
+    // in two parts, like filters running on threads would
+    int ret = px_plane_convolve(&dst, &src, depth, kernel_h, kernel_v, radius, 0, 4);
+    assert(ret == 0);
+    ret = px_plane_convolve(&dst, &src, depth, kernel_h, kernel_v, radius, 4, height);
+    assert(ret == 0);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float sum = 0.0f;
+            for (int i = -radius; i <= radius; i++) {
+                for (int j = -radius; j <= radius; j++) {
+                    sum += kernel_v[i + radius] * kernel_h[j + radius] * pixel(&src, x + j, y + i, depth);
+                }
+            }
+            assert_near(pixel(&dst, x, y, depth), expect(sum, depth), tolerance);
+        }
+    }
+
+    ret = px_plane_box_blur(&dst, &src, depth, radius, 1, height);
+    assert(ret == 0);
+    for (int y = 1; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float sum = 0.0f;
+            for (int i = -radius; i <= radius; i++) {
+                for (int j = -radius; j <= radius; j++) {
+                    sum += pixel(&src, x + j, y + i, depth);
+                }
+            }
+            assert_near(pixel(&dst, x, y, depth), expect(sum / 25.0f, depth), tolerance);
+        }
+    }
+}
+
+int main(void) {
+    int flags = px_cpu_flags();
+    assert(!(flags & PX_CPU_AVX512) || (flags & PX_CPU_AVX2));
+    assert(px_simd_impl_name());
+
+    for (size_t i = 0; i < FF_ARRAY_ELEMS(depths); i++) {
+        test_rows(depths[i]);
+        test_convolve(depths[i]);
+    }
+    test_convert();
+    test_histogram();
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "../src/internals.h"
+
+#include <pixie/filter.h>
+#include <pixie/util/thread.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+
+enum : int {
+    n_threads = 4,
+    n_outer = 16,
+    n_inner = 100,
+};
+
+typedef struct Counts {
+    PXThreadPool* pool;
+    atomic_int runs[n_outer * n_inner];
+    atomic_bool busy[n_outer][n_threads]; // thread indices in use by each call
+    atomic_int n_done;
+} Counts;
+
+typedef struct InnerCtx {
+    Counts* counts;
+    int outer_idx;
+} InnerCtx;
+
+static int inner_job(void* ctx, int job_idx, int thread_idx) {
+    InnerCtx* inner = ctx;
+    assert(thread_idx >= 0 && thread_idx < n_threads);
+    assert(!atomic_exchange(&inner->counts->busy[inner->outer_idx][thread_idx], true));
+
+    atomic_fetch_add(&inner->counts->runs[inner->outer_idx * n_inner + job_idx], 1);
+
+    atomic_store(&inner->counts->busy[inner->outer_idx][thread_idx], false);
+    return 0;
+}
+
+// posts jobs of its own from within the pool
+static int outer_job(void* ctx, int job_idx, [[maybe_unused]] int thread_idx) {
+    Counts* counts = ctx;
+    InnerCtx inner = {.counts = counts, .outer_idx = job_idx};
+    int ret = px_thrd_pool_run(counts->pool, inner_job, &inner, n_inner);
+    atomic_fetch_add(&counts->n_done, 1);
+    return ret;
+}
+
+static int failing_job([[maybe_unused]] void* ctx, int job_idx, [[maybe_unused]] int thread_idx) {
+    return job_idx == 37 ? PXERROR(EINVAL) : 0;
+}
+
+// calls that don't wake up the pool still have their thread index to themselves
+static int single_job([[maybe_unused]] void* ctx, [[maybe_unused]] int job_idx, int thread_idx) {
+    static atomic_bool busy[n_threads];
+    assert(!atomic_exchange(&busy[thread_idx], true));
+    // hold on to it for long enough for the other callers to collide with it
+    for (volatile int i = 0; i < 10000; i++) {
+    }
+    atomic_store(&busy[thread_idx], false);
+    return 0;
+}
+
+static void test_nested(PXThreadPool* pool) {
+    static Counts counts;
+    counts.pool = pool;
+
+    int ret = px_thrd_pool_run(pool, outer_job, &counts, n_outer);
+    assert(ret == 0);
+    assert(atomic_load(&counts.n_done) == n_outer);
+    for (int i = 0; i < n_outer * n_inner; i++) {
+        assert(atomic_load(&counts.runs[i]) == 1);
+    }
+
+    ret = px_thrd_pool_run(pool, failing_job, NULL, 100);
+    assert(ret == PXERROR(EINVAL));
+}
+
+static void test_parallel_for(PXThreadPool* pool) {
+    static Counts counts;
+    counts.pool = pool;
+    InnerCtx inner = {.counts = &counts};
+
+    // runs on the calling thread without a pool
+    PXFilter filter = {.name = "test"};
+    assert(px_parallel_threads(&filter) == 1);
+    int ret = px_parallel_for(&filter, n_inner, inner_job, &inner);
+    assert(ret == 0);
+
+    filter.thread_pool = pool;
+    assert(px_parallel_threads(&filter) == n_threads);
+    ret = px_parallel_for(&filter, n_inner, inner_job, &inner);
+    assert(ret == 0);
+
+    for (int i = 0; i < n_inner; i++) {
+        assert(atomic_load(&counts.runs[i]) == 2);
+    }
+}
+
+// runs single jobs on `ctx` (the pool), which other threads outside of it are doing as well
+static int post_single_jobs(void* ctx) {
+    for (int i = 0; i < 1000; i++) {
+        int ret = px_thrd_pool_run(ctx, single_job, NULL, 1);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static void test_outside_callers(PXThreadPool* pool) {
+    PXThread threads[2];
+    for (int i = 0; i < 2; i++) {
+        threads[i] = (PXThread) {.func = post_single_jobs, .args = pool};
+        int ret = px_thrd_launch(&threads[i]);
+        assert(ret == 0);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        int thread_ret = -1;
+        int ret = px_thrd_join(&threads[i], &thread_ret);
+        assert(ret == 0 && thread_ret == 0);
+    }
+}
+
+int main(void) {
+    PXThreadPool* pool;
+    int ret = px_thrd_pool_new(&pool, n_threads);
+    assert(ret == 0);
+    assert(px_thrd_pool_num_threads(pool) == n_threads);
+
+    test_nested(pool);
+    test_parallel_for(pool);
+    test_outside_callers(pool);
+
+    px_thrd_pool_free(&pool);
+    return 0;
+}